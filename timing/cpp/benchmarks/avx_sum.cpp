@@ -1,3 +1,9 @@
+#include "avx_sum_sse42.h"
+#include "buffer_allocator.h"
+#include "cache_state.h"
+#include "dataset_cache.h"
+#include "roofline.h"
+#include "tune_table.h"
 #include "immintrin.h"
 #include "tbb/blocked_range.h"
 #include "tbb/parallel_reduce.h"
@@ -6,57 +12,56 @@
 #include "tbb/task_scheduler_init.h"
 #include "tbb/tbb.h"
 #include "tbb/tick_count.h"
+#include "work_stealing_pool.h"
 #include "xmmintrin.h"
+#include <ATen/Parallel.h>
 #include <benchmark/benchmark.h>
+#include <algorithm>
+#include <atomic>
 #include <cassert>
 #include <cstdint>
 #include <cstdlib>
 #include <cstring>
 #include <ctime>
+#include <execution>
 #include <fstream>
 #include <functional>
 #include <iomanip>
 #include <iostream>
+#include <limits>
 #include <map>
 #include <memory>
+#include <mutex>
 #include <numeric>
 #include <omp.h>
 #include <random>
+#include <set>
+#include <sstream>
 #include <stdexcept>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <unistd.h>
 #include <vector>
 
-// Mimic TH alignment
-constexpr size_t _ALIGNMENT = 64;
-
 using namespace tbb;
 
 // HELPER FUNCTIONS
 
-void make_vector(float *data_, size_t size) {
-  for (size_t i = 0; i < size; i++) {
-    data_[i] = (float)(i % 1024);
-  }
-}
-
 static inline int64_t round_down(int64_t a, int64_t m) { return a - (a % m); }
 
 inline int64_t divup(int64_t x, int64_t y) { return (x + y - 1) / y; }
 
-void make_random_vector(float *data_, size_t size) {
-  std::random_device
-      rd; // Will be used to obtain a seed for the random number engine
-  std::mt19937 gen(rd()); // Standard mersenne_twister_engine seeded with rd()
-  std::normal_distribution<> dis{0, 1};
-  for (size_t i = 0; i < size; i++) {
-    data_[i] = (float)(dis(gen));
-  }
+// Allocation mode is set by the caller, see buffer_allocator.h
+template <typename T> void make_data(T **data_, size_t size) {
+  *data_ = (T *)alloc_buffer(size * sizeof(T));
 }
 
-void make_float_data(float **data_, size_t size) {
-  if (posix_memalign((void **)data_, _ALIGNMENT, size * sizeof(float)))
-    throw std::invalid_argument("received negative value");
-  memset(*data_, 0, size * sizeof(float));
-}
+template <typename T> std::string dtype_name();
+template <> std::string dtype_name<float>() { return "float"; }
+template <> std::string dtype_name<double>() { return "double"; }
+template <> std::string dtype_name<int32_t>() { return "int32"; }
+template <> std::string dtype_name<int64_t>() { return "int64"; }
 
 float get_random_value() {
   std::random_device
@@ -68,21 +73,209 @@ float get_random_value() {
 
 static inline size_t _divup(size_t x, size_t y) { return ((x + y - 1) / y); }
 
+template <typename T>
+double sum_reference(const T *arr, size_t start, size_t end) {
+  double sum = 0;
+  for (size_t i = start; i < end; i++) {
+    sum += arr[i];
+  }
+  return sum;
+}
+
+template <typename T>
+void reducesum_reference(const T *arr, double *outarr, size_t size1b,
+                         size_t size1e, size_t size2b, size_t size2e,
+                         size_t size2) {
+  for (size_t i = size1b; i < size1e; i += 1) {
+    for (size_t j = size2b; j < size2e; j += 1) {
+      outarr[j] += arr[i * size2 + j];
+    }
+  }
+}
+
+double relative_error(double comp, double ref) {
+  if (ref == 0) {
+    return std::abs(comp);
+  }
+  return std::abs(comp - ref) / std::abs(ref);
+}
+
+template <typename T>
+double max_relative_error(const T *comp, const double *ref, size_t size) {
+  double error = 0;
+  for (size_t i = 0; i < size; i++) {
+    error = std::max(error, relative_error(comp[i], ref[i]));
+  }
+  return error;
+}
+
+// CPU DISPATCH
+
+// The target is built with -mavx2, so AVX2 is the lowest tier a CPU is
+// detected as. The AVX-512 tier is enabled per function so that all of them
+// live in the same binary. The SSE4.2 tier is built without AVX in its own
+// translation unit, see avx_sum_sse42.h, and is only dispatched to when forced
+// with AVX_SUM_CPU_CAPABILITY=sse42. The *_best pointers are set by
+// resolve_dispatch at the start of main.
+#define TARGET_AVX512 __attribute__((target("avx512f")))
+
+enum class CPUCapability { SSE42 = 0, AVX2 = 1, AVX512 = 2 };
+
+std::string cpu_capability_name(CPUCapability capability) {
+  switch (capability) {
+  case CPUCapability::AVX512:
+    return "avx512";
+  case CPUCapability::AVX2:
+    return "avx2";
+  default:
+    return "sse42";
+  }
+}
+
+// Never SSE42, the binary doesn't run without AVX2
+CPUCapability supported_cpu_capability() {
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f")) {
+    return CPUCapability::AVX512;
+  }
+  return CPUCapability::AVX2;
+}
+
+// Best supported tier, can be lowered with AVX_SUM_CPU_CAPABILITY=sse42|avx2
+CPUCapability compute_cpu_capability() {
+  CPUCapability capability = supported_cpu_capability();
+  const char *envar = std::getenv("AVX_SUM_CPU_CAPABILITY");
+  if (envar) {
+    for (CPUCapability c : {CPUCapability::SSE42, CPUCapability::AVX2}) {
+      if (cpu_capability_name(c) == envar && c < capability) {
+        capability = c;
+      }
+    }
+  }
+  return capability;
+}
+
+CPUCapability get_cpu_capability() {
+  static CPUCapability capability = compute_cpu_capability();
+  return capability;
+}
+
+template <typename F> F dispatch(F sse42, F avx2, F avx512) {
+  switch (get_cpu_capability()) {
+  case CPUCapability::AVX512:
+    return avx512;
+  case CPUCapability::AVX2:
+    return avx2;
+  default:
+    return sse42;
+  }
+}
+
+template <typename T>
+using sum_fn = void (*)(T &, const T *, size_t, size_t);
+template <typename T>
+using parallelsum_fn = void (*)(T &, const T *, size_t, size_t, size_t, size_t);
+template <typename T>
+using reducesum_fn = void (*)(const T *, T *, size_t, size_t, size_t, size_t,
+                              size_t);
+template <typename T>
+using parallelreducesum_fn = void (*)(const T *, T *, size_t, size_t, size_t,
+                                      size_t, size_t, size_t, size_t);
+template <typename T>
+using stridedsum_fn = void (*)(T &, const T *, size_t, size_t, size_t);
+template <typename T>
+using parallelstridedsum_fn = void (*)(T &, const T *, size_t, size_t, size_t,
+                                       size_t, size_t);
+template <typename T>
+using stridedreducesum_fn = void (*)(const T *, T *, size_t, size_t, size_t,
+                                     size_t, size_t, size_t);
+template <typename T>
+using parallelstridedreducesum_fn = void (*)(const T *, T *, size_t, size_t,
+                                             size_t, size_t, size_t, size_t,
+                                             size_t, size_t);
+
+// AVX2 VECTOR TYPES
+
+// Generic kernels are written against Vec256<T>, which maps the handful of
+// operations they need onto the intrinsics for each dtype.
+template <typename T> struct Vec256;
+
+template <> struct Vec256<float> {
+  using type = __m256;
+  static constexpr int64_t size = 8;
+  static type zero() { return _mm256_setzero_ps(); }
+  static type load(const float *p) { return _mm256_load_ps(p); }
+  static type loadu(const float *p) { return _mm256_loadu_ps(p); }
+  static void storeu(float *p, type a) { _mm256_storeu_ps(p, a); }
+  static void stream(float *p, type a) { _mm256_stream_ps(p, a); }
+  static type add(type a, type b) { return _mm256_add_ps(a, b); }
+};
+
+template <> struct Vec256<double> {
+  using type = __m256d;
+  static constexpr int64_t size = 4;
+  static type zero() { return _mm256_setzero_pd(); }
+  static type load(const double *p) { return _mm256_load_pd(p); }
+  static type loadu(const double *p) { return _mm256_loadu_pd(p); }
+  static void storeu(double *p, type a) { _mm256_storeu_pd(p, a); }
+  static void stream(double *p, type a) { _mm256_stream_pd(p, a); }
+  static type add(type a, type b) { return _mm256_add_pd(a, b); }
+};
+
+template <> struct Vec256<int32_t> {
+  using type = __m256i;
+  static constexpr int64_t size = 8;
+  static type zero() { return _mm256_setzero_si256(); }
+  static type load(const int32_t *p) {
+    return _mm256_load_si256((const __m256i *)p);
+  }
+  static type loadu(const int32_t *p) {
+    return _mm256_loadu_si256((const __m256i *)p);
+  }
+  static void storeu(int32_t *p, type a) {
+    _mm256_storeu_si256((__m256i *)p, a);
+  }
+  static void stream(int32_t *p, type a) {
+    _mm256_stream_si256((__m256i *)p, a);
+  }
+  static type add(type a, type b) { return _mm256_add_epi32(a, b); }
+};
+
+template <> struct Vec256<int64_t> {
+  using type = __m256i;
+  static constexpr int64_t size = 4;
+  static type zero() { return _mm256_setzero_si256(); }
+  static type load(const int64_t *p) {
+    return _mm256_load_si256((const __m256i *)p);
+  }
+  static type loadu(const int64_t *p) {
+    return _mm256_loadu_si256((const __m256i *)p);
+  }
+  static void storeu(int64_t *p, type a) {
+    _mm256_storeu_si256((__m256i *)p, a);
+  }
+  static void stream(int64_t *p, type a) {
+    _mm256_stream_si256((__m256i *)p, a);
+  }
+  static type add(type a, type b) { return _mm256_add_epi64(a, b); }
+};
+
 // SUMALL
 
 // ONECORE
 
-inline void sum_naive(float &sum, const float *arr, size_t start, size_t end) {
+template <typename T>
+inline void sum_naive(T &sum, const T *arr, size_t start, size_t end) {
   for (size_t i = start; i < end; i += 1) {
     sum += arr[i];
   }
 }
 
-inline void sum_naive_32(float &sum, const float *arr, size_t start,
-                         size_t end) {
+template <typename T>
+inline void sum_naive_32(T &sum, const T *arr, size_t start, size_t end) {
   int64_t blocks = (end - start) / 32;
   for (int64_t k = 0; k < blocks; k++) {
-    float slocal = 0;
+    T slocal = 0;
     for (size_t j = 0; j < 32; j++) {
       slocal += arr[start + k * 32 + j];
     }
@@ -91,90 +284,287 @@ inline void sum_naive_32(float &sum, const float *arr, size_t start,
   sum_naive(sum, arr, start + blocks * 32, end);
 }
 
-inline void sum_simple_128(float &sum, const float *arr, size_t start,
-                           size_t end) {
-  __m256 a[4]; // 128 bytes (two cache lines)
-  a[0] = _mm256_set1_ps(0);
-  a[1] = _mm256_set1_ps(0);
-  a[2] = _mm256_set1_ps(0);
-  a[3] = _mm256_set1_ps(0);
-  for (int64_t k = 0; k < (end - start) / 32; k++) {
-    for (size_t i = 0; i < 4; i++) {
-      a[i] = _mm256_add_ps(a[i], _mm256_loadu_ps(arr + start + k * 32 + i * 8));
+// Generic unrolled kernel. Each iteration loads ACC * UNROLL vectors into ACC
+// independent accumulators, so ACC controls the length of the dependency
+// chains and UNROLL the number of loads issued per loop branch. With ALIGNED
+// a scalar prologue brings arr + start to a 32 byte boundary so that the main
+// loop can use aligned loads.
+template <typename T, int ACC, int UNROLL, bool ALIGNED>
+inline void sum_unrolled(T &sum, const T *arr, size_t start, size_t end) {
+  using Vec = Vec256<T>;
+  static_assert(ACC > 0 && UNROLL > 0, "sum_unrolled needs ACC, UNROLL > 0");
+  const int64_t step = ACC * UNROLL * Vec::size;
+  if (ALIGNED) {
+    while (start < end && ((uintptr_t)(arr + start)) % 32 != 0) {
+      sum += arr[start++];
     }
   }
-  for (size_t i = 0; i < 4; i++) {
-    float sarr[8];
-    _mm256_store_ps(sarr, a[i]);
-    for (int i = 0; i < 8; i++) {
-      sum += sarr[i];
+  typename Vec::type a[ACC];
+  for (int i = 0; i < ACC; i++) {
+    a[i] = Vec::zero();
+  }
+  int64_t blocks = (end - start) / step;
+  for (int64_t k = 0; k < blocks; k++) {
+    const T *block = arr + start + k * step;
+    for (int u = 0; u < UNROLL; u++) {
+      for (int i = 0; i < ACC; i++) {
+        const T *p = block + (u * ACC + i) * Vec::size;
+        a[i] = Vec::add(a[i], ALIGNED ? Vec::load(p) : Vec::loadu(p));
+      }
     }
   }
-  sum_naive(sum, arr, start + ((end - start) / 32) * 32, end);
+  for (int width = 1; width < ACC; width *= 2) {
+    for (int i = 0; i + width < ACC; i += 2 * width) {
+      a[i] = Vec::add(a[i], a[i + width]);
+    }
+  }
+  T sarr[Vec::size];
+  Vec::storeu(sarr, a[0]);
+  for (int i = 0; i < Vec::size; i++) {
+    sum += sarr[i];
+  }
+  sum_naive(sum, arr, start + blocks * step, end);
 }
 
-inline void sum_simple_128_aligned(float &sum, const float *arr, size_t start,
+template <typename T>
+inline void sum_simple_128(T &sum, const T *arr, size_t start, size_t end) {
+  sum_unrolled<T, 4, 1, false>(sum, arr, start, end);
+}
+
+template <typename T>
+inline void sum_simple_128_aligned(T &sum, const T *arr, size_t start,
                                    size_t end) {
-  __m256 a[4]; // 128 bytes (two cache lines)
-  a[0] = _mm256_set1_ps(0);
-  a[1] = _mm256_set1_ps(0);
-  a[2] = _mm256_set1_ps(0);
-  a[3] = _mm256_set1_ps(0);
+  sum_unrolled<T, 4, 1, true>(sum, arr, start, end);
+}
+
+template <typename T>
+inline void sum_simple_256(T &sum, const T *arr, size_t start, size_t end) {
+  sum_unrolled<T, 8, 1, false>(sum, arr, start, end);
+}
+
+template <typename T>
+inline void sum_simple(T &sum, const T *arr, size_t start, size_t end) {
+  sum_unrolled<T, 1, 1, false>(sum, arr, start, end);
+}
+
+// Instantiates sum_unrolled over the grid of accumulators x unroll x alignment
+// swept by the benchmarks.
+template <typename T> struct SumConfig {
+  std::string name;
+  sum_fn<T> sumf;
+  int64_t accumulators;
+  int64_t unroll;
+  bool aligned;
+};
+
+template <typename T, int ACC, int UNROLL>
+void add_sum_config(std::vector<SumConfig<T>> &configs) {
+  std::string name = "sum_unrolled_a" + std::to_string(ACC) + "_u" +
+                     std::to_string(UNROLL);
+  configs.push_back({name, &sum_unrolled<T, ACC, UNROLL, false>, ACC, UNROLL,
+                     false});
+  configs.push_back({name + "_aligned", &sum_unrolled<T, ACC, UNROLL, true>,
+                     ACC, UNROLL, true});
+}
+
+template <typename T, int ACC>
+void add_sum_configs(std::vector<SumConfig<T>> &configs) {
+  add_sum_config<T, ACC, 1>(configs);
+  add_sum_config<T, ACC, 2>(configs);
+  add_sum_config<T, ACC, 4>(configs);
+}
+
+// AVX2 has 16 vector registers, so 16 accumulators already spill
+template <typename T> std::vector<SumConfig<T>> make_sum_configs() {
+  std::vector<SumConfig<T>> configs;
+  add_sum_configs<T, 1>(configs);
+  add_sum_configs<T, 2>(configs);
+  add_sum_configs<T, 4>(configs);
+  add_sum_configs<T, 6>(configs);
+  add_sum_configs<T, 8>(configs);
+  add_sum_configs<T, 12>(configs);
+  add_sum_configs<T, 16>(configs);
+  return configs;
+}
+
+// AVX-512 tier
+TARGET_AVX512 inline void sum_simple_avx512(float &sum, const float *arr,
+                                            size_t start, size_t end) {
+  __m512 a = _mm512_set1_ps(0);
+  int64_t blocks = (end - start) / 16;
+  for (int64_t k = 0; k < blocks; k++) {
+    a = _mm512_add_ps(a, _mm512_loadu_ps(arr + start + k * 16));
+  }
+  float sarr[16];
+  _mm512_storeu_ps(sarr, a);
+  for (int i = 0; i < 16; i++) {
+    sum += sarr[i];
+  }
+  sum_naive(sum, arr, start + blocks * 16, end);
+}
+
+TARGET_AVX512 inline void sum_simple_128_avx512(float &sum, const float *arr,
+                                                size_t start, size_t end) {
+  __m512 a[2]; // 128 bytes (two cache lines)
+  a[0] = _mm512_set1_ps(0);
+  a[1] = _mm512_set1_ps(0);
   for (int64_t k = 0; k < (end - start) / 32; k++) {
-    for (size_t i = 0; i < 4; i++) {
-      a[i] = _mm256_add_ps(a[i], _mm256_load_ps(arr + start + k * 32 + i * 8));
+    for (size_t i = 0; i < 2; i++) {
+      a[i] =
+          _mm512_add_ps(a[i], _mm512_loadu_ps(arr + start + k * 32 + i * 16));
     }
   }
-  for (size_t i = 0; i < 4; i++) {
-    float sarr[8];
-    _mm256_store_ps(sarr, a[i]);
-    for (int i = 0; i < 8; i++) {
+  for (size_t i = 0; i < 2; i++) {
+    float sarr[16];
+    _mm512_storeu_ps(sarr, a[i]);
+    for (int i = 0; i < 16; i++) {
       sum += sarr[i];
     }
   }
   sum_naive(sum, arr, start + ((end - start) / 32) * 32, end);
 }
 
-inline void sum_simple_256(float &sum, const float *arr, size_t start,
-                           size_t end) {
-  __m256 a[8]; // 128 bytes (two cache lines)
-  a[0] = _mm256_set1_ps(0);
-  a[1] = _mm256_set1_ps(0);
-  a[2] = _mm256_set1_ps(0);
-  a[3] = _mm256_set1_ps(0);
-  a[4] = _mm256_set1_ps(0);
-  a[5] = _mm256_set1_ps(0);
-  a[6] = _mm256_set1_ps(0);
-  a[7] = _mm256_set1_ps(0);
+TARGET_AVX512 inline void sum_simple_256_avx512(float &sum, const float *arr,
+                                                size_t start, size_t end) {
+  __m512 a[4]; // 256 bytes (four cache lines)
+  a[0] = _mm512_set1_ps(0);
+  a[1] = _mm512_set1_ps(0);
+  a[2] = _mm512_set1_ps(0);
+  a[3] = _mm512_set1_ps(0);
   for (int64_t k = 0; k < (end - start) / 64; k++) {
-    for (size_t i = 0; i < 8; i++) {
-      a[i] = _mm256_add_ps(a[i], _mm256_loadu_ps(arr + start + k * 64 + i * 8));
+    for (size_t i = 0; i < 4; i++) {
+      a[i] =
+          _mm512_add_ps(a[i], _mm512_loadu_ps(arr + start + k * 64 + i * 16));
     }
   }
-  for (size_t i = 0; i < 8; i++) {
-    float sarr[8];
-    _mm256_store_ps(sarr, a[i]);
-    for (int i = 0; i < 8; i++) {
+  for (size_t i = 0; i < 4; i++) {
+    float sarr[16];
+    _mm512_storeu_ps(sarr, a[i]);
+    for (int i = 0; i < 16; i++) {
       sum += sarr[i];
     }
   }
   sum_naive(sum, arr, start + ((end - start) / 64) * 64, end);
 }
 
-inline void sum_simple(float &sum, const float *arr, size_t start, size_t end) {
-  register size_t k;
-  __m256 a; // 128 bytes (two cache lines)
-  a = _mm256_set1_ps(0);
-  int64_t blocks = (end - start) / 8;
-  for (int64_t k = 0; k < blocks; k++) {
-    a = _mm256_add_ps(a, _mm256_loadu_ps(arr + start + k * 8));
+// Best tier the CPU supports, see resolve_dispatch
+
+static sum_fn<float> sum_simple_best = nullptr;
+static sum_fn<float> sum_simple_128_best = nullptr;
+static sum_fn<float> sum_simple_256_best = nullptr;
+
+void sum_simple_dispatch(float &sum, const float *arr, size_t start,
+                         size_t end) {
+  sum_simple_best(sum, arr, start, end);
+}
+
+void sum_simple_128_dispatch(float &sum, const float *arr, size_t start,
+                             size_t end) {
+  sum_simple_128_best(sum, arr, start, end);
+}
+
+void sum_simple_256_dispatch(float &sum, const float *arr, size_t start,
+                             size_t end) {
+  sum_simple_256_best(sum, arr, start, end);
+}
+
+// COMPENSATED AND PAIRWISE
+
+// Number of terms each lane accumulates sequentially before pairwise combining
+constexpr size_t _PAIRWISE_BASE = 32;
+
+// Neumaier's variant of Kahan summation, also compensates when the new term
+// is larger in magnitude than the running sum.
+inline void neumaier_add(float &sum, float &c, float x) {
+  float t = sum + x;
+  if (std::abs(sum) >= std::abs(x)) {
+    c += (sum - t) + x;
+  } else {
+    c += (x - t) + sum;
   }
-  float sarr[8];
-  _mm256_store_ps(sarr, a);
-  for (int i = 0; i < 8; i++) {
-    sum += sarr[i];
+  sum = t;
+}
+
+inline void kahan_add_ps(__m256 &sum, __m256 &c, __m256 x) {
+  __m256 y = _mm256_sub_ps(x, c);
+  __m256 t = _mm256_add_ps(sum, y);
+  c = _mm256_sub_ps(_mm256_sub_ps(t, sum), y);
+  sum = t;
+}
+
+inline void neumaier_add_ps(__m256 &sum, __m256 &c, __m256 x) {
+  const __m256 sign = _mm256_set1_ps(-0.f);
+  __m256 t = _mm256_add_ps(sum, x);
+  __m256 ge = _mm256_cmp_ps(_mm256_andnot_ps(sign, sum),
+                            _mm256_andnot_ps(sign, x), _CMP_GE_OQ);
+  __m256 big = _mm256_blendv_ps(x, sum, ge);
+  __m256 small = _mm256_blendv_ps(sum, x, ge);
+  c = _mm256_add_ps(c, _mm256_add_ps(_mm256_sub_ps(big, t), small));
+  sum = t;
+}
+
+// Kahan keeps the negated error in c, Neumaier the error itself
+template <bool NEUMAIER>
+inline void sum_compensated_128(float &sum, const float *arr, size_t start,
+                                size_t end) {
+  __m256 a[4]; // 128 bytes (two cache lines)
+  __m256 c[4];
+  for (size_t i = 0; i < 4; i++) {
+    a[i] = _mm256_set1_ps(0);
+    c[i] = _mm256_set1_ps(0);
+  }
+  for (int64_t k = 0; k < (end - start) / 32; k++) {
+    for (size_t i = 0; i < 4; i++) {
+      __m256 val = _mm256_loadu_ps(arr + start + k * 32 + i * 8);
+      if (NEUMAIER) {
+        neumaier_add_ps(a[i], c[i], val);
+      } else {
+        kahan_add_ps(a[i], c[i], val);
+      }
+    }
   }
-  sum_naive(sum, arr, start + blocks * 8, end);
+  float comp = 0;
+  for (size_t i = 0; i < 4; i++) {
+    float sarr[8];
+    float carr[8];
+    _mm256_storeu_ps(sarr, a[i]);
+    _mm256_storeu_ps(carr, c[i]);
+    for (int i = 0; i < 8; i++) {
+      neumaier_add(sum, comp, sarr[i]);
+      neumaier_add(sum, comp, NEUMAIER ? carr[i] : -carr[i]);
+    }
+  }
+  for (size_t i = start + ((end - start) / 32) * 32; i < end; i++) {
+    neumaier_add(sum, comp, arr[i]);
+  }
+  sum += comp;
+}
+
+inline void sum_kahan_128(float &sum, const float *arr, size_t start,
+                          size_t end) {
+  sum_compensated_128<false>(sum, arr, start, end);
+}
+
+inline void sum_neumaier_128(float &sum, const float *arr, size_t start,
+                             size_t end) {
+  sum_compensated_128<true>(sum, arr, start, end);
+}
+
+inline float sum_pairwise_block_128(const float *arr, size_t start,
+                                    size_t end) {
+  if (end <= start + _PAIRWISE_BASE * 32) {
+    float sum = 0;
+    sum_simple_128(sum, arr, start, end);
+    return sum;
+  }
+  size_t mid = start + round_down((end - start) / 2, 32);
+  return sum_pairwise_block_128(arr, start, mid) +
+         sum_pairwise_block_128(arr, mid, end);
+}
+
+inline void sum_pairwise_128(float &sum, const float *arr, size_t start,
+                             size_t end) {
+  sum += sum_pairwise_block_128(arr, start, end);
 }
 
 // Simply way too slow
@@ -184,7 +574,8 @@ inline void sum_simple(float &sum, const float *arr, size_t start, size_t end) {
 
 // PARALLEL
 
-void sum_omp_naive_simd(float &sum, const float *a, size_t start, size_t end,
+template <typename T>
+void sum_omp_naive_simd(T &sum, const T *a, size_t start, size_t end,
                         size_t threshold, size_t max_num_thread) {
   (void)max_num_thread;
   (void)threshold;
@@ -194,7 +585,8 @@ void sum_omp_naive_simd(float &sum, const float *a, size_t start, size_t end,
   }
 }
 
-void sum_omp_naive(float &sum, const float *a, size_t start, size_t end,
+template <typename T>
+void sum_omp_naive(T &sum, const T *a, size_t start, size_t end,
                    size_t threshold, size_t max_num_thread) {
   (void)max_num_thread;
   (void)threshold;
@@ -204,22 +596,27 @@ void sum_omp_naive(float &sum, const float *a, size_t start, size_t end,
   }
 }
 
-void sum_omp_reduce_128(float &sum, const float *a, size_t start, size_t end,
+// The parallel kernels below are templated on their single core kernel so
+// that every ISA tier and dtype can be benchmarked in parallel as well.
+
+template <typename T, sum_fn<T> SUMF>
+void sum_omp_reduce_128(T &sum, const T *a, size_t start, size_t end,
                         size_t threshold, size_t max_num_thread) {
 #pragma omp parallel for reduction(+ : sum)
   for (size_t i = start; i < end; i += threshold) {
-    float result = 0;
-    sum_simple_128(result, a, i, std::min(i + threshold, end));
+    T result = 0;
+    SUMF(result, a, i, std::min(i + threshold, end));
     sum += result;
   }
 }
 
-void sum_omp_simple_128(float &sum, const float *a, size_t start_, size_t end_,
+template <typename T, sum_fn<T> SUMF>
+void sum_omp_simple_128(T &sum, const T *a, size_t start_, size_t end_,
                         size_t threshold, size_t max_num_thread) {
   (void)max_num_thread;
   int64_t num_threads = omp_get_max_threads();
-  std::vector<float> results(num_threads, 0);
-  float *results_data = results.data();
+  std::vector<T> results(num_threads, 0);
+  T *results_data = results.data();
   int64_t end = end_;
   int64_t start = start_;
   int64_t range = end - start;
@@ -229,8 +626,8 @@ void sum_omp_simple_128(float &sum, const float *a, size_t start_, size_t end_,
     int64_t tid = omp_get_thread_num();
     int64_t chunk_size = divup(range, num_threads);
     int64_t start_tid = start + tid * chunk_size;
-    float result = 0;
-    sum_simple_128(result, a, start_tid, std::min(end, chunk_size + start_tid));
+    T result = 0;
+    SUMF(result, a, start_tid, std::min(end, chunk_size + start_tid));
     results_data[tid] = result;
   }
   for (int64_t i = 0; i < num_threads; i++) {
@@ -238,39 +635,129 @@ void sum_omp_simple_128(float &sum, const float *a, size_t start_, size_t end_,
   }
 }
 
-class SumFoo {
-  const float *my_a;
+template <typename T, sum_fn<T> SUMF> class SumFoo {
+  const T *my_a;
 
 public:
-  float my_sum;
+  T my_sum;
   void operator()(const blocked_range<size_t> &r) {
-    const float *a = my_a;
-    float sum = 0;
-    sum_simple_128(sum, a, r.begin(), r.end());
+    const T *a = my_a;
+    T sum = 0;
+    SUMF(sum, a, r.begin(), r.end());
     my_sum += sum;
   }
   SumFoo(SumFoo &x, split) : my_a(x.my_a), my_sum(0) {}
   void join(const SumFoo &y) { my_sum += y.my_sum; }
-  SumFoo(const float *a) : my_a(a), my_sum(0) {}
+  SumFoo(const T *a) : my_a(a), my_sum(0) {}
+};
+
+// Initialized task_arenas by concurrency. Arenas are created on first use, or
+// ahead of time with reserve so that the timed region never pays for one. At
+// most _MAX_ARENAS are kept, the least recently used one is dropped first. An
+// evicted arena lives on until its last user releases it.
+//
+// reserve also publishes its arenas in a table indexed by concurrency, which
+// execute reads without the lock. Published arenas are never evicted, and as
+// there are at most _MAX_ARENAS of them there is always another one to drop.
+constexpr size_t _MAX_ARENAS = 64;
+
+class ArenaPool {
+  std::map<int64_t, std::shared_ptr<tbb::task_arena>> arenas_;
+  std::map<int64_t, int64_t> last_use_;
+  int64_t clock_ = 0;
+  std::mutex mutex_;
+  std::atomic<tbb::task_arena *> published_[_MAX_ARENAS + 1];
+
+  bool published(int64_t concurrency) {
+    return concurrency >= 0 && concurrency <= (int64_t)_MAX_ARENAS &&
+           published_[concurrency].load(std::memory_order_relaxed);
+  }
+
+  // Under mutex_
+  std::shared_ptr<tbb::task_arena> get_locked(int64_t concurrency) {
+    std::shared_ptr<tbb::task_arena> &arena = arenas_[concurrency];
+    if (!arena) {
+      arena = std::make_shared<tbb::task_arena>(concurrency);
+      arena->initialize();
+    }
+    last_use_[concurrency] = clock_++;
+    std::shared_ptr<tbb::task_arena> result = arena;
+    if (arenas_.size() > _MAX_ARENAS) {
+      auto oldest = last_use_.end();
+      for (auto it = last_use_.begin(); it != last_use_.end(); ++it) {
+        if (!published(it->first) &&
+            (oldest == last_use_.end() || it->second < oldest->second)) {
+          oldest = it;
+        }
+      }
+      arenas_.erase(oldest->first);
+      last_use_.erase(oldest);
+    }
+    return result;
+  }
+
+public:
+  ArenaPool() {
+    for (std::atomic<tbb::task_arena *> &arena : published_) {
+      arena.store(nullptr);
+    }
+  }
+
+  std::shared_ptr<tbb::task_arena> get(int64_t concurrency) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return get_locked(concurrency);
+  }
+
+  // Runs f in the arena of concurrency, the lock is only taken if reserve
+  // didn't publish one
+  template <typename F> void execute(int64_t concurrency, const F &f) {
+    if (concurrency >= 0 && concurrency <= (int64_t)_MAX_ARENAS) {
+      tbb::task_arena *arena =
+          published_[concurrency].load(std::memory_order_acquire);
+      if (arena) {
+        arena->execute(f);
+        return;
+      }
+    }
+    get(concurrency)->execute(f);
+  }
+
+  // Creates and publishes the arenas for concurrency 1 to max_concurrency,
+  // above _MAX_ARENAS they are only created
+  void reserve(int64_t max_concurrency) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (int64_t c = 1; c <= max_concurrency; c++) {
+      std::shared_ptr<tbb::task_arena> arena = get_locked(c);
+      if (c <= (int64_t)_MAX_ARENAS) {
+        published_[c].store(arena.get(), std::memory_order_release);
+      }
+    }
+  }
+
+  size_t size() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return arenas_.size();
+  }
 };
 
-void sum_tbb_ap_arena(float &sum, const float *a, size_t start, size_t end,
+ArenaPool &arena_pool() {
+  static ArenaPool pool;
+  return pool;
+}
+
+// Runs in an arena of one thread per threshold elements when that is fewer
+// than max_num_thread
+template <typename T, sum_fn<T> SUMF>
+void sum_tbb_ap_arena(T &sum, const T *a, size_t start, size_t end,
                       size_t threshold, size_t max_num_thread) {
-  static std::map<int64_t, tbb::task_arena> arenas = {
-      {1, tbb::task_arena(1)},   {2, tbb::task_arena(2)},
-      {4, tbb::task_arena(4)},   {8, tbb::task_arena(8)},
-      {16, tbb::task_arena(16)}, {32, tbb::task_arena(32)}};
   if (end - start < threshold) {
-    sum_simple_128(sum, a, start, end);
+    SUMF(sum, a, start, end);
   } else {
     size_t max_tasks = ((end - start) / threshold);
-    SumFoo sf(a);
+    SumFoo<T, SUMF> sf(a);
     static affinity_partitioner ap;
     if (max_tasks < max_num_thread) {
-      if (arenas.count(max_tasks) == 0) {
-        std::cout << "need arena for " << max_tasks << std::endl;
-      }
-      arenas[max_tasks].execute([&] {
+      arena_pool().execute(max_tasks, [&] {
         parallel_reduce(blocked_range<size_t>(start, end, threshold), sf, ap);
       });
     } else {
@@ -280,310 +767,2967 @@ void sum_tbb_ap_arena(float &sum, const float *a, size_t start, size_t end,
   }
 }
 
-void sum_tbb_simp(float &sum, const float *a, size_t start, size_t end,
+template <typename T, sum_fn<T> SUMF>
+void sum_tbb_simp(T &sum, const T *a, size_t start, size_t end,
                   size_t threshold, size_t max_num_thread) {
   (void)max_num_thread;
   static simple_partitioner ap;
   sum += parallel_reduce(
-      blocked_range<size_t>(start, end, threshold), 0.f,
-      [a](const tbb::blocked_range<size_t> &r, float init) -> float {
-        float result = init;
-        sum_simple_128(result, a, r.begin(), r.end());
+      blocked_range<size_t>(start, end, threshold), T(0),
+      [a](const tbb::blocked_range<size_t> &r, T init) -> T {
+        T result = init;
+        SUMF(result, a, r.begin(), r.end());
         return result;
       },
-      std::plus<float>(), ap);
+      std::plus<T>(), ap);
 }
 
-void sum_tbb_ap(float &sum, const float *a, size_t start, size_t end,
+template <typename T, sum_fn<T> SUMF>
+void sum_tbb_ap(T &sum, const T *a, size_t start, size_t end,
                 size_t threshold, size_t max_num_thread) {
   (void)max_num_thread;
   static affinity_partitioner ap;
   sum += parallel_reduce(
-      blocked_range<size_t>(start, end, threshold), 0.f,
-      [a](const tbb::blocked_range<size_t> &r, float init) -> float {
-        float result = init;
-        sum_simple_128(result, a, r.begin(), r.end());
+      blocked_range<size_t>(start, end, threshold), T(0),
+      [a](const tbb::blocked_range<size_t> &r, T init) -> T {
+        T result = init;
+        SUMF(result, a, r.begin(), r.end());
         return result;
       },
-      std::plus<float>(), ap);
+      std::plus<T>(), ap);
 }
 
-void sum_tbb_default(float &sum, const float *a, size_t start, size_t end,
+template <typename T, sum_fn<T> SUMF>
+void sum_tbb_default(T &sum, const T *a, size_t start, size_t end,
                      size_t threshold, size_t max_num_thread) {
   (void)max_num_thread;
   sum += parallel_reduce(
-      blocked_range<int64_t>(start, end, threshold), 0.f,
-      [a](const tbb::blocked_range<int64_t> &r, float init) -> float {
-        float result = init;
-        sum_simple_128(result, a, r.begin(), r.end());
+      blocked_range<int64_t>(start, end, threshold), T(0),
+      [a](const tbb::blocked_range<int64_t> &r, T init) -> T {
+        T result = init;
+        SUMF(result, a, r.begin(), r.end());
         return result;
       },
-      std::plus<float>());
+      std::plus<T>());
 }
 
-// REDUCESUM
-
-// ONECORE
-
-void reducesum_naive(const float *arr, float *outarr, size_t size1b,
-                     size_t size1e, size_t size2b, size_t size2e,
-                     size_t size2) {
-  for (size_t i = size1b; i < size1e; i += 1) {
-    for (size_t j = size2b; j < size2e; j += 1) {
-      outarr[j] += arr[i * size2 + j];
-    }
-  }
+// Same chunking as sum_tbb_simp, on the work-stealing pool
+template <typename T, sum_fn<T> SUMF>
+void sum_ws_simple_128(T &sum, const T *a, size_t start, size_t end,
+                       size_t threshold, size_t max_num_thread) {
+  sum += ws::parallel_reduce(ws::pool(max_num_thread), start, end, threshold,
+                             T(0),
+                             [a](int64_t b, int64_t e, T init) -> T {
+                               T result = init;
+                               SUMF(result, a, b, e);
+                               return result;
+                             },
+                             std::plus<T>());
 }
 
-void reducesum_simple(const float *arr, float *outarr, size_t size1b,
-                      size_t size1e, size_t size2b, size_t size2e,
-                      size_t size2) {
-  int64_t blocks2 = (size2e - size2b) / 8;
-  for (size_t k = 0; k < blocks2; k++) {
-    __m256 b = _mm256_loadu_ps(outarr + size2b + k * 8);
-    for (size_t i = size1b; i < size1e; i++) {
-      __m256 a = _mm256_loadu_ps(arr + i * size2 + size2b + k * 8);
-      b = _mm256_add_ps(a, b);
-    }
-    _mm256_storeu_ps(outarr + size2b + k * 8, b);
-  }
-  for (size_t j = size2b + blocks2 * 8; j < size2e; j += 1) {
-    for (size_t i = size1b; i < size1e; i += 1) {
-      outarr[j] += arr[i * size2 + j];
-    }
+// C++17 parallel algorithms. libstdc++ runs them on TBB, so they follow the
+// task_scheduler_init thread count. Neither takes a grain size, std::reduce
+// leaves all chunking and vectorization to the library.
+template <typename T, bool UNSEQ>
+void sum_std_reduce(T &sum, const T *a, size_t start, size_t end,
+                    size_t threshold, size_t max_num_thread) {
+  (void)threshold;
+  (void)max_num_thread;
+  if (UNSEQ) {
+    sum += std::reduce(std::execution::par_unseq, a + start, a + end, T(0));
+  } else {
+    sum += std::reduce(std::execution::par, a + start, a + end, T(0));
   }
 }
 
-void reducesum_simple_128(const float *arr, float *outarr, size_t size1b,
-                          size_t size1e, size_t size2b, size_t size2e,
-                          size_t size2) {
-  size_t blocks2 = (size2e - size2b) / 32;
-  for (size_t k = 0; k < blocks2; k++) {
-    __m256 b[4];
-    for (size_t ib = 0; ib < 4; ib++) {
-      b[ib] = _mm256_loadu_ps(outarr + size2b + k * 32 + ib * 8);
-    }
-    for (size_t i = size1b; i < size1e; i += 1) {
-      for (size_t ib = 0; ib < 4; ib++) {
-        __m256 val =
-            _mm256_loadu_ps(arr + i * size2 + size2b + k * 32 + ib * 8);
-        b[ib] = _mm256_add_ps(val, b[ib]);
-      }
-    }
-    for (size_t ib = 0; ib < 4; ib++) {
-      _mm256_storeu_ps(outarr + size2b + k * 32 + ib * 8, b[ib]);
-    }
-  }
-  for (size_t j = size2b + blocks2 * 32; j < size2e; j += 1) {
-    for (size_t i = size1b; i < size1e; i += 1) {
-      outarr[j] += arr[i * size2 + j];
-    }
+// Chunks of threshold elements summed with SUMF, the counterpart of
+// sum_tbb_simp. There is no counting iterator, so the chunk starts are
+// materialized.
+template <typename T, sum_fn<T> SUMF>
+void sum_std_transform_reduce_128(T &sum, const T *a, size_t start, size_t end,
+                                  size_t threshold, size_t max_num_thread) {
+  (void)max_num_thread;
+  std::vector<size_t> chunks(divup(end - start, threshold));
+  for (size_t c = 0; c < chunks.size(); c++) {
+    chunks[c] = start + c * threshold;
   }
+  sum += std::transform_reduce(std::execution::par, chunks.begin(),
+                               chunks.end(), T(0), std::plus<T>(),
+                               [=](size_t b) -> T {
+                                 T result = 0;
+                                 SUMF(result, a, b,
+                                      std::min(b + threshold, end));
+                                 return result;
+                               });
 }
 
-// PARALLEL
-
-void reducesum_omp_simple_128(const float *arr, float *outarr, size_t size1b,
-                              size_t size1e, size_t size2b, size_t size2e,
-                              size_t size2, size_t threshold,
-                              size_t num_thread) {
-  (void)num_thread;
-  (void)threshold;
-#pragma omp parallel for
-  for (size_t i = size2b; i < size2e; i += threshold) {
-    reducesum_simple_128(arr, outarr, size1b, size1e, i,
-                         std::min(i + threshold, size2e), size2);
-  }
+// ATen's own primitives, what the shipping CPU kernels use. They run on ATen's
+// parallel backend, OpenMP by default, and so follow omp_set_num_threads. The
+// _grain variants ignore threshold and use ATen's GRAIN_SIZE like the kernels
+// in ATen do.
+template <typename T, sum_fn<T> SUMF, bool GRAIN>
+void sum_aten_simple_128(T &sum, const T *a, size_t start, size_t end,
+                         size_t threshold, size_t max_num_thread) {
+  (void)max_num_thread;
+  int64_t grain_size = GRAIN ? at::internal::GRAIN_SIZE : threshold;
+  sum += at::parallel_reduce(int64_t(start), int64_t(end), grain_size, T(0),
+                             [a](int64_t b, int64_t e, T init) -> T {
+                               T result = init;
+                               SUMF(result, a, b, e);
+                               return result;
+                             },
+                             std::plus<T>());
 }
 
-void reducesum_tbb_simple_128(const float *arr, float *outarr, size_t size1b,
-                              size_t size1e, size_t size2b, size_t size2e,
-                              size_t size2, size_t threshold,
-                              size_t num_thread) {
-  (void)num_thread;
-  static affinity_partitioner ap;
-  parallel_for(blocked_range<size_t>(size2b, size2e, threshold),
+// Like sum_omp_simple_128 and sum_tbb_ap, but the partial results are combined
+// with compensation so that the parallel versions stay as accurate as SUMF.
+
+template <sum_fn<float> SUMF>
+void sum_omp_accurate_128(float &sum, const float *a, size_t start_,
+                          size_t end_, size_t threshold,
+                          size_t max_num_thread) {
+  (void)max_num_thread;
+  int64_t num_threads = omp_get_max_threads();
+  std::vector<float> results(num_threads, 0);
+  float *results_data = results.data();
+  int64_t end = end_;
+  int64_t start = start_;
+  int64_t range = end - start;
+#pragma omp parallel if ((end - start) > threshold)
+  {
+    int64_t num_threads = omp_get_num_threads();
+    int64_t tid = omp_get_thread_num();
+    int64_t chunk_size = divup(range, num_threads);
+    int64_t start_tid = start + tid * chunk_size;
+    float result = 0;
+    SUMF(result, a, start_tid, std::min(end, chunk_size + start_tid));
+    results_data[tid] = result;
+  }
+  float comp = 0;
+  for (int64_t i = 0; i < num_threads; i++) {
+    neumaier_add(sum, comp, results[i]);
+  }
+  sum += comp;
+}
+
+template <sum_fn<float> SUMF>
+void sum_tbb_accurate_128(float &sum, const float *a, size_t start, size_t end,
+                          size_t threshold, size_t max_num_thread) {
+  (void)max_num_thread;
+  static affinity_partitioner ap;
+  std::pair<float, float> result = parallel_reduce(
+      blocked_range<size_t>(start, end, threshold), std::make_pair(0.f, 0.f),
+      [a](const tbb::blocked_range<size_t> &r,
+          std::pair<float, float> init) -> std::pair<float, float> {
+        float result = 0;
+        SUMF(result, a, r.begin(), r.end());
+        neumaier_add(init.first, init.second, result);
+        return init;
+      },
+      [](std::pair<float, float> x,
+         std::pair<float, float> y) -> std::pair<float, float> {
+        neumaier_add(x.first, x.second, y.first);
+        x.second += y.second;
+        return x;
+      },
+      ap);
+  float comp = result.second;
+  neumaier_add(sum, comp, result.first);
+  sum += comp;
+}
+
+// DETERMINISTIC
+
+// The kernels above add one partial per thread or per task, so their float
+// results change with the thread count and the partitioner. The kernels below
+// fix the shape of the reduction instead. Leaves of _DETERMINISTIC_LEAF
+// elements are summed with SUMF and the leaf sums are added in a pairwise tree
+// that only depends on the number of leaves. Threads merely decide who sums
+// which leaf, so the single core, OMP and TBB forms are bitwise identical for
+// any thread count and threshold.
+//
+// threshold sets the number of leaves per task, not the leaf size. OMP deals
+// out tasks of that many leaves statically, TBB uses it as the grain of its
+// affinity_partitioner. Both run serially when there is a single task. The
+// leaf sums live in split_scratch, so a call allocates nothing once the
+// scratch has grown to the leaf count.
+constexpr int64_t _DETERMINISTIC_LEAF = 4096;
+
+// At least bytes of 64 byte aligned scratch, one buffer per calling thread
+// and thread count. Buffers only grow and are never freed between calls.
+inline void *split_scratch(int64_t num_thread, size_t bytes) {
+  struct Scratch {
+    void *ptr = NULL;
+    size_t bytes = 0;
+    Scratch() = default;
+    Scratch(const Scratch &) = delete;
+    ~Scratch() { free(ptr); }
+  };
+  thread_local std::map<int64_t, Scratch> scratches;
+  Scratch &scratch = scratches[num_thread];
+  if (scratch.bytes < bytes) {
+    free(scratch.ptr);
+    scratch.ptr = NULL;
+    scratch.bytes = 0;
+    if (posix_memalign(&scratch.ptr, _BUFFER_ALIGNMENT, bytes))
+      throw std::runtime_error("posix_memalign failed");
+    scratch.bytes = bytes;
+  }
+  return scratch.ptr;
+}
+
+template <typename T> T pairwise_tree(T *partials, int64_t size) {
+  for (int64_t stride = 1; stride < size; stride *= 2) {
+    for (int64_t i = 0; i + stride < size; i += 2 * stride) {
+      partials[i] += partials[i + stride];
+    }
+  }
+  return size > 0 ? partials[0] : T(0);
+}
+
+template <typename T, sum_fn<T> SUMF>
+inline T sum_leaf(const T *a, int64_t start, int64_t end, int64_t leaf) {
+  T result = 0;
+  int64_t b = start + leaf * _DETERMINISTIC_LEAF;
+  SUMF(result, a, b, std::min(b + _DETERMINISTIC_LEAF, end));
+  return result;
+}
+
+inline int64_t deterministic_grain(size_t threshold) {
+  return std::max<int64_t>(threshold / _DETERMINISTIC_LEAF, 1);
+}
+
+template <typename T, sum_fn<T> SUMF>
+void sum_deterministic_128(T &sum, const T *a, size_t start, size_t end) {
+  int64_t leaves = divup(end - start, _DETERMINISTIC_LEAF);
+  T *partials = (T *)split_scratch(1, leaves * sizeof(T));
+  for (int64_t leaf = 0; leaf < leaves; leaf++) {
+    partials[leaf] = sum_leaf<T, SUMF>(a, start, end, leaf);
+  }
+  sum += pairwise_tree(partials, leaves);
+}
+
+template <typename T, sum_fn<T> SUMF>
+void sum_omp_deterministic_128(T &sum, const T *a, size_t start_, size_t end_,
+                               size_t threshold, size_t max_num_thread) {
+  int64_t start = start_;
+  int64_t end = end_;
+  int64_t leaves = divup(end - start, _DETERMINISTIC_LEAF);
+  T *partials = (T *)split_scratch(max_num_thread, leaves * sizeof(T));
+  int64_t grain = deterministic_grain(threshold);
+#pragma omp parallel for schedule(static, grain) if (leaves > grain)
+  for (int64_t leaf = 0; leaf < leaves; leaf++) {
+    partials[leaf] = sum_leaf<T, SUMF>(a, start, end, leaf);
+  }
+  sum += pairwise_tree(partials, leaves);
+}
+
+template <typename T, sum_fn<T> SUMF>
+void sum_tbb_deterministic_128(T &sum, const T *a, size_t start_, size_t end_,
+                               size_t threshold, size_t max_num_thread) {
+  int64_t start = start_;
+  int64_t end = end_;
+  int64_t leaves = divup(end - start, _DETERMINISTIC_LEAF);
+  T *partials = (T *)split_scratch(max_num_thread, leaves * sizeof(T));
+  int64_t grain = deterministic_grain(threshold);
+  static affinity_partitioner ap;
+  parallel_for(blocked_range<int64_t>(0, leaves, grain),
+               [=](const blocked_range<int64_t> &r) {
+                 for (int64_t leaf = r.begin(); leaf < r.end(); leaf++) {
+                   partials[leaf] = sum_leaf<T, SUMF>(a, start, end, leaf);
+                 }
+               },
+               ap);
+  sum += pairwise_tree(partials, leaves);
+}
+
+// REDUCESUM
+
+// ONECORE
+
+template <typename T>
+void reducesum_naive(const T *arr, T *outarr, size_t size1b, size_t size1e,
+                     size_t size2b, size_t size2e, size_t size2) {
+  for (size_t i = size1b; i < size1e; i += 1) {
+    for (size_t j = size2b; j < size2e; j += 1) {
+      outarr[j] += arr[i * size2 + j];
+    }
+  }
+}
+
+template <typename T>
+void reducesum_simple(const T *arr, T *outarr, size_t size1b, size_t size1e,
+                      size_t size2b, size_t size2e, size_t size2) {
+  using Vec = Vec256<T>;
+  const int64_t step = Vec::size;
+  int64_t blocks2 = (size2e - size2b) / step;
+  for (size_t k = 0; k < blocks2; k++) {
+    typename Vec::type b = Vec::loadu(outarr + size2b + k * step);
+    for (size_t i = size1b; i < size1e; i++) {
+      typename Vec::type a = Vec::loadu(arr + i * size2 + size2b + k * step);
+      b = Vec::add(a, b);
+    }
+    Vec::storeu(outarr + size2b + k * step, b);
+  }
+  for (size_t j = size2b + blocks2 * step; j < size2e; j += 1) {
+    for (size_t i = size1b; i < size1e; i += 1) {
+      outarr[j] += arr[i * size2 + j];
+    }
+  }
+}
+
+template <typename T>
+void reducesum_simple_128(const T *arr, T *outarr, size_t size1b,
+                          size_t size1e, size_t size2b, size_t size2e,
+                          size_t size2) {
+  using Vec = Vec256<T>;
+  const int64_t step = 4 * Vec::size;
+  size_t blocks2 = (size2e - size2b) / step;
+  for (size_t k = 0; k < blocks2; k++) {
+    typename Vec::type b[4];
+    for (size_t ib = 0; ib < 4; ib++) {
+      b[ib] = Vec::loadu(outarr + size2b + k * step + ib * Vec::size);
+    }
+    for (size_t i = size1b; i < size1e; i += 1) {
+      for (size_t ib = 0; ib < 4; ib++) {
+        typename Vec::type val =
+            Vec::loadu(arr + i * size2 + size2b + k * step + ib * Vec::size);
+        b[ib] = Vec::add(val, b[ib]);
+      }
+    }
+    for (size_t ib = 0; ib < 4; ib++) {
+      Vec::storeu(outarr + size2b + k * step + ib * Vec::size, b[ib]);
+    }
+  }
+  for (size_t j = size2b + blocks2 * step; j < size2e; j += 1) {
+    for (size_t i = size1b; i < size1e; i += 1) {
+      outarr[j] += arr[i * size2 + j];
+    }
+  }
+}
+
+// AVX-512 tier
+
+TARGET_AVX512 void reducesum_simple_avx512(const float *arr, float *outarr,
+                                           size_t size1b, size_t size1e,
+                                           size_t size2b, size_t size2e,
+                                           size_t size2) {
+  int64_t blocks2 = (size2e - size2b) / 16;
+  for (size_t k = 0; k < blocks2; k++) {
+    __m512 b = _mm512_loadu_ps(outarr + size2b + k * 16);
+    for (size_t i = size1b; i < size1e; i++) {
+      __m512 a = _mm512_loadu_ps(arr + i * size2 + size2b + k * 16);
+      b = _mm512_add_ps(a, b);
+    }
+    _mm512_storeu_ps(outarr + size2b + k * 16, b);
+  }
+  for (size_t j = size2b + blocks2 * 16; j < size2e; j += 1) {
+    for (size_t i = size1b; i < size1e; i += 1) {
+      outarr[j] += arr[i * size2 + j];
+    }
+  }
+}
+
+TARGET_AVX512 void reducesum_simple_128_avx512(const float *arr, float *outarr,
+                                               size_t size1b, size_t size1e,
+                                               size_t size2b, size_t size2e,
+                                               size_t size2) {
+  size_t blocks2 = (size2e - size2b) / 32;
+  for (size_t k = 0; k < blocks2; k++) {
+    __m512 b[2];
+    for (size_t ib = 0; ib < 2; ib++) {
+      b[ib] = _mm512_loadu_ps(outarr + size2b + k * 32 + ib * 16);
+    }
+    for (size_t i = size1b; i < size1e; i += 1) {
+      for (size_t ib = 0; ib < 2; ib++) {
+        __m512 val =
+            _mm512_loadu_ps(arr + i * size2 + size2b + k * 32 + ib * 16);
+        b[ib] = _mm512_add_ps(val, b[ib]);
+      }
+    }
+    for (size_t ib = 0; ib < 2; ib++) {
+      _mm512_storeu_ps(outarr + size2b + k * 32 + ib * 16, b[ib]);
+    }
+  }
+  for (size_t j = size2b + blocks2 * 32; j < size2e; j += 1) {
+    for (size_t i = size1b; i < size1e; i += 1) {
+      outarr[j] += arr[i * size2 + j];
+    }
+  }
+}
+
+static reducesum_fn<float> reducesum_simple_best = nullptr;
+static reducesum_fn<float> reducesum_simple_128_best = nullptr;
+
+void reducesum_simple_dispatch(const float *arr, float *outarr, size_t size1b,
+                               size_t size1e, size_t size2b, size_t size2e,
+                               size_t size2) {
+  reducesum_simple_best(arr, outarr, size1b, size1e, size2b, size2e, size2);
+}
+
+void reducesum_simple_128_dispatch(const float *arr, float *outarr,
+                                   size_t size1b, size_t size1e, size_t size2b,
+                                   size_t size2e, size_t size2) {
+  reducesum_simple_128_best(arr, outarr, size1b, size1e, size2b, size2e,
+                            size2);
+}
+
+// Points the *_dispatch kernels at the best tier, once, before anything calls
+// them
+void resolve_dispatch() {
+  sum_simple_best = dispatch<sum_fn<float>>(
+      sum_simple_sse42, sum_simple<float>, sum_simple_avx512);
+  sum_simple_128_best = dispatch<sum_fn<float>>(
+      sum_simple_128_sse42, sum_simple_128<float>, sum_simple_128_avx512);
+  sum_simple_256_best = dispatch<sum_fn<float>>(
+      sum_simple_256_sse42, sum_simple_256<float>, sum_simple_256_avx512);
+  reducesum_simple_best = dispatch<reducesum_fn<float>>(
+      reducesum_simple_sse42, reducesum_simple<float>,
+      reducesum_simple_avx512);
+  reducesum_simple_128_best = dispatch<reducesum_fn<float>>(
+      reducesum_simple_128_sse42, reducesum_simple_128<float>,
+      reducesum_simple_128_avx512);
+}
+
+// COMPENSATED AND PAIRWISE
+
+template <bool NEUMAIER>
+void reducesum_compensated_128(const float *arr, float *outarr, size_t size1b,
+                               size_t size1e, size_t size2b, size_t size2e,
+                               size_t size2) {
+  size_t blocks2 = (size2e - size2b) / 32;
+  for (size_t k = 0; k < blocks2; k++) {
+    __m256 b[4];
+    __m256 c[4];
+    for (size_t ib = 0; ib < 4; ib++) {
+      b[ib] = _mm256_loadu_ps(outarr + size2b + k * 32 + ib * 8);
+      c[ib] = _mm256_set1_ps(0);
+    }
+    for (size_t i = size1b; i < size1e; i += 1) {
+      for (size_t ib = 0; ib < 4; ib++) {
+        __m256 val =
+            _mm256_loadu_ps(arr + i * size2 + size2b + k * 32 + ib * 8);
+        if (NEUMAIER) {
+          neumaier_add_ps(b[ib], c[ib], val);
+        } else {
+          kahan_add_ps(b[ib], c[ib], val);
+        }
+      }
+    }
+    for (size_t ib = 0; ib < 4; ib++) {
+      b[ib] = NEUMAIER ? _mm256_add_ps(b[ib], c[ib])
+                       : _mm256_sub_ps(b[ib], c[ib]);
+      _mm256_storeu_ps(outarr + size2b + k * 32 + ib * 8, b[ib]);
+    }
+  }
+  for (size_t j = size2b + blocks2 * 32; j < size2e; j += 1) {
+    float comp = 0;
+    for (size_t i = size1b; i < size1e; i += 1) {
+      neumaier_add(outarr[j], comp, arr[i * size2 + j]);
+    }
+    outarr[j] += comp;
+  }
+}
+
+void reducesum_kahan_128(const float *arr, float *outarr, size_t size1b,
+                         size_t size1e, size_t size2b, size_t size2e,
+                         size_t size2) {
+  reducesum_compensated_128<false>(arr, outarr, size1b, size1e, size2b, size2e,
+                                   size2);
+}
+
+void reducesum_neumaier_128(const float *arr, float *outarr, size_t size1b,
+                            size_t size1e, size_t size2b, size_t size2e,
+                            size_t size2) {
+  reducesum_compensated_128<true>(arr, outarr, size1b, size1e, size2b, size2e,
+                                  size2);
+}
+
+// Sums rows [size1b, size1e) of the 32 columns starting at col into b
+void reducesum_pairwise_block_128(__m256 *b, const float *arr, size_t size1b,
+                                  size_t size1e, size_t col, size_t size2) {
+  if (size1e <= size1b + _PAIRWISE_BASE) {
+    for (size_t ib = 0; ib < 4; ib++) {
+      b[ib] = _mm256_set1_ps(0);
+    }
+    for (size_t i = size1b; i < size1e; i += 1) {
+      for (size_t ib = 0; ib < 4; ib++) {
+        __m256 val = _mm256_loadu_ps(arr + i * size2 + col + ib * 8);
+        b[ib] = _mm256_add_ps(val, b[ib]);
+      }
+    }
+    return;
+  }
+  size_t mid = size1b + (size1e - size1b) / 2;
+  __m256 right[4];
+  reducesum_pairwise_block_128(b, arr, size1b, mid, col, size2);
+  reducesum_pairwise_block_128(right, arr, mid, size1e, col, size2);
+  for (size_t ib = 0; ib < 4; ib++) {
+    b[ib] = _mm256_add_ps(b[ib], right[ib]);
+  }
+}
+
+float reducesum_pairwise_naive(const float *arr, size_t size1b, size_t size1e,
+                               size_t col, size_t size2) {
+  if (size1e <= size1b + _PAIRWISE_BASE) {
+    float sum = 0;
+    for (size_t i = size1b; i < size1e; i += 1) {
+      sum += arr[i * size2 + col];
+    }
+    return sum;
+  }
+  size_t mid = size1b + (size1e - size1b) / 2;
+  return reducesum_pairwise_naive(arr, size1b, mid, col, size2) +
+         reducesum_pairwise_naive(arr, mid, size1e, col, size2);
+}
+
+void reducesum_pairwise_128(const float *arr, float *outarr, size_t size1b,
+                            size_t size1e, size_t size2b, size_t size2e,
+                            size_t size2) {
+  size_t blocks2 = (size2e - size2b) / 32;
+  for (size_t k = 0; k < blocks2; k++) {
+    __m256 b[4];
+    reducesum_pairwise_block_128(b, arr, size1b, size1e, size2b + k * 32,
+                                 size2);
+    for (size_t ib = 0; ib < 4; ib++) {
+      __m256 out = _mm256_loadu_ps(outarr + size2b + k * 32 + ib * 8);
+      _mm256_storeu_ps(outarr + size2b + k * 32 + ib * 8,
+                       _mm256_add_ps(out, b[ib]));
+    }
+  }
+  for (size_t j = size2b + blocks2 * 32; j < size2e; j += 1) {
+    outarr[j] += reducesum_pairwise_naive(arr, size1b, size1e, j, size2);
+  }
+}
+
+// PARALLEL
+
+template <typename T, reducesum_fn<T> REDUCESUMF>
+void reducesum_omp_simple_128(const T *arr, T *outarr, size_t size1b,
+                              size_t size1e, size_t size2b, size_t size2e,
+                              size_t size2, size_t threshold,
+                              size_t num_thread) {
+  (void)num_thread;
+  (void)threshold;
+#pragma omp parallel for
+  for (size_t i = size2b; i < size2e; i += threshold) {
+    REDUCESUMF(arr, outarr, size1b, size1e, i,
+               std::min(i + threshold, size2e), size2);
+  }
+}
+
+template <typename T, reducesum_fn<T> REDUCESUMF>
+void reducesum_tbb_simple_128(const T *arr, T *outarr, size_t size1b,
+                              size_t size1e, size_t size2b, size_t size2e,
+                              size_t size2, size_t threshold,
+                              size_t num_thread) {
+  (void)num_thread;
+  static affinity_partitioner ap;
+  parallel_for(blocked_range<size_t>(size2b, size2e, threshold),
+               [&](const tbb::blocked_range<size_t> &r) {
+                 REDUCESUMF(arr, outarr, size1b, size1e, r.begin(),
+                            r.end(), size2);
+               },
+               ap);
+}
+
+// See sum_tbb_ap_arena
+template <typename T, reducesum_fn<T> REDUCESUMF>
+void reducesum_tbb_simple_128_arena(const T *arr, T *outarr, size_t size1b,
+                                    size_t size1e, size_t size2b, size_t size2e,
+                                    size_t size2, size_t threshold,
+                                    size_t max_num_thread) {
+  if (((size2e - size2b)) < threshold) {
+    REDUCESUMF(arr, outarr, size1b, size1e, size2b, size2e, size2);
+  } else {
+    size_t max_tasks = ((size2e - size2b) / threshold);
+    static affinity_partitioner ap;
+    if (max_tasks < max_num_thread) {
+      arena_pool().execute(max_tasks, [&] {
+        parallel_for(blocked_range<size_t>(size2b, size2e, threshold),
+                     [&](const tbb::blocked_range<size_t> &r) {
+                       REDUCESUMF(arr, outarr, size1b, size1e,
+                                  r.begin(), r.end(), size2);
+                     },
+                     ap);
+      });
+    } else {
+      parallel_for(blocked_range<size_t>(size2b, size2e, threshold),
+                   [&](const tbb::blocked_range<size_t> &r) {
+                     REDUCESUMF(arr, outarr, size1b, size1e,
+                                r.begin(), r.end(), size2);
+                   },
+                   ap);
+    }
+  }
+}
+
+template <typename T, reducesum_fn<T> REDUCESUMF>
+void reducesum_ws_simple_128(const T *arr, T *outarr, size_t size1b,
+                             size_t size1e, size_t size2b, size_t size2e,
+                             size_t size2, size_t threshold,
+                             size_t num_thread) {
+  ws::parallel_for(ws::pool(num_thread), size2b, size2e, threshold,
+                   [&](int64_t b, int64_t e) {
+                     REDUCESUMF(arr, outarr, size1b, size1e, b, e, size2);
+                   });
+}
+
+// See sum_aten_simple_128
+template <typename T, reducesum_fn<T> REDUCESUMF, bool GRAIN>
+void reducesum_aten_simple_128(const T *arr, T *outarr, size_t size1b,
+                               size_t size1e, size_t size2b, size_t size2e,
+                               size_t size2, size_t threshold,
+                               size_t num_thread) {
+  (void)num_thread;
+  int64_t grain_size = GRAIN ? at::internal::GRAIN_SIZE : threshold;
+  at::parallel_for(size2b, size2e, grain_size, [&](int64_t b, int64_t e) {
+    REDUCESUMF(arr, outarr, size1b, size1e, b, e, size2);
+  });
+}
+
+// Column blocks of threshold through std::for_each, see sum_std_reduce
+template <typename T, reducesum_fn<T> REDUCESUMF, bool UNSEQ>
+void reducesum_std_simple_128(const T *arr, T *outarr, size_t size1b,
+                              size_t size1e, size_t size2b, size_t size2e,
+                              size_t size2, size_t threshold,
+                              size_t num_thread) {
+  (void)num_thread;
+  std::vector<size_t> blocks(divup(size2e - size2b, threshold));
+  for (size_t b = 0; b < blocks.size(); b++) {
+    blocks[b] = size2b + b * threshold;
+  }
+  auto body = [=](size_t b) {
+    REDUCESUMF(arr, outarr, size1b, size1e, b, std::min(b + threshold, size2e),
+               size2);
+  };
+  if (UNSEQ) {
+    std::for_each(std::execution::par_unseq, blocks.begin(), blocks.end(),
+                  body);
+  } else {
+    std::for_each(std::execution::par, blocks.begin(), blocks.end(), body);
+  }
+}
+
+// OUTER AND 2-D SPLIT
+
+// The kernels above only split size2, so a narrow inner dimension (a handful
+// of columns over millions of rows) runs on a single thread. The kernels below
+// also split size1 into row blocks. Every row block but the first reduces into
+// a partial row of its own, padded to whole cache lines so that neighbouring
+// blocks never share one, and the partial rows are then combined pairwise in
+// log2(outer_blocks) rounds.
+//
+// The partial rows only span [size2b, size2e) and live in split_scratch, so a
+// call allocates nothing once the scratch has grown to its shape. That also
+// keeps the allocation mode and NUMA policy under test out of the kernels.
+
+enum class ReduceSplit { INNER, OUTER, TWO_D };
+
+struct ReduceSplitPlan {
+  ReduceSplit split;
+  int64_t outer_blocks;
+  int64_t inner_blocks;
+};
+
+// Row blocks for the columns of one column block, as many as there are
+// threads while each block keeps at least threshold elements
+inline int64_t outer_split_blocks(int64_t rows, int64_t cols,
+                                  int64_t threshold, int64_t num_thread) {
+  int64_t blocks = std::min(rows * cols / threshold, num_thread);
+  return std::max<int64_t>(std::min(blocks, rows), 1);
+}
+
+// Column blocks come first since they need no partial rows. The threads they
+// leave unused split the rows.
+inline ReduceSplitPlan plan_reduce_split(int64_t rows, int64_t cols,
+                                         int64_t threshold,
+                                         int64_t num_thread) {
+  int64_t inner_blocks =
+      std::max<int64_t>(std::min(divup(cols, threshold), num_thread), 1);
+  int64_t outer_blocks = outer_split_blocks(rows, cols / inner_blocks,
+                                            threshold,
+                                            num_thread / inner_blocks);
+  if (outer_blocks == 1) {
+    return {ReduceSplit::INNER, 1, inner_blocks};
+  }
+  if (inner_blocks == 1) {
+    return {ReduceSplit::OUTER, outer_blocks, 1};
+  }
+  return {ReduceSplit::TWO_D, outer_blocks, inner_blocks};
+}
+
+template <typename T, reducesum_fn<T> REDUCESUMF, bool TBB>
+void reducesum_split(const T *arr, T *outarr, size_t size1b, size_t size1e,
+                     size_t size2b, size_t size2e, size_t size2,
+                     ReduceSplitPlan plan, size_t num_thread) {
+  int64_t outer_blocks = plan.outer_blocks;
+  int64_t inner_blocks = plan.inner_blocks;
+  int64_t rows = divup(size1e - size1b, outer_blocks);
+  int64_t cols = divup(size2e - size2b, inner_blocks);
+  // Partial row o - 1 holds the columns of [size2b, size2e) from 0, and is
+  // reduced into through arr + size2b so that the kernel indexes it from 0
+  int64_t line = _BUFFER_ALIGNMENT / sizeof(T);
+  int64_t row_stride = divup(size2e - size2b, line) * line;
+  T *partials = NULL;
+  if (outer_blocks > 1) {
+    partials = (T *)split_scratch(num_thread, (outer_blocks - 1) * row_stride *
+                                                  sizeof(T));
+  }
+  auto reduce_block = [&](int64_t task) {
+    int64_t o = task / inner_blocks;
+    int64_t c = task % inner_blocks;
+    int64_t r0 = size1b + o * rows;
+    int64_t c0 = size2b + c * cols;
+    int64_t r1 = std::min<int64_t>(r0 + rows, size1e);
+    int64_t c1 = std::min<int64_t>(c0 + cols, size2e);
+    if (c0 >= c1) {
+      return;
+    }
+    if (o == 0) {
+      if (r0 < r1) {
+        REDUCESUMF(arr, outarr, r0, r1, c0, c1, size2);
+      }
+      return;
+    }
+    T *partial = partials + (o - 1) * row_stride;
+    memset(partial + c0 - size2b, 0, (c1 - c0) * sizeof(T));
+    if (r0 < r1) {
+      REDUCESUMF(arr + size2b, partial, r0, r1, c0 - size2b, c1 - size2b,
+                 size2);
+    }
+  };
+  // Partial row o - 1 for o > 0, outarr shifted to size2b for o == 0
+  auto row = [&](int64_t o) {
+    return o == 0 ? outarr + size2b : partials + (o - 1) * row_stride;
+  };
+  int64_t tasks = outer_blocks * inner_blocks;
+  if (TBB) {
+    parallel_for(blocked_range<int64_t>(0, tasks, 1),
+                 [&](const blocked_range<int64_t> &r) {
+                   for (int64_t t = r.begin(); t < r.end(); t++) {
+                     reduce_block(t);
+                   }
+                 },
+                 simple_partitioner());
+  } else {
+#pragma omp parallel for schedule(static)
+    for (int64_t t = 0; t < tasks; t++) {
+      reduce_block(t);
+    }
+  }
+  // Round step adds row o + step into row o for every o divisible by 2 * step
+  for (int64_t step = 1; step < outer_blocks; step *= 2) {
+    auto combine = [&](int64_t pair) {
+      T *dst = row(2 * step * pair);
+      const T *src = row(2 * step * pair + step);
+      for (size_t j = 0; j < size2e - size2b; j++) {
+        dst[j] += src[j];
+      }
+    };
+    int64_t pairs = divup(outer_blocks - step, 2 * step);
+    if (TBB) {
+      parallel_for(int64_t(0), pairs, combine);
+    } else {
+#pragma omp parallel for if (pairs > 1)
+      for (int64_t pair = 0; pair < pairs; pair++) {
+        combine(pair);
+      }
+    }
+  }
+}
+
+// Always splits the rows only, the counterpart of reducesum_*_simple_128
+template <typename T, reducesum_fn<T> REDUCESUMF>
+void reducesum_omp_outer_128(const T *arr, T *outarr, size_t size1b,
+                             size_t size1e, size_t size2b, size_t size2e,
+                             size_t size2, size_t threshold,
+                             size_t num_thread) {
+  int64_t outer_blocks = outer_split_blocks(size1e - size1b, size2e - size2b,
+                                            threshold, num_thread);
+  reducesum_split<T, REDUCESUMF, false>(
+      arr, outarr, size1b, size1e, size2b, size2e, size2,
+      {ReduceSplit::OUTER, outer_blocks, 1}, num_thread);
+}
+
+template <typename T, reducesum_fn<T> REDUCESUMF>
+void reducesum_tbb_outer_128(const T *arr, T *outarr, size_t size1b,
+                             size_t size1e, size_t size2b, size_t size2e,
+                             size_t size2, size_t threshold,
+                             size_t num_thread) {
+  int64_t outer_blocks = outer_split_blocks(size1e - size1b, size2e - size2b,
+                                            threshold, num_thread);
+  reducesum_split<T, REDUCESUMF, true>(
+      arr, outarr, size1b, size1e, size2b, size2e, size2,
+      {ReduceSplit::OUTER, outer_blocks, 1}, num_thread);
+}
+
+// Picks the split from the shape, the inner one is left to the existing kernels
+template <typename T, reducesum_fn<T> REDUCESUMF>
+void reducesum_omp_split_128(const T *arr, T *outarr, size_t size1b,
+                             size_t size1e, size_t size2b, size_t size2e,
+                             size_t size2, size_t threshold,
+                             size_t num_thread) {
+  ReduceSplitPlan plan = plan_reduce_split(size1e - size1b, size2e - size2b,
+                                           threshold, num_thread);
+  if (plan.split == ReduceSplit::INNER) {
+    reducesum_omp_simple_128<T, REDUCESUMF>(arr, outarr, size1b, size1e,
+                                            size2b, size2e, size2, threshold,
+                                            num_thread);
+  } else {
+    reducesum_split<T, REDUCESUMF, false>(arr, outarr, size1b, size1e, size2b,
+                                          size2e, size2, plan, num_thread);
+  }
+}
+
+template <typename T, reducesum_fn<T> REDUCESUMF>
+void reducesum_tbb_split_128(const T *arr, T *outarr, size_t size1b,
+                             size_t size1e, size_t size2b, size_t size2e,
+                             size_t size2, size_t threshold,
+                             size_t num_thread) {
+  ReduceSplitPlan plan = plan_reduce_split(size1e - size1b, size2e - size2b,
+                                           threshold, num_thread);
+  if (plan.split == ReduceSplit::INNER) {
+    reducesum_tbb_simple_128<T, REDUCESUMF>(arr, outarr, size1b, size1e,
+                                            size2b, size2e, size2, threshold,
+                                            num_thread);
+  } else {
+    reducesum_split<T, REDUCESUMF, true>(arr, outarr, size1b, size1e, size2b,
+                                         size2e, size2, plan, num_thread);
+  }
+}
+
+// PREFETCH AND STREAMING
+
+// Variants of sum_simple_128 and reducesum_simple_128 with explicit software
+// prefetches. DISTANCE is in bytes ahead of the current load for the sums and
+// in rows ahead for the reducesums, where the hardware prefetcher loses track
+// of the size2 strided stream once rows get long. DISTANCE 0 issues no
+// prefetches. With STREAM the reducesum writes outarr with non-temporal
+// stores wherever it is 32 byte aligned.
+
+template <typename T, int DISTANCE>
+void sum_prefetch_128(T &sum, const T *arr, size_t start, size_t end) {
+  using Vec = Vec256<T>;
+  const int64_t step = 4 * Vec::size;
+  typename Vec::type a[4];
+  for (size_t i = 0; i < 4; i++) {
+    a[i] = Vec::zero();
+  }
+  int64_t blocks = (end - start) / step;
+  for (int64_t k = 0; k < blocks; k++) {
+    const T *block = arr + start + k * step;
+    if (DISTANCE > 0) {
+      // 128 bytes per iteration, one prefetch per cache line
+      _mm_prefetch((const char *)block + DISTANCE, _MM_HINT_T0);
+      _mm_prefetch((const char *)block + DISTANCE + 64, _MM_HINT_T0);
+    }
+    for (size_t i = 0; i < 4; i++) {
+      a[i] = Vec::add(a[i], Vec::loadu(block + i * Vec::size));
+    }
+  }
+  a[0] = Vec::add(Vec::add(a[0], a[1]), Vec::add(a[2], a[3]));
+  T sarr[Vec::size];
+  Vec::storeu(sarr, a[0]);
+  for (int i = 0; i < Vec::size; i++) {
+    sum += sarr[i];
+  }
+  sum_naive(sum, arr, start + blocks * step, end);
+}
+
+template <typename T, int DISTANCE, bool STREAM>
+void reducesum_prefetch_128(const T *arr, T *outarr, size_t size1b,
+                            size_t size1e, size_t size2b, size_t size2e,
+                            size_t size2) {
+  using Vec = Vec256<T>;
+  const int64_t step = 4 * Vec::size;
+  size_t blocks2 = (size2e - size2b) / step;
+  for (size_t k = 0; k < blocks2; k++) {
+    const size_t col = size2b + k * step;
+    typename Vec::type b[4];
+    for (size_t ib = 0; ib < 4; ib++) {
+      b[ib] = Vec::loadu(outarr + col + ib * Vec::size);
+    }
+    for (size_t i = size1b; i < size1e; i += 1) {
+      if (DISTANCE > 0 && i + DISTANCE < size1e) {
+        const char *ahead = (const char *)(arr + (i + DISTANCE) * size2 + col);
+        _mm_prefetch(ahead, _MM_HINT_T0);
+        _mm_prefetch(ahead + 64, _MM_HINT_T0);
+      }
+      for (size_t ib = 0; ib < 4; ib++) {
+        typename Vec::type val =
+            Vec::loadu(arr + i * size2 + col + ib * Vec::size);
+        b[ib] = Vec::add(val, b[ib]);
+      }
+    }
+    for (size_t ib = 0; ib < 4; ib++) {
+      T *out = outarr + col + ib * Vec::size;
+      if (STREAM && ((uintptr_t)out) % 32 == 0) {
+        Vec::stream(out, b[ib]);
+      } else {
+        Vec::storeu(out, b[ib]);
+      }
+    }
+  }
+  if (STREAM) {
+    _mm_sfence();
+  }
+  for (size_t j = size2b + blocks2 * step; j < size2e; j += 1) {
+    for (size_t i = size1b; i < size1e; i += 1) {
+      outarr[j] += arr[i * size2 + j];
+    }
+  }
+}
+
+template <typename F> struct PrefetchConfig {
+  std::string name;
+  F fn;
+  int64_t distance;
+  bool stream;
+};
+
+template <typename T, int DISTANCE>
+void add_sum_prefetch_config(std::vector<PrefetchConfig<sum_fn<T>>> &configs) {
+  configs.push_back({"sum_prefetch_128_d" + std::to_string(DISTANCE),
+                     &sum_prefetch_128<T, DISTANCE>, DISTANCE, false});
+}
+
+template <typename T>
+std::vector<PrefetchConfig<sum_fn<T>>> make_sum_prefetch_configs() {
+  std::vector<PrefetchConfig<sum_fn<T>>> configs;
+  add_sum_prefetch_config<T, 0>(configs);
+  add_sum_prefetch_config<T, 256>(configs);
+  add_sum_prefetch_config<T, 512>(configs);
+  add_sum_prefetch_config<T, 1024>(configs);
+  add_sum_prefetch_config<T, 2048>(configs);
+  add_sum_prefetch_config<T, 4096>(configs);
+  return configs;
+}
+
+template <typename T, int DISTANCE>
+void add_reducesum_prefetch_config(
+    std::vector<PrefetchConfig<reducesum_fn<T>>> &configs) {
+  std::string name = "reducesum_prefetch_128_d" + std::to_string(DISTANCE);
+  configs.push_back(
+      {name, &reducesum_prefetch_128<T, DISTANCE, false>, DISTANCE, false});
+  configs.push_back({name + "_stream",
+                     &reducesum_prefetch_128<T, DISTANCE, true>, DISTANCE,
+                     true});
+}
+
+template <typename T>
+std::vector<PrefetchConfig<reducesum_fn<T>>> make_reducesum_prefetch_configs() {
+  std::vector<PrefetchConfig<reducesum_fn<T>>> configs;
+  add_reducesum_prefetch_config<T, 0>(configs);
+  add_reducesum_prefetch_config<T, 1>(configs);
+  add_reducesum_prefetch_config<T, 2>(configs);
+  add_reducesum_prefetch_config<T, 4>(configs);
+  add_reducesum_prefetch_config<T, 8>(configs);
+  add_reducesum_prefetch_config<T, 16>(configs);
+  return configs;
+}
+
+// ROWWISE REDUCESUM
+
+// Reduces the contiguous inner dimension, outarr[i] += sum_j arr[i * size2 + j]
+// for rows [size1b, size1e) and columns [size2b, size2e). outarr has one entry
+// per row.
+
+// ONECORE
+
+template <typename T>
+void reducesum_rowwise_naive(const T *arr, T *outarr, size_t size1b,
+                             size_t size1e, size_t size2b, size_t size2e,
+                             size_t size2) {
+  for (size_t i = size1b; i < size1e; i += 1) {
+    for (size_t j = size2b; j < size2e; j += 1) {
+      outarr[i] += arr[i * size2 + j];
+    }
+  }
+}
+
+// One row at a time, each row pays for its own horizontal add
+template <typename T>
+void reducesum_rowwise_simple(const T *arr, T *outarr, size_t size1b,
+                              size_t size1e, size_t size2b, size_t size2e,
+                              size_t size2) {
+  for (size_t i = size1b; i < size1e; i += 1) {
+    sum_simple_128<T>(outarr[i], arr + i * size2, size2b, size2e);
+  }
+}
+
+// Adds the lanes of a[r] to outarr[r] for each of the ROWS accumulators
+template <typename T, int ROWS>
+inline void reduce_rows(const typename Vec256<T>::type *a, T *outarr) {
+  using Vec = Vec256<T>;
+  for (int r = 0; r < ROWS; r++) {
+    T sarr[Vec::size];
+    Vec::storeu(sarr, a[r]);
+    for (int i = 0; i < Vec::size; i++) {
+      outarr[r] += sarr[i];
+    }
+  }
+}
+
+// For float, four rows are transposed and added with hadd so that one vector
+// add and store produce four row sums.
+template <int ROWS>
+inline void reduce_rows_ps(const __m256 *a, float *outarr) {
+  for (int r = 0; r < ROWS; r += 4) {
+    __m256 h01 = _mm256_hadd_ps(a[r], a[r + 1]);
+    __m256 h23 = _mm256_hadd_ps(a[r + 2], a[r + 3]);
+    __m256 h = _mm256_hadd_ps(h01, h23);
+    __m128 s = _mm_add_ps(_mm256_castps256_ps128(h),
+                          _mm256_extractf128_ps(h, 1));
+    _mm_storeu_ps(outarr + r, _mm_add_ps(_mm_loadu_ps(outarr + r), s));
+  }
+}
+
+template <> inline void reduce_rows<float, 4>(const __m256 *a, float *outarr) {
+  reduce_rows_ps<4>(a, outarr);
+}
+
+template <> inline void reduce_rows<float, 8>(const __m256 *a, float *outarr) {
+  reduce_rows_ps<8>(a, outarr);
+}
+
+// Streams ROWS rows at once with one accumulator each. The independent
+// accumulators keep the adders busy and the horizontal reduction is amortized
+// over ROWS rows.
+template <typename T, int ROWS>
+void reducesum_rowwise_interleaved(const T *arr, T *outarr, size_t size1b,
+                                   size_t size1e, size_t size2b, size_t size2e,
+                                   size_t size2) {
+  using Vec = Vec256<T>;
+  if (size2e <= size2b) {
+    return;
+  }
+  size_t blocks2 = (size2e - size2b) / Vec::size;
+  size_t tail = size2b + blocks2 * Vec::size;
+  size_t i = size1b;
+  for (; i + ROWS <= size1e; i += ROWS) {
+    typename Vec::type a[ROWS];
+    for (int r = 0; r < ROWS; r++) {
+      a[r] = Vec::zero();
+    }
+    for (size_t k = 0; k < blocks2; k++) {
+      for (int r = 0; r < ROWS; r++) {
+        a[r] = Vec::add(
+            a[r], Vec::loadu(arr + (i + r) * size2 + size2b + k * Vec::size));
+      }
+    }
+    reduce_rows<T, ROWS>(a, outarr + i);
+    for (int r = 0; r < ROWS; r++) {
+      sum_naive(outarr[i + r], arr + (i + r) * size2, tail, size2e);
+    }
+  }
+  reducesum_rowwise_simple(arr, outarr, i, size1e, size2b, size2e, size2);
+}
+
+template <typename T>
+void reducesum_rowwise_interleaved_4(const T *arr, T *outarr, size_t size1b,
+                                     size_t size1e, size_t size2b,
+                                     size_t size2e, size_t size2) {
+  reducesum_rowwise_interleaved<T, 4>(arr, outarr, size1b, size1e, size2b,
+                                      size2e, size2);
+}
+
+template <typename T>
+void reducesum_rowwise_interleaved_8(const T *arr, T *outarr, size_t size1b,
+                                     size_t size1e, size_t size2b,
+                                     size_t size2e, size_t size2) {
+  reducesum_rowwise_interleaved<T, 8>(arr, outarr, size1b, size1e, size2b,
+                                      size2e, size2);
+}
+
+// PARALLEL
+
+// Rows are split across threads. threshold is in elements, like for the other
+// kernels, so each task gets at least threshold / width rows.
+inline size_t rowwise_grain(size_t threshold, size_t size2b, size_t size2e) {
+  size_t width = size2e > size2b ? size2e - size2b : 1;
+  return std::max<size_t>(1, threshold / width);
+}
+
+template <typename T, reducesum_fn<T> REDUCESUMF>
+void reducesum_rowwise_omp(const T *arr, T *outarr, size_t size1b,
+                           size_t size1e, size_t size2b, size_t size2e,
+                           size_t size2, size_t threshold, size_t num_thread) {
+  (void)num_thread;
+  size_t grain = rowwise_grain(threshold, size2b, size2e);
+#pragma omp parallel for
+  for (size_t i = size1b; i < size1e; i += grain) {
+    REDUCESUMF(arr, outarr, i, std::min(i + grain, size1e), size2b, size2e,
+               size2);
+  }
+}
+
+template <typename T, reducesum_fn<T> REDUCESUMF>
+void reducesum_rowwise_tbb(const T *arr, T *outarr, size_t size1b,
+                           size_t size1e, size_t size2b, size_t size2e,
+                           size_t size2, size_t threshold, size_t num_thread) {
+  (void)num_thread;
+  static affinity_partitioner ap;
+  parallel_for(blocked_range<size_t>(size1b, size1e,
+                                     rowwise_grain(threshold, size2b, size2e)),
+               [&](const tbb::blocked_range<size_t> &r) {
+                 REDUCESUMF(arr, outarr, r.begin(), r.end(), size2b, size2e,
+                            size2);
+               },
+               ap);
+}
+
+// N-D REDUCESUM
+
+// Sums an N-d tensor over an arbitrary set of axes. The input is described by
+// sizes and element strides, the output is contiguous (row-major over the
+// kept axes) and is accumulated into, like for the 2-d kernels.
+//
+// After dropping size 1 axes and merging neighbours that are contiguous with
+// each other, the innermost axis decides the inner loop:
+//  - kept with unit stride: column tiles of the output are sized to stay in L1
+//    and the reduced rows are fed to reducesum_simple_128 in row tiles sized
+//    for L2, so that only a few pages are streamed at once.
+//  - reduced with unit stride: rows of the innermost kept axis are summed with
+//    reducesum_rowwise_interleaved_8 in row tiles sized for L2.
+//  - otherwise a scalar loop over precomputed offsets.
+// The remaining kept axes and the tiles form independent work items, which are
+// what the parallel backends parallelize over, at least grain elements per
+// chunk of items. When there are fewer column items than threads, the reduced
+// rows are also split into blocks like in reducesum_split. Every block but the
+// first reduces into a partial tile in split_scratch, which a second pass adds
+// into the output. A full reduction is a single work item, use the sum_*
+// kernels for that.
+
+struct CacheSizes {
+  int64_t l1;
+  int64_t l2;
+  int64_t l3;
+};
+
+CacheSizes detect_cache_sizes() {
+  CacheSizes sizes = {32 * 1024, 256 * 1024, 8 * 1024 * 1024};
+  long l1 = sysconf(_SC_LEVEL1_DCACHE_SIZE);
+  long l2 = sysconf(_SC_LEVEL2_CACHE_SIZE);
+  long l3 = sysconf(_SC_LEVEL3_CACHE_SIZE);
+  if (l1 > 0) {
+    sizes.l1 = l1;
+  }
+  if (l2 > 0) {
+    sizes.l2 = l2;
+  }
+  if (l3 > 0) {
+    sizes.l3 = l3;
+  }
+  return sizes;
+}
+
+const CacheSizes &get_cache_sizes() {
+  static CacheSizes sizes = detect_cache_sizes();
+  return sizes;
+}
+
+enum class ReduceBackend { SERIAL, OMP, TBB, WS };
+
+struct ReduceDim {
+  int64_t size;
+  int64_t stride;
+  bool reduced;
+};
+
+std::vector<ReduceDim> coalesce_dims(const std::vector<int64_t> &sizes,
+                                     const std::vector<int64_t> &strides,
+                                     const std::vector<int64_t> &reduce_dims) {
+  std::vector<ReduceDim> dims;
+  for (size_t d = 0; d < sizes.size(); d++) {
+    bool reduced = std::find(reduce_dims.begin(), reduce_dims.end(),
+                             (int64_t)d) != reduce_dims.end();
+    if (sizes[d] == 1) {
+      continue;
+    }
+    if (!dims.empty() && dims.back().reduced == reduced &&
+        dims.back().stride == strides[d] * sizes[d]) {
+      dims.back().size *= sizes[d];
+      dims.back().stride = strides[d];
+      continue;
+    }
+    dims.push_back({sizes[d], strides[d], reduced});
+  }
+  return dims;
+}
+
+// Input offsets of all indices of dims, enumerated in row-major order
+std::vector<int64_t> dim_offsets(const std::vector<ReduceDim> &dims) {
+  std::vector<int64_t> offsets(1, 0);
+  for (const ReduceDim &dim : dims) {
+    std::vector<int64_t> next;
+    next.reserve(offsets.size() * dim.size);
+    for (int64_t offset : offsets) {
+      for (int64_t i = 0; i < dim.size; i++) {
+        next.push_back(offset + i * dim.stride);
+      }
+    }
+    offsets.swap(next);
+  }
+  return offsets;
+}
+
+template <typename T> struct ReducePlan {
+  enum { COLUMNS, ROWS, SCALAR } kind;
+  // Offsets of the kept axes that are looped over, their linear index times
+  // inner_size is the offset into the output
+  std::vector<int64_t> outer;
+  // Offsets of the reduced axes that are looped over
+  std::vector<int64_t> reduced;
+  // COLUMNS: rows of stride row_stride, inner_size contiguous columns
+  // ROWS: inner_size rows of stride row_stride, row_size contiguous columns
+  // SCALAR: unused
+  int64_t rows;
+  int64_t row_stride;
+  int64_t row_size;
+  int64_t inner_size;
+  int64_t tile;
+  int64_t tiles;
+  // COLUMNS: the rows are reduced in row_blocks blocks of block_rows
+  // ROWS and SCALAR: a single block
+  int64_t row_blocks;
+  int64_t block_rows;
+  // Input elements read per work item
+  int64_t item_size;
+};
+
+template <typename T>
+ReducePlan<T> make_reduce_plan(const std::vector<int64_t> &sizes,
+                               const std::vector<int64_t> &strides,
+                               const std::vector<int64_t> &reduce_dims) {
+  const CacheSizes &cache = get_cache_sizes();
+  std::vector<ReduceDim> dims = coalesce_dims(sizes, strides, reduce_dims);
+  ReducePlan<T> plan;
+  std::vector<ReduceDim> outer;
+  std::vector<ReduceDim> reduced;
+  if (dims.empty() || dims.back().stride != 1) {
+    for (const ReduceDim &dim : dims) {
+      (dim.reduced ? reduced : outer).push_back(dim);
+    }
+    plan.kind = ReducePlan<T>::SCALAR;
+    plan.rows = plan.row_stride = plan.row_size = 0;
+    plan.inner_size = plan.tile = plan.tiles = 1;
+  } else if (!dims.back().reduced) {
+    // The innermost reduced axis provides the rows
+    int64_t rho = -1;
+    for (int64_t d = 0; d < (int64_t)dims.size(); d++) {
+      if (dims[d].reduced) {
+        rho = d;
+      }
+    }
+    for (int64_t d = 0; d + 1 < (int64_t)dims.size(); d++) {
+      if (d != rho) {
+        (dims[d].reduced ? reduced : outer).push_back(dims[d]);
+      }
+    }
+    plan.kind = ReducePlan<T>::COLUMNS;
+    plan.rows = rho < 0 ? 1 : dims[rho].size;
+    plan.row_stride = rho < 0 ? 0 : dims[rho].stride;
+    plan.row_size = 0;
+    plan.inner_size = dims.back().size;
+    // Half of L1 for the output tile, in multiples of 32 columns
+    plan.tile = std::max<int64_t>(32, cache.l1 / 2 / sizeof(T) / 32 * 32);
+    plan.tiles = divup(plan.inner_size, plan.tile);
+  } else {
+    // The innermost kept axis provides the rows
+    int64_t kappa = -1;
+    for (int64_t d = 0; d < (int64_t)dims.size(); d++) {
+      if (!dims[d].reduced) {
+        kappa = d;
+      }
+    }
+    for (int64_t d = 0; d + 1 < (int64_t)dims.size(); d++) {
+      if (d != kappa) {
+        (dims[d].reduced ? reduced : outer).push_back(dims[d]);
+      }
+    }
+    plan.kind = ReducePlan<T>::ROWS;
+    plan.inner_size = kappa < 0 ? 1 : dims[kappa].size;
+    plan.row_stride = kappa < 0 ? 0 : dims[kappa].stride;
+    plan.row_size = dims.back().size;
+    plan.rows = plan.inner_size;
+    // Half of L2 worth of rows per tile, in multiples of the interleave
+    int64_t row_bytes = plan.row_size * sizeof(T);
+    plan.tile = std::max<int64_t>(8, cache.l2 / 2 / row_bytes / 8 * 8);
+    plan.tiles = divup(plan.inner_size, plan.tile);
+  }
+  plan.outer = dim_offsets(outer);
+  plan.reduced = dim_offsets(reduced);
+  plan.row_blocks = 1;
+  plan.block_rows = plan.rows;
+  int64_t reduced_size = plan.reduced.size();
+  if (plan.kind == ReducePlan<T>::COLUMNS) {
+    plan.item_size = plan.rows * std::min(plan.tile, plan.inner_size) *
+                     reduced_size;
+  } else if (plan.kind == ReducePlan<T>::ROWS) {
+    plan.item_size = std::min(plan.tile, plan.inner_size) * plan.row_size *
+                     reduced_size;
+  } else {
+    plan.item_size = reduced_size;
+  }
+  return plan;
+}
+
+// Splits the rows of a COLUMNS plan between the threads that the column items
+// leave unused, as long as every block keeps at least grain elements
+template <typename T>
+void split_reduce_plan(ReducePlan<T> &plan, int64_t grain,
+                       int64_t num_thread) {
+  if (plan.kind != ReducePlan<T>::COLUMNS) {
+    return;
+  }
+  int64_t items = plan.outer.size() * plan.tiles;
+  int64_t blocks = outer_split_blocks(plan.rows, plan.item_size / plan.rows,
+                                      grain, num_thread / items);
+  plan.block_rows = divup(plan.rows, blocks);
+  plan.row_blocks = divup(plan.rows, plan.block_rows);
+  plan.item_size = plan.block_rows * (plan.item_size / plan.rows);
+}
+
+// Partial tiles are padded to whole cache lines, so that neighbouring items
+// never share one
+template <typename T> int64_t partial_tile_stride(const ReducePlan<T> &plan) {
+  int64_t line = _BUFFER_ALIGNMENT / sizeof(T);
+  return divup(plan.tile, line) * line;
+}
+
+// Partial tile of row block b > 0 of outer index o and tile t
+template <typename T>
+T *partial_tile(const ReducePlan<T> &plan, T *partials, int64_t o, int64_t t,
+                int64_t b) {
+  int64_t tile = (o * plan.tiles + t) * (plan.row_blocks - 1) + b - 1;
+  return partials + tile * partial_tile_stride(plan);
+}
+
+// Work item i covers row block i % row_blocks of outer index
+// i / row_blocks / tiles and tile i / row_blocks % tiles
+template <typename T>
+void reducesum_nd_item(const ReducePlan<T> &plan, const T *arr, T *outarr,
+                       T *partials, int64_t item) {
+  int64_t b = item % plan.row_blocks;
+  int64_t o = item / plan.row_blocks / plan.tiles;
+  int64_t t = item / plan.row_blocks % plan.tiles;
+  const T *in = arr + plan.outer[o];
+  T *out = outarr + o * plan.inner_size;
+  if (plan.kind == ReducePlan<T>::SCALAR) {
+    for (int64_t offset : plan.reduced) {
+      *out += in[offset];
+    }
+    return;
+  }
+  int64_t tb = t * plan.tile;
+  int64_t te = std::min(tb + plan.tile, plan.inner_size);
+  if (plan.kind == ReducePlan<T>::ROWS) {
+    for (int64_t offset : plan.reduced) {
+      reducesum_rowwise_interleaved_8<T>(in + offset, out, tb, te, 0,
+                                         plan.row_size, plan.row_stride);
+    }
+    return;
+  }
+  const CacheSizes &cache = get_cache_sizes();
+  int64_t row_tile = std::max<int64_t>(
+      1, cache.l2 / 2 / ((te - tb) * sizeof(T)));
+  int64_t r0 = b * plan.block_rows;
+  int64_t r1 = std::min(r0 + plan.block_rows, plan.rows);
+  if (b > 0) {
+    // The partial tile is indexed from 0, through in shifted to tb
+    out = partial_tile(plan, partials, o, t, b);
+    memset(out, 0, (te - tb) * sizeof(T));
+    in += tb;
+    te -= tb;
+    tb = 0;
+  }
+  for (int64_t offset : plan.reduced) {
+    for (int64_t rb = r0; rb < r1; rb += row_tile) {
+      reducesum_simple_128<T>(in + offset, out, rb, std::min(rb + row_tile, r1),
+                              tb, te, plan.row_stride);
+    }
+  }
+}
+
+// Adds the partial tiles of outer index i / tiles and tile i % tiles into the
+// output
+template <typename T>
+void reducesum_nd_combine(const ReducePlan<T> &plan, T *outarr, T *partials,
+                          int64_t item) {
+  int64_t o = item / plan.tiles;
+  int64_t t = item % plan.tiles;
+  int64_t tb = t * plan.tile;
+  int64_t te = std::min(tb + plan.tile, plan.inner_size);
+  T *out = outarr + o * plan.inner_size + tb;
+  for (int64_t b = 1; b < plan.row_blocks; b++) {
+    const T *partial = partial_tile(plan, partials, o, t, b);
+    for (int64_t j = 0; j < te - tb; j++) {
+      out[j] += partial[j];
+    }
+  }
+}
+
+// Runs body over [0, items) on backend, chunk items at a time
+template <typename F>
+void reducesum_nd_for(ReduceBackend backend, int64_t items, int64_t chunk,
+                      int64_t num_thread, const F &body) {
+  if (backend == ReduceBackend::OMP) {
+#pragma omp parallel for schedule(static, chunk) num_threads(num_thread)
+    for (int64_t i = 0; i < items; i++) {
+      body(i);
+    }
+  } else if (backend == ReduceBackend::TBB) {
+    parallel_for(blocked_range<int64_t>(0, items, chunk),
+                 [&](const tbb::blocked_range<int64_t> &r) {
+                   for (int64_t i = r.begin(); i < r.end(); i++) {
+                     body(i);
+                   }
+                 });
+  } else if (backend == ReduceBackend::WS) {
+    ws::parallel_for(ws::pool(num_thread), 0, items, chunk,
+                     [&](int64_t b, int64_t e) {
+                       for (int64_t i = b; i < e; i++) {
+                         body(i);
+                       }
+                     });
+  } else {
+    for (int64_t i = 0; i < items; i++) {
+      body(i);
+    }
+  }
+}
+
+// num_thread 0 takes the concurrency of the backend. An empty input adds
+// nothing to the output, and would leave the plan without rows or items.
+template <typename T>
+void reducesum_nd(const T *arr, T *outarr, const std::vector<int64_t> &sizes,
+                  const std::vector<int64_t> &strides,
+                  const std::vector<int64_t> &reduce_dims,
+                  ReduceBackend backend,
+                  int64_t grain = at::internal::GRAIN_SIZE,
+                  int64_t num_thread = 0) {
+  if (shape_numel(sizes) == 0) {
+    return;
+  }
+  if (backend == ReduceBackend::SERIAL) {
+    num_thread = 1;
+  } else if (num_thread <= 0 && backend == ReduceBackend::OMP) {
+    num_thread = omp_get_max_threads();
+  } else if (num_thread <= 0 && backend == ReduceBackend::TBB) {
+    num_thread = this_task_arena::max_concurrency();
+  } else if (num_thread <= 0) {
+    num_thread = std::thread::hardware_concurrency();
+  }
+  ReducePlan<T> plan = make_reduce_plan<T>(sizes, strides, reduce_dims);
+  split_reduce_plan(plan, grain, num_thread);
+  int64_t items = plan.outer.size() * plan.tiles;
+  T *partials = NULL;
+  if (plan.row_blocks > 1) {
+    partials = (T *)split_scratch(num_thread, items * (plan.row_blocks - 1) *
+                                                  partial_tile_stride(plan) *
+                                                  sizeof(T));
+  }
+  int64_t chunk = std::max<int64_t>(1, grain / std::max<int64_t>(
+                                                   1, plan.item_size));
+  reducesum_nd_for(backend, items * plan.row_blocks, chunk, num_thread,
+                   [&](int64_t i) {
+                     reducesum_nd_item(plan, arr, outarr, partials, i);
+                   });
+  if (plan.row_blocks > 1) {
+    reducesum_nd_for(backend, items, 1, num_thread, [&](int64_t i) {
+      reducesum_nd_combine(plan, outarr, partials, i);
+    });
+  }
+}
+
+// The 2-d column-wise and row-wise problems through the engine, so that it runs
+// on the same sweeps as the hand-written kernels.
+template <typename T, ReduceBackend BACKEND>
+void reducesum_nd_columns_parallel(const T *arr, T *outarr, size_t size1b,
+                                   size_t size1e, size_t size2b, size_t size2e,
+                                   size_t size2, size_t threshold,
+                                   size_t num_thread) {
+  if (size1e <= size1b || size2e <= size2b) {
+    return;
+  }
+  reducesum_nd(arr + size1b * size2 + size2b, outarr + size2b,
+               {(int64_t)(size1e - size1b), (int64_t)(size2e - size2b)},
+               {(int64_t)size2, 1}, {0}, BACKEND, threshold, num_thread);
+}
+
+template <typename T, ReduceBackend BACKEND>
+void reducesum_nd_rows_parallel(const T *arr, T *outarr, size_t size1b,
+                                size_t size1e, size_t size2b, size_t size2e,
+                                size_t size2, size_t threshold,
+                                size_t num_thread) {
+  if (size1e <= size1b || size2e <= size2b) {
+    return;
+  }
+  reducesum_nd(arr + size1b * size2 + size2b, outarr + size1b,
+               {(int64_t)(size1e - size1b), (int64_t)(size2e - size2b)},
+               {(int64_t)size2, 1}, {1}, BACKEND, threshold, num_thread);
+}
+
+template <typename T, ReduceBackend BACKEND>
+void reducesum_nd_columns(const T *arr, T *outarr, size_t size1b,
+                          size_t size1e, size_t size2b, size_t size2e,
+                          size_t size2) {
+  reducesum_nd_columns_parallel<T, BACKEND>(arr, outarr, size1b, size1e, size2b,
+                                            size2e, size2,
+                                            at::internal::GRAIN_SIZE, 0);
+}
+
+template <typename T, ReduceBackend BACKEND>
+void reducesum_nd_rows(const T *arr, T *outarr, size_t size1b, size_t size1e,
+                       size_t size2b, size_t size2e, size_t size2) {
+  reducesum_nd_rows_parallel<T, BACKEND>(arr, outarr, size1b, size1e, size2b,
+                                         size2e, size2,
+                                         at::internal::GRAIN_SIZE, 0);
+}
+
+// FUSED STATISTICS
+
+// Sum, sum of squares, min, max and argmax of a buffer. The kernels are
+// templated on a mask of the statistics they compute, so the same loop gives
+// the fused single pass kernel and the single statistic passes it is compared
+// against. argmax is the first index of the maximum, it implies max. The
+// vector kernels track indices in 32 bit lanes relative to the start of a
+// span of at most _STATS_SPAN elements (rows for the column-wise kernels) and
+// add the span start back when they combine, so indices stay exact past 2^31.
+// NaNs are not handled.
+
+enum StatFlags {
+  STAT_SUM = 1,
+  STAT_SUMSQ = 2,
+  STAT_MIN = 4,
+  STAT_MAX = 8,
+  STAT_ARGMAX = 16,
+  STAT_ALL = 31
+};
+
+// Flops per element for the roofline, counting min and max as one each
+constexpr int _STATS_FLOPS = 5;
+
+// Passes over the input of the *_separate_* kernels, one per statistic, for
+// the bytes they read
+constexpr int _STATS_SEPARATE_PASSES = 4;
+
+constexpr size_t _STATS_SPAN = size_t(1) << 30;
+
+int64_t stats_passes(const std::string &name) {
+  return name.find("_separate_") != std::string::npos ? _STATS_SEPARATE_PASSES
+                                                       : 1;
+}
+
+struct Stats {
+  float sum;
+  float sumsq;
+  float min;
+  float max;
+  int64_t argmax;
+};
+
+Stats stats_identity() {
+  return {0, 0, std::numeric_limits<float>::infinity(),
+          -std::numeric_limits<float>::infinity(), -1};
+}
+
+// Merges b into a. On equal maxima the smaller index wins, so combining the
+// partial results of disjoint ranges in any order gives the first index.
+inline void stats_combine(Stats &a, const Stats &b) {
+  a.sum += b.sum;
+  a.sumsq += b.sumsq;
+  a.min = std::min(a.min, b.min);
+  if (b.max > a.max ||
+      (b.max == a.max && b.argmax >= 0 &&
+       (a.argmax < 0 || b.argmax < a.argmax))) {
+    a.max = b.max;
+    a.argmax = b.argmax;
+  }
+}
+
+using stats_fn = void (*)(Stats &, const float *, size_t, size_t);
+using parallelstats_fn = void (*)(Stats &, const float *, size_t, size_t,
+                                  size_t, size_t);
+
+// ONECORE
+
+template <int FLAGS>
+inline void stats_add(Stats &stats, float v, int64_t index) {
+  if (FLAGS & STAT_SUM) {
+    stats.sum += v;
+  }
+  if (FLAGS & STAT_SUMSQ) {
+    stats.sumsq += v * v;
+  }
+  if (FLAGS & STAT_MIN) {
+    stats.min = std::min(stats.min, v);
+  }
+  if ((FLAGS & (STAT_MAX | STAT_ARGMAX)) && v > stats.max) {
+    stats.max = v;
+    stats.argmax = index;
+  }
+}
+
+template <int FLAGS>
+void stats_naive(Stats &stats, const float *arr, size_t start, size_t end) {
+  for (size_t i = start; i < end; i++) {
+    stats_add<FLAGS>(stats, arr[i], i);
+  }
+}
+
+// Two accumulators of each statistic (64 bytes per iteration) keep the fused
+// kernel within the 16 vector registers. One span, see _STATS_SPAN.
+template <int FLAGS>
+void stats_span_64(Stats &stats, const float *arr, size_t start, size_t end) {
+  __m256 sum[2], sumsq[2], min[2], max[2];
+  __m256i argmax[2], index[2];
+  const __m256i step = _mm256_set1_epi32(16);
+  for (size_t i = 0; i < 2; i++) {
+    sum[i] = _mm256_set1_ps(0);
+    sumsq[i] = _mm256_set1_ps(0);
+    min[i] = _mm256_set1_ps(std::numeric_limits<float>::infinity());
+    max[i] = _mm256_set1_ps(-std::numeric_limits<float>::infinity());
+    argmax[i] = _mm256_set1_epi32(-1);
+    index[i] = _mm256_add_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7),
+                                _mm256_set1_epi32(i * 8));
+  }
+  size_t blocks = (end - start) / 16;
+  for (size_t k = 0; k < blocks; k++) {
+    for (size_t i = 0; i < 2; i++) {
+      __m256 v = _mm256_loadu_ps(arr + start + k * 16 + i * 8);
+      if (FLAGS & STAT_SUM) {
+        sum[i] = _mm256_add_ps(sum[i], v);
+      }
+      if (FLAGS & STAT_SUMSQ) {
+        sumsq[i] = _mm256_add_ps(sumsq[i], _mm256_mul_ps(v, v));
+      }
+      if (FLAGS & STAT_MIN) {
+        min[i] = _mm256_min_ps(min[i], v);
+      }
+      if (FLAGS & STAT_ARGMAX) {
+        __m256 gt = _mm256_cmp_ps(v, max[i], _CMP_GT_OQ);
+        max[i] = _mm256_blendv_ps(max[i], v, gt);
+        argmax[i] = _mm256_castps_si256(
+            _mm256_blendv_ps(_mm256_castsi256_ps(argmax[i]),
+                             _mm256_castsi256_ps(index[i]), gt));
+        index[i] = _mm256_add_epi32(index[i], step);
+      } else if (FLAGS & STAT_MAX) {
+        max[i] = _mm256_max_ps(max[i], v);
+      }
+    }
+  }
+  Stats result = stats_identity();
+  for (size_t i = 0; i < 2; i++) {
+    float sum_arr[8], sumsq_arr[8], min_arr[8], max_arr[8];
+    int32_t argmax_arr[8];
+    _mm256_storeu_ps(sum_arr, sum[i]);
+    _mm256_storeu_ps(sumsq_arr, sumsq[i]);
+    _mm256_storeu_ps(min_arr, min[i]);
+    _mm256_storeu_ps(max_arr, max[i]);
+    _mm256_storeu_si256((__m256i *)argmax_arr, argmax[i]);
+    for (size_t j = 0; j < 8; j++) {
+      int64_t argmax = argmax_arr[j] < 0 ? -1 : start + argmax_arr[j];
+      stats_combine(result, {sum_arr[j], sumsq_arr[j], min_arr[j], max_arr[j],
+                             argmax});
+    }
+  }
+  stats_naive<FLAGS>(result, arr, start + blocks * 16, end);
+  stats_combine(stats, result);
+}
+
+template <int FLAGS>
+void stats_simple_64(Stats &stats, const float *arr, size_t start,
+                     size_t end) {
+  for (size_t span = start; span < end; span += _STATS_SPAN) {
+    stats_span_64<FLAGS>(stats, arr, span, std::min(span + _STATS_SPAN, end));
+  }
+}
+
+void stats_naive_all(Stats &stats, const float *arr, size_t start,
+                     size_t end) {
+  stats_naive<STAT_ALL>(stats, arr, start, end);
+}
+
+void stats_fused_64(Stats &stats, const float *arr, size_t start, size_t end) {
+  stats_simple_64<STAT_ALL>(stats, arr, start, end);
+}
+
+// Baseline, one pass over the data per statistic
+void stats_separate_64(Stats &stats, const float *arr, size_t start,
+                       size_t end) {
+  Stats result = stats_identity();
+  sum_simple_128<float>(result.sum, arr, start, end);
+  stats_simple_64<STAT_SUMSQ>(result, arr, start, end);
+  stats_simple_64<STAT_MIN>(result, arr, start, end);
+  stats_simple_64<STAT_ARGMAX>(result, arr, start, end);
+  stats_combine(stats, result);
+}
+
+// PARALLEL
+
+template <stats_fn STATSF>
+void stats_omp(Stats &stats, const float *a, size_t start, size_t end,
+               size_t threshold, size_t max_num_thread) {
+  (void)max_num_thread;
+  int64_t num_chunks = divup(end - start, threshold);
+  std::vector<Stats> results(num_chunks, stats_identity());
+  Stats *results_data = results.data();
+#pragma omp parallel for if ((end - start) > threshold)
+  for (int64_t c = 0; c < num_chunks; c++) {
+    size_t chunk_start = start + c * threshold;
+    STATSF(results_data[c], a, chunk_start,
+           std::min(chunk_start + threshold, end));
+  }
+  for (int64_t c = 0; c < num_chunks; c++) {
+    stats_combine(stats, results[c]);
+  }
+}
+
+template <stats_fn STATSF>
+void stats_tbb(Stats &stats, const float *a, size_t start, size_t end,
+               size_t threshold, size_t max_num_thread) {
+  (void)max_num_thread;
+  static affinity_partitioner ap;
+  Stats result = parallel_reduce(
+      blocked_range<int64_t>(start, end, threshold), stats_identity(),
+      [a](const tbb::blocked_range<int64_t> &r, Stats init) -> Stats {
+        STATSF(init, a, r.begin(), r.end());
+        return init;
+      },
+      [](Stats x, const Stats &y) -> Stats {
+        stats_combine(x, y);
+        return x;
+      },
+      ap);
+  stats_combine(stats, result);
+}
+
+// Column-wise statistics over the outer dimension, the fused counterpart of
+// reducesum_simple_128. out holds one entry per column and is combined into,
+// argmax is the row index.
+struct StatsColumns {
+  float *sum;
+  float *sumsq;
+  float *min;
+  float *max;
+  int64_t *argmax;
+};
+
+inline void stats_column_combine(const StatsColumns &out, size_t j,
+                                 const Stats &b) {
+  Stats a = {out.sum[j], out.sumsq[j], out.min[j], out.max[j], out.argmax[j]};
+  stats_combine(a, b);
+  out.sum[j] = a.sum;
+  out.sumsq[j] = a.sumsq;
+  out.min[j] = a.min;
+  out.max[j] = a.max;
+  out.argmax[j] = a.argmax;
+}
+
+using reducestats_fn = void (*)(const float *, const StatsColumns &, size_t,
+                                size_t, size_t, size_t, size_t);
+using parallelreducestats_fn = void (*)(const float *, const StatsColumns &,
+                                        size_t, size_t, size_t, size_t, size_t,
+                                        size_t, size_t);
+
+// One span of rows, see _STATS_SPAN
+template <int FLAGS>
+void reducestats_span_64(const float *arr, const StatsColumns &out,
+                         size_t size1b, size_t size1e, size_t size2b,
+                         size_t size2e, size_t size2) {
+  size_t blocks2 = (size2e - size2b) / 16;
+  for (size_t k = 0; k < blocks2; k++) {
+    const size_t col = size2b + k * 16;
+    __m256 sum[2], sumsq[2], min[2], max[2];
+    __m256i argmax[2];
+    for (size_t ib = 0; ib < 2; ib++) {
+      sum[ib] = _mm256_set1_ps(0);
+      sumsq[ib] = _mm256_set1_ps(0);
+      min[ib] = _mm256_set1_ps(std::numeric_limits<float>::infinity());
+      max[ib] = _mm256_set1_ps(-std::numeric_limits<float>::infinity());
+      argmax[ib] = _mm256_set1_epi32(-1);
+    }
+    for (size_t i = size1b; i < size1e; i += 1) {
+      __m256i row = _mm256_set1_epi32(i - size1b);
+      for (size_t ib = 0; ib < 2; ib++) {
+        __m256 v = _mm256_loadu_ps(arr + i * size2 + col + ib * 8);
+        if (FLAGS & STAT_SUM) {
+          sum[ib] = _mm256_add_ps(sum[ib], v);
+        }
+        if (FLAGS & STAT_SUMSQ) {
+          sumsq[ib] = _mm256_add_ps(sumsq[ib], _mm256_mul_ps(v, v));
+        }
+        if (FLAGS & STAT_MIN) {
+          min[ib] = _mm256_min_ps(min[ib], v);
+        }
+        if (FLAGS & STAT_ARGMAX) {
+          __m256 gt = _mm256_cmp_ps(v, max[ib], _CMP_GT_OQ);
+          max[ib] = _mm256_blendv_ps(max[ib], v, gt);
+          argmax[ib] = _mm256_castps_si256(
+              _mm256_blendv_ps(_mm256_castsi256_ps(argmax[ib]),
+                               _mm256_castsi256_ps(row), gt));
+        } else if (FLAGS & STAT_MAX) {
+          max[ib] = _mm256_max_ps(max[ib], v);
+        }
+      }
+    }
+    for (size_t ib = 0; ib < 2; ib++) {
+      float sum_arr[8], sumsq_arr[8], min_arr[8], max_arr[8];
+      int32_t argmax_arr[8];
+      _mm256_storeu_ps(sum_arr, sum[ib]);
+      _mm256_storeu_ps(sumsq_arr, sumsq[ib]);
+      _mm256_storeu_ps(min_arr, min[ib]);
+      _mm256_storeu_ps(max_arr, max[ib]);
+      _mm256_storeu_si256((__m256i *)argmax_arr, argmax[ib]);
+      for (size_t j = 0; j < 8; j++) {
+        int64_t argmax = argmax_arr[j] < 0 ? -1 : size1b + argmax_arr[j];
+        stats_column_combine(out, col + ib * 8 + j,
+                             {sum_arr[j], sumsq_arr[j], min_arr[j], max_arr[j],
+                              argmax});
+      }
+    }
+  }
+  for (size_t j = size2b + blocks2 * 16; j < size2e; j += 1) {
+    Stats result = stats_identity();
+    for (size_t i = size1b; i < size1e; i += 1) {
+      stats_add<FLAGS>(result, arr[i * size2 + j], i);
+    }
+    stats_column_combine(out, j, result);
+  }
+}
+
+template <int FLAGS>
+void reducestats_simple_64(const float *arr, const StatsColumns &out,
+                           size_t size1b, size_t size1e, size_t size2b,
+                           size_t size2e, size_t size2) {
+  for (size_t span = size1b; span < size1e; span += _STATS_SPAN) {
+    reducestats_span_64<FLAGS>(arr, out, span,
+                               std::min(span + _STATS_SPAN, size1e), size2b,
+                               size2e, size2);
+  }
+}
+
+void reducestats_naive_all(const float *arr, const StatsColumns &out,
+                           size_t size1b, size_t size1e, size_t size2b,
+                           size_t size2e, size_t size2) {
+  for (size_t j = size2b; j < size2e; j += 1) {
+    Stats result = stats_identity();
+    for (size_t i = size1b; i < size1e; i += 1) {
+      stats_add<STAT_ALL>(result, arr[i * size2 + j], i);
+    }
+    stats_column_combine(out, j, result);
+  }
+}
+
+void reducestats_fused_64(const float *arr, const StatsColumns &out,
+                          size_t size1b, size_t size1e, size_t size2b,
+                          size_t size2e, size_t size2) {
+  reducestats_simple_64<STAT_ALL>(arr, out, size1b, size1e, size2b, size2e,
+                                  size2);
+}
+
+void reducestats_separate_64(const float *arr, const StatsColumns &out,
+                             size_t size1b, size_t size1e, size_t size2b,
+                             size_t size2e, size_t size2) {
+  reducesum_simple_128<float>(arr, out.sum, size1b, size1e, size2b, size2e,
+                              size2);
+  reducestats_simple_64<STAT_SUMSQ>(arr, out, size1b, size1e, size2b, size2e,
+                                    size2);
+  reducestats_simple_64<STAT_MIN>(arr, out, size1b, size1e, size2b, size2e,
+                                  size2);
+  reducestats_simple_64<STAT_ARGMAX>(arr, out, size1b, size1e, size2b, size2e,
+                                     size2);
+}
+
+template <reducestats_fn REDUCESTATSF>
+void reducestats_omp(const float *arr, const StatsColumns &out, size_t size1b,
+                     size_t size1e, size_t size2b, size_t size2e, size_t size2,
+                     size_t threshold, size_t num_thread) {
+  (void)num_thread;
+#pragma omp parallel for
+  for (size_t i = size2b; i < size2e; i += threshold) {
+    REDUCESTATSF(arr, out, size1b, size1e, i, std::min(i + threshold, size2e),
+                 size2);
+  }
+}
+
+template <reducestats_fn REDUCESTATSF>
+void reducestats_tbb(const float *arr, const StatsColumns &out, size_t size1b,
+                     size_t size1e, size_t size2b, size_t size2e, size_t size2,
+                     size_t threshold, size_t num_thread) {
+  (void)num_thread;
+  static affinity_partitioner ap;
+  parallel_for(blocked_range<size_t>(size2b, size2e, threshold),
+               [&](const tbb::blocked_range<size_t> &r) {
+                 REDUCESTATSF(arr, out, size1b, size1e, r.begin(), r.end(),
+                              size2);
+               },
+               ap);
+}
+
+// STRIDED
+
+// Element i of a strided vector lives at arr[i * stride]. Element (i, j) of a
+// strided matrix lives at arr[(i * size2 + j) * stride], which matches the
+// select() views compare_eigen uses for its stride sweep. The output of the
+// strided reducesum is contiguous.
+
+// Elements packed per call into the contiguous scratch buffer (16KB)
+constexpr size_t _STRIDED_PACK_SIZE = 4096;
+
+// ONECORE
+
+template <typename T>
+void sum_strided_naive(T &sum, const T *arr, size_t start, size_t end,
+                       size_t stride) {
+  for (size_t i = start; i < end; i += 1) {
+    sum += arr[i * stride];
+  }
+}
+
+// Scalar loads with independent accumulators to hide the add latency
+void sum_strided_scalar(float &sum, const float *arr, size_t start, size_t end,
+                        size_t stride) {
+  float s[4] = {0, 0, 0, 0};
+  size_t blocks = (end - start) / 4;
+  for (size_t k = 0; k < blocks; k++) {
+    for (size_t ib = 0; ib < 4; ib++) {
+      s[ib] += arr[(start + k * 4 + ib) * stride];
+    }
+  }
+  sum += (s[0] + s[1]) + (s[2] + s[3]);
+  sum_strided_naive(sum, arr, start + blocks * 4, end, stride);
+}
+
+inline __m256i strided_gather_index(size_t stride) {
+  return _mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7),
+                            _mm256_set1_epi32((int)stride));
+}
+
+void sum_strided_gather(float &sum, const float *arr, size_t start, size_t end,
+                        size_t stride) {
+  __m256i vindex = strided_gather_index(stride);
+  __m256 a[4];
+  for (size_t ib = 0; ib < 4; ib++) {
+    a[ib] = _mm256_set1_ps(0);
+  }
+  size_t blocks = (end - start) / 32;
+  for (size_t k = 0; k < blocks; k++) {
+    for (size_t ib = 0; ib < 4; ib++) {
+      const float *base = arr + (start + k * 32 + ib * 8) * stride;
+      a[ib] = _mm256_add_ps(a[ib], _mm256_i32gather_ps(base, vindex, 4));
+    }
+  }
+  a[0] = _mm256_add_ps(_mm256_add_ps(a[0], a[1]), _mm256_add_ps(a[2], a[3]));
+  float sarr[8];
+  _mm256_storeu_ps(sarr, a[0]);
+  for (size_t i = 0; i < 8; i++) {
+    sum += sarr[i];
+  }
+  sum_strided_naive(sum, arr, start + blocks * 32, end, stride);
+}
+
+// Copies blocks into a contiguous buffer and sums it with the vector kernel
+void sum_strided_pack(float &sum, const float *arr, size_t start, size_t end,
+                      size_t stride) {
+  alignas(32) float buffer[_STRIDED_PACK_SIZE];
+  for (size_t b = start; b < end; b += _STRIDED_PACK_SIZE) {
+    size_t n = std::min(end - b, _STRIDED_PACK_SIZE);
+    for (size_t i = 0; i < n; i++) {
+      buffer[i] = arr[(b + i) * stride];
+    }
+    sum_simple_128<float>(sum, buffer, 0, n);
+  }
+}
+
+template <typename T>
+void reducesum_strided_naive(const T *arr, T *outarr, size_t size1b,
+                             size_t size1e, size_t size2b, size_t size2e,
+                             size_t size2, size_t stride) {
+  for (size_t i = size1b; i < size1e; i += 1) {
+    for (size_t j = size2b; j < size2e; j += 1) {
+      outarr[j] += arr[(i * size2 + j) * stride];
+    }
+  }
+}
+
+void reducesum_strided_gather(const float *arr, float *outarr, size_t size1b,
+                              size_t size1e, size_t size2b, size_t size2e,
+                              size_t size2, size_t stride) {
+  __m256i vindex = strided_gather_index(stride);
+  size_t blocks2 = (size2e - size2b) / 32;
+  for (size_t k = 0; k < blocks2; k++) {
+    __m256 b[4];
+    for (size_t ib = 0; ib < 4; ib++) {
+      b[ib] = _mm256_loadu_ps(outarr + size2b + k * 32 + ib * 8);
+    }
+    for (size_t i = size1b; i < size1e; i += 1) {
+      for (size_t ib = 0; ib < 4; ib++) {
+        const float *base =
+            arr + (i * size2 + size2b + k * 32 + ib * 8) * stride;
+        b[ib] = _mm256_add_ps(_mm256_i32gather_ps(base, vindex, 4), b[ib]);
+      }
+    }
+    for (size_t ib = 0; ib < 4; ib++) {
+      _mm256_storeu_ps(outarr + size2b + k * 32 + ib * 8, b[ib]);
+    }
+  }
+  reducesum_strided_naive(arr, outarr, size1b, size1e, size2b + blocks2 * 32,
+                          size2e, size2, stride);
+}
+
+// Packs as many full rows of [size2b, size2e) as fit into the buffer and
+// reduces them with the contiguous kernel. Ranges wider than the buffer are
+// packed in column blocks of at most _STRIDED_PACK_SIZE.
+void reducesum_strided_pack(const float *arr, float *outarr, size_t size1b,
+                            size_t size1e, size_t size2b, size_t size2e,
+                            size_t size2, size_t stride) {
+  alignas(32) float buffer[_STRIDED_PACK_SIZE];
+  for (size_t jb = size2b; jb < size2e; jb += _STRIDED_PACK_SIZE) {
+    size_t width = std::min(size2e - jb, _STRIDED_PACK_SIZE);
+    size_t rows = _STRIDED_PACK_SIZE / width;
+    for (size_t ib = size1b; ib < size1e; ib += rows) {
+      size_t ie = std::min(ib + rows, size1e);
+      for (size_t i = ib; i < ie; i++) {
+        for (size_t j = 0; j < width; j++) {
+          buffer[(i - ib) * width + j] = arr[(i * size2 + jb + j) * stride];
+        }
+      }
+      reducesum_simple_128<float>(buffer, outarr + jb, 0, ie - ib, 0, width,
+                                  width);
+    }
+  }
+}
+
+// PARALLEL
+
+template <typename T, stridedsum_fn<T> SUMF>
+void sum_omp_strided(T &sum, const T *a, size_t start, size_t end,
+                     size_t stride, size_t threshold, size_t max_num_thread) {
+#pragma omp parallel for reduction(+ : sum)
+  for (size_t i = start; i < end; i += threshold) {
+    T result = 0;
+    SUMF(result, a, i, std::min(i + threshold, end), stride);
+    sum += result;
+  }
+}
+
+template <typename T, stridedsum_fn<T> SUMF>
+void sum_tbb_strided(T &sum, const T *a, size_t start, size_t end,
+                     size_t stride, size_t threshold, size_t max_num_thread) {
+  (void)max_num_thread;
+  static affinity_partitioner ap;
+  sum += parallel_reduce(
+      blocked_range<int64_t>(start, end, threshold), T(0),
+      [a, stride](const tbb::blocked_range<int64_t> &r, T init) -> T {
+        T result = init;
+        SUMF(result, a, r.begin(), r.end(), stride);
+        return result;
+      },
+      std::plus<T>(), ap);
+}
+
+template <typename T, stridedreducesum_fn<T> REDUCESUMF>
+void reducesum_omp_strided(const T *arr, T *outarr, size_t size1b,
+                           size_t size1e, size_t size2b, size_t size2e,
+                           size_t size2, size_t stride, size_t threshold,
+                           size_t num_thread) {
+  (void)num_thread;
+#pragma omp parallel for
+  for (size_t i = size2b; i < size2e; i += threshold) {
+    REDUCESUMF(arr, outarr, size1b, size1e, i, std::min(i + threshold, size2e),
+               size2, stride);
+  }
+}
+
+template <typename T, stridedreducesum_fn<T> REDUCESUMF>
+void reducesum_tbb_strided(const T *arr, T *outarr, size_t size1b,
+                           size_t size1e, size_t size2b, size_t size2e,
+                           size_t size2, size_t stride, size_t threshold,
+                           size_t num_thread) {
+  (void)num_thread;
+  static affinity_partitioner ap;
+  parallel_for(blocked_range<size_t>(size2b, size2e, threshold),
                [&](const tbb::blocked_range<size_t> &r) {
-                 reducesum_simple_128(arr, outarr, size1b, size1e, r.begin(),
-                                      r.end(), size2);
+                 REDUCESUMF(arr, outarr, size1b, size1e, r.begin(), r.end(),
+                            size2, stride);
                },
                ap);
 }
 
-void reducesum_tbb_simple_128_arena(const float *arr, float *outarr,
-                                    size_t size1b, size_t size1e, size_t size2b,
-                                    size_t size2e, size_t size2,
-                                    size_t threshold, size_t max_num_thread) {
-  static std::map<int64_t, tbb::task_arena> arenas = {
-      {1, tbb::task_arena(1)},   {2, tbb::task_arena(2)},
-      {4, tbb::task_arena(4)},   {8, tbb::task_arena(8)},
-      {16, tbb::task_arena(16)}, {32, tbb::task_arena(32)}};
-  if (((size2e - size2b)) < threshold) {
-    reducesum_simple_128(arr, outarr, size1b, size1e, size2b, size2e, size2);
-  } else {
-    size_t max_tasks = ((size2e - size2b) / threshold);
-    static affinity_partitioner ap;
-    if (max_tasks < max_num_thread) {
-      if (arenas.count(max_tasks) == 0) {
-        std::cout << "need arena for " << max_tasks << std::endl;
-      }
-      arenas[max_tasks].execute([&] {
-        parallel_for(blocked_range<size_t>(size2b, size2e, threshold),
-                     [&](const tbb::blocked_range<size_t> &r) {
-                       reducesum_simple_128(arr, outarr, size1b, size1e,
-                                            r.begin(), r.end(), size2);
-                     },
-                     ap);
-      });
-    } else {
-      parallel_for(blocked_range<size_t>(size2b, size2e, threshold),
-                   [&](const tbb::blocked_range<size_t> &r) {
-                     reducesum_simple_128(arr, outarr, size1b, size1e,
-                                          r.begin(), r.end(), size2);
-                   },
-                   ap);
-    }
+// NUMA PLACEMENT
+
+// Backend a parallel kernel runs on, going by its registered name. The
+// standard algorithms run on TBB.
+ReduceBackend parallel_backend(const std::string &name) {
+  if (name.find("_ws_") != std::string::npos) {
+    return ReduceBackend::WS;
+  }
+  return name.find("tbb") != std::string::npos ||
+                 name.find("std") != std::string::npos
+             ? ReduceBackend::TBB
+             : ReduceBackend::OMP;
+}
+
+// How a parallel reducesum kernel splits its input, going by its registered
+// name. TWO_D stands for the *_split_128 kernels, which plan the split from
+// the shape, see split_plan.
+ReduceSplit parallel_split(const std::string &name) {
+  if (name.find("_outer_") != std::string::npos) {
+    return ReduceSplit::OUTER;
+  }
+  if (name.find("_split_") != std::string::npos) {
+    return ReduceSplit::TWO_D;
+  }
+  return ReduceSplit::INNER;
+}
+
+// The plan the kernels of split run with on a size_outer x size_inner input
+ReduceSplitPlan split_plan(ReduceSplit split, int64_t size_outer,
+                           int64_t size_inner, int64_t threshold,
+                           int64_t num_thread) {
+  if (split == ReduceSplit::OUTER) {
+    return {ReduceSplit::OUTER,
+            outer_split_blocks(size_outer, size_inner, threshold, num_thread),
+            1};
+  }
+  if (split == ReduceSplit::TWO_D) {
+    return plan_reduce_split(size_outer, size_inner, threshold, num_thread);
+  }
+  return {ReduceSplit::INNER, 1, 1};
+}
+
+// Writes the values of make_vector into a size_outer x size_inner buffer, with
+// the threads of backend each taking the threshold wide column blocks that the
+// kernels give them. A vector is the size_outer == 1 case. Under
+// NumaPolicy::FIRST_TOUCH this faults each page in on the node of the thread
+// that later reads it. OMP blocks are split statically like the kernels' omp
+// for loops, TBB gets the even split affinity_partitioner starts out with and
+// WS goes through the pool of num_thread with the same grain as its kernels.
+// Kernels that also split the rows pass their plan, and the row block x column
+// block tiles are then touched with the same schedule as reducesum_split.
+template <typename T>
+void make_vector_first_touch(T *data_, int64_t size_outer, int64_t size_inner,
+                             int64_t threshold, int64_t num_thread,
+                             ReduceBackend backend,
+                             ReduceSplitPlan plan = {ReduceSplit::INNER, 1,
+                                                     1}) {
+  // Kernels that ignore threshold get -1, their input is touched in one block
+  // per thread
+  if (threshold <= 0) {
+    threshold = std::max<int64_t>(1, divup(size_inner, num_thread));
+  }
+  auto fill_tile = [=](int64_t r0, int64_t r1, int64_t c0, int64_t c1) {
+    for (int64_t i = r0; i < r1; i++) {
+      for (int64_t j = c0; j < c1; j++) {
+        data_[i * size_inner + j] = (T)((i * size_inner + j) % 1024);
+      }
+    }
+  };
+  auto fill = [=](int64_t begin, int64_t end) {
+    fill_tile(0, size_outer, begin, end);
+  };
+  if (plan.split != ReduceSplit::INNER &&
+      (backend == ReduceBackend::TBB || backend == ReduceBackend::OMP)) {
+    int64_t rows = divup(size_outer, plan.outer_blocks);
+    int64_t cols = divup(size_inner, plan.inner_blocks);
+    auto fill_task = [=](int64_t task) {
+      int64_t r0 = (task / plan.inner_blocks) * rows;
+      int64_t c0 = (task % plan.inner_blocks) * cols;
+      fill_tile(r0, std::min(r0 + rows, size_outer), c0,
+                std::min(c0 + cols, size_inner));
+    };
+    int64_t tasks = plan.outer_blocks * plan.inner_blocks;
+    if (backend == ReduceBackend::TBB) {
+      parallel_for(blocked_range<int64_t>(0, tasks, 1),
+                   [&](const blocked_range<int64_t> &r) {
+                     for (int64_t t = r.begin(); t < r.end(); t++) {
+                       fill_task(t);
+                     }
+                   },
+                   simple_partitioner());
+    } else {
+#pragma omp parallel for schedule(static)
+      for (int64_t t = 0; t < tasks; t++) {
+        fill_task(t);
+      }
+    }
+  } else if (backend == ReduceBackend::TBB) {
+    parallel_for(blocked_range<int64_t>(0, size_inner, threshold),
+                 [&](const blocked_range<int64_t> &r) {
+                   fill(r.begin(), r.end());
+                 },
+                 static_partitioner());
+  } else if (backend == ReduceBackend::OMP) {
+    int64_t num_blocks = divup(size_inner, threshold);
+#pragma omp parallel for schedule(static)
+    for (int64_t b = 0; b < num_blocks; b++) {
+      fill(b * threshold, std::min((b + 1) * threshold, size_inner));
+    }
+  } else if (backend == ReduceBackend::WS) {
+    ws::parallel_for(ws::pool(num_thread), 0, size_inner, threshold, fill);
+  } else {
+    fill(0, size_inner);
+  }
+}
+
+// Input of the parallel benchmarks, only first touched in parallel if the
+// NUMA policy asks for it
+template <typename T>
+void make_parallel_vector(T *data_, int64_t size_outer, int64_t size_inner,
+                          int64_t threshold, int64_t num_thread,
+                          ReduceBackend backend,
+                          ReduceSplitPlan plan = {ReduceSplit::INNER, 1, 1}) {
+  if (current_numa_policy() == NumaPolicy::FIRST_TOUCH) {
+    make_vector_first_touch(data_, size_outer, size_inner, threshold,
+                            num_thread, backend, plan);
+  } else {
+    make_vector(data_, size_outer * size_inner);
+  }
+}
+
+// Cached input of the parallel benchmarks. A parallel first touch depends on
+// the threads and the threshold of the benchmark, so those inputs are never
+// shared.
+template <typename T>
+std::shared_ptr<const T>
+parallel_dataset(int64_t size_outer, int64_t size_inner, int64_t threshold,
+                 int64_t num_thread, ReduceBackend backend,
+                 ReduceSplitPlan plan = {ReduceSplit::INNER, 1, 1}) {
+  if (current_numa_policy() == NumaPolicy::FIRST_TOUCH) {
+    T *data_ = NULL;
+    make_data(&data_, size_outer * size_inner);
+    make_vector_first_touch(data_, size_outer, size_inner, threshold,
+                            num_thread, backend, plan);
+    return std::shared_ptr<const T>(data_, free_buffer);
+  }
+  if (size_outer == 1) {
+    return dataset<T>({size_inner});
+  }
+  return dataset<T>({size_outer, size_inner});
+}
+
+// The parallel benchmarks keep one scheduler configuration for all their
+// iterations and bring the OMP team, the TBB workers and the work-stealing
+// pool up before timing, so they measure steady state. What thread creation
+// and resizing cost is measured by BM_RUNTIME_STARTUP and BM_RUNTIME_SWITCH in
+// fork_join.cpp.
+void warm_up_runtimes(int64_t num_thread) {
+#pragma omp parallel num_threads(num_thread)
+  { benchmark::ClobberMemory(); }
+  // TBB only wakes as many workers as there are tasks to steal, so each task
+  // waits a little for the others to show up
+  std::atomic<int64_t> arrived(0);
+  parallel_for(blocked_range<int64_t>(0, num_thread, 1),
+               [&](const blocked_range<int64_t> &) {
+                 arrived++;
+                 tbb::tick_count start = tbb::tick_count::now();
+                 while (arrived.load() < num_thread &&
+                        (tbb::tick_count::now() - start).seconds() < 0.01) {
+                   _mm_pause();
+                 }
+               },
+               simple_partitioner());
+  ws::pool(num_thread);
+}
+
+template <typename T>
+static void BM_ONECORE_SUM(benchmark::State &state, int64_t size, int64_t iter,
+                           sum_fn<T> sumf) {
+  std::shared_ptr<const T> data = dataset<T>({size});
+  const T *data_ = data.get();
+  // Checked once, every timed call sums the same data the same way
+  T result = 0;
+  sumf(result, data_, 0, size);
+  state.counters["rel_error"] =
+      relative_error(result, sum_reference(data_, 0, size));
+  PerfCounters perf(PerfScope::THREAD);
+  for (auto _ : state) {
+    state.PauseTiming();
+    state.counters["size"] = size;
+    state.counters["size_inner"] = -1;
+    state.counters["size_outer"] = -1;
+    state.counters["stride"] = 1;
+    state.counters["threshold"] = -1;
+    T sum = get_random_value();
+    time_and_report(state, iter, data_, size * sizeof(T),
+                    CallWork(size, size, size * sizeof(T)), -1, perf,
+                    [&] { sumf(sum, data_, 0, size); });
+  }
+}
+
+template <typename T>
+static void BM_ONECORE_SUM_SWEEP(benchmark::State &state, int64_t size,
+                                 int64_t iter, SumConfig<T> config) {
+  BM_ONECORE_SUM<T>(state, size, iter, config.sumf);
+  state.counters["accumulators"] = config.accumulators;
+  state.counters["unroll"] = config.unroll;
+  state.counters["aligned"] = config.aligned;
+}
+
+template <typename T>
+static void BM_ONECORE_SUM_PREFETCH(benchmark::State &state, int64_t size,
+                                    int64_t iter,
+                                    PrefetchConfig<sum_fn<T>> config) {
+  BM_ONECORE_SUM<T>(state, size, iter, config.fn);
+  state.counters["prefetch_distance"] = config.distance;
+  state.counters["stream"] = config.stream;
+}
+
+template <typename T>
+static void BM_ONECORE_REDUCESUM(benchmark::State &state, int64_t size_outer,
+                                 int64_t size_inner, int64_t iter,
+                                 reducesum_fn<T> reducesumf) {
+  std::shared_ptr<const T> data = dataset<T>({size_outer, size_inner});
+  const T *data_ = data.get();
+  OutputBuffer<T> out({size_inner});
+  T *out_data_ = out.data();
+  // Checked once, see BM_ONECORE_SUM
+  std::vector<double> out_ref(size_inner, 0);
+  memset(out_data_, 0, size_inner * sizeof(T));
+  reducesumf(data_, out_data_, 0, size_outer, 0, size_inner, size_inner);
+  reducesum_reference(data_, out_ref.data(), 0, size_outer, 0, size_inner,
+                      size_inner);
+  state.counters["rel_error"] =
+      max_relative_error(out_data_, out_ref.data(), size_inner);
+  PerfCounters perf(PerfScope::THREAD);
+  for (auto _ : state) {
+    state.PauseTiming();
+    state.counters["size"] = -1;
+    state.counters["size_inner"] = size_inner;
+    state.counters["size_outer"] = size_outer;
+    state.counters["stride"] = 1;
+    state.counters["threshold"] = -1;
+    out.reset();
+    int64_t size = size_outer * size_inner;
+    time_and_report(state, iter, data_, size * sizeof(T),
+                    CallWork(size, size, size * sizeof(T)), -1, perf, [&] {
+                      reducesumf(data_, out_data_, 0, size_outer, 0,
+                                 size_inner, size_inner);
+                    });
+  }
+}
+
+template <typename T>
+static void
+BM_ONECORE_REDUCESUM_PREFETCH(benchmark::State &state, int64_t size_outer,
+                              int64_t size_inner, int64_t iter,
+                              PrefetchConfig<reducesum_fn<T>> config) {
+  BM_ONECORE_REDUCESUM<T>(state, size_outer, size_inner, iter, config.fn);
+  state.counters["prefetch_distance"] = config.distance;
+  state.counters["stream"] = config.stream;
+}
+
+template <typename T>
+static void BM_PARALLEL_SUM(benchmark::State &state, int64_t size, int64_t iter,
+                            int64_t threshold, int64_t num_thread,
+                            ReduceBackend backend, parallelsum_fn<T> psumf) {
+  // Threads first, they may do the first touch
+  task_scheduler_init init(num_thread);
+  omp_set_num_threads(num_thread);
+  arena_pool().reserve(num_thread);
+  warm_up_runtimes(num_thread);
+  std::shared_ptr<const T> data =
+      parallel_dataset<T>(1, size, threshold, num_thread, backend);
+  const T *data_ = data.get();
+  // Checked once, see BM_ONECORE_SUM. The kernels with a fixed split give the
+  // same result on every call, the others differ only in rounding.
+  T result = 0;
+  psumf(result, data_, 0, size, threshold, num_thread);
+  state.counters["rel_error"] =
+      relative_error(result, sum_reference(data_, 0, size));
+  PerfCounters perf(PerfScope::PROCESS);
+  for (auto _ : state) {
+    state.PauseTiming();
+    state.counters["size"] = size;
+    state.counters["size_inner"] = -1;
+    state.counters["size_outer"] = -1;
+    state.counters["stride"] = 1;
+    state.counters["threshold"] = threshold;
+    T sum = get_random_value();
+    time_and_report(
+        state, iter, data_, size * sizeof(T),
+        CallWork(size, size, size * sizeof(T)), num_thread, perf,
+        [&] { psumf(sum, data_, 0, size, threshold, num_thread); });
+  }
+  init.terminate();
+}
+
+template <typename T>
+static void BM_PARALLEL_REDUCESUM(benchmark::State &state, int64_t size_outer,
+                                  int64_t size_inner, int64_t iter,
+                                  int64_t threshold, int64_t num_thread,
+                                  ReduceBackend backend, ReduceSplit split,
+                                  parallelreducesum_fn<T> preducesumf) {
+  // Threads first, they may do the first touch
+  task_scheduler_init init(num_thread);
+  omp_set_num_threads(num_thread);
+  arena_pool().reserve(num_thread);
+  warm_up_runtimes(num_thread);
+  // The output is touched with the same plan, row block 0 writes it
+  ReduceSplitPlan plan =
+      split_plan(split, size_outer, size_inner, threshold, num_thread);
+  std::shared_ptr<const T> data = parallel_dataset<T>(
+      size_outer, size_inner, threshold, num_thread, backend, plan);
+  const T *data_ = data.get();
+  // Not an OutputBuffer, the output is first touched like the input
+  T *out_data_ = NULL;
+  make_data(&out_data_, size_inner);
+  // Untimed, so that kernels with scratch, e.g. the *_split_128 ones, have it
+  // grown before the first timed call. Also the one accuracy check, see
+  // BM_PARALLEL_SUM.
+  std::vector<double> out_ref(size_inner, 0);
+  memset(out_data_, 0, size_inner * sizeof(T));
+  preducesumf(data_, out_data_, 0, size_outer, 0, size_inner, size_inner,
+              threshold, num_thread);
+  reducesum_reference(data_, out_ref.data(), 0, size_outer, 0, size_inner,
+                      size_inner);
+  state.counters["rel_error"] =
+      max_relative_error(out_data_, out_ref.data(), size_inner);
+  PerfCounters perf(PerfScope::PROCESS);
+  for (auto _ : state) {
+    state.PauseTiming();
+    state.counters["size"] = -1;
+    state.counters["size_inner"] = size_inner;
+    state.counters["size_outer"] = size_outer;
+    state.counters["stride"] = 1;
+    state.counters["threshold"] = threshold;
+    make_parallel_vector(out_data_, 1, size_inner, threshold, num_thread,
+                         backend, plan);
+    int64_t size = size_outer * size_inner;
+    time_and_report(
+        state, iter, data_, size * sizeof(T),
+        CallWork(size, size, size * sizeof(T)), num_thread, perf,
+        [&] {
+          preducesumf(data_, out_data_, 0, size_outer, 0, size_inner,
+                      size_inner, threshold, num_thread);
+        });
+  }
+  free_buffer(out_data_);
+  init.terminate();
+}
+
+// The allocation mode only changes page size and fault-in behaviour, so any
+// throughput difference at the large sizes is down to TLB pressure.
+// alloc_mode is the mode the input actually got, HUGETLB falls back to THP
+// without reserved pages. The input is the cached dataset the benchmark ran
+// on.
+template <typename T>
+static void BM_ONECORE_SUM_ALLOC(benchmark::State &state, int64_t size,
+                                 int64_t iter, AllocMode mode,
+                                 sum_fn<T> sumf) {
+  ScopedAllocMode scoped_mode(mode);
+  BM_ONECORE_SUM<T>(state, size, iter, sumf);
+  std::shared_ptr<const T> data = dataset<T>({size});
+  state.counters["alloc_mode"] = (int)buffer_alloc_mode(data.get());
+}
+
+template <typename T>
+static void
+BM_PARALLEL_REDUCESUM_ALLOC(benchmark::State &state, int64_t size_outer,
+                            int64_t size_inner, int64_t iter,
+                            int64_t threshold, int64_t num_thread,
+                            AllocMode mode,
+                            parallelreducesum_fn<T> preducesumf) {
+  ScopedAllocMode scoped_mode(mode);
+  BM_PARALLEL_REDUCESUM<T>(state, size_outer, size_inner, iter, threshold,
+                           num_thread, ReduceBackend::SERIAL,
+                           ReduceSplit::INNER, preducesumf);
+  std::shared_ptr<const T> data = dataset<T>({size_outer, size_inner});
+  state.counters["alloc_mode"] = (int)buffer_alloc_mode(data.get());
+}
+
+// What the *_arena kernels pay to limit parallelism to the number of useful
+// tasks. tasks one element chunks run through parallel_for in the default
+// arena (DIRECT), inside an arena of concurrency tasks (ARENA), and the bare
+// switch into and out of that arena (EMPTY).
+enum class ArenaSwitch { DIRECT = 0, ARENA, EMPTY };
+
+static void BM_ARENA_SWITCH(benchmark::State &state, int64_t tasks,
+                            int64_t iter, ArenaSwitch mode) {
+  for (auto _ : state) {
+    state.PauseTiming();
+    state.counters["iter"] = iter;
+    state.counters["num_thread"] = tasks;
+    state.counters["size"] = tasks;
+    state.counters["size_inner"] = -1;
+    state.counters["size_outer"] = -1;
+    state.counters["stride"] = 1;
+    state.counters["threshold"] = 1;
+    state.counters["arena_switch"] = (int)mode;
+    std::shared_ptr<tbb::task_arena> arena = arena_pool().get(tasks);
+    auto body = [](const blocked_range<int64_t> &r) {
+      int64_t b = r.begin();
+      benchmark::DoNotOptimize(b);
+    };
+    state.ResumeTiming();
+    for (int64_t step = 0; step < iter; step++) {
+      if (mode == ArenaSwitch::DIRECT) {
+        parallel_for(blocked_range<int64_t>(0, tasks, 1), body,
+                     simple_partitioner());
+      } else if (mode == ArenaSwitch::ARENA) {
+        arena->execute([&] {
+          parallel_for(blocked_range<int64_t>(0, tasks, 1), body,
+                       simple_partitioner());
+        });
+      } else {
+        arena->execute([] { benchmark::ClobberMemory(); });
+      }
+    }
+  }
+}
+
+template <typename T>
+static void BM_PARALLEL_SUM_NUMA(benchmark::State &state, int64_t size,
+                                 int64_t iter, int64_t threshold,
+                                 int64_t num_thread, NumaPolicy policy,
+                                 ReduceBackend backend,
+                                 parallelsum_fn<T> psumf) {
+  ScopedNumaPolicy scoped_policy(policy);
+  BM_PARALLEL_SUM<T>(state, size, iter, threshold, num_thread, backend, psumf);
+  state.counters["numa_policy"] = (int)policy;
+}
+
+template <typename T>
+static void
+BM_PARALLEL_REDUCESUM_NUMA(benchmark::State &state, int64_t size_outer,
+                           int64_t size_inner, int64_t iter, int64_t threshold,
+                           int64_t num_thread, NumaPolicy policy,
+                           ReduceBackend backend, ReduceSplit split,
+                           parallelreducesum_fn<T> preducesumf) {
+  ScopedNumaPolicy scoped_policy(policy);
+  BM_PARALLEL_REDUCESUM<T>(state, size_outer, size_inner, iter, threshold,
+                           num_thread, backend, split, preducesumf);
+  state.counters["numa_policy"] = (int)policy;
+}
+
+template <typename T>
+static void BM_ONECORE_SUM_CACHE(benchmark::State &state, int64_t size,
+                                 int64_t iter, CacheState cache,
+                                 sum_fn<T> sumf) {
+  ScopedCacheState scoped_cache(cache);
+  BM_ONECORE_SUM<T>(state, size, iter, sumf);
+}
+
+template <typename T>
+static void BM_ONECORE_REDUCESUM_CACHE(benchmark::State &state,
+                                       int64_t size_outer, int64_t size_inner,
+                                       int64_t iter, CacheState cache,
+                                       reducesum_fn<T> reducesumf) {
+  ScopedCacheState scoped_cache(cache);
+  BM_ONECORE_REDUCESUM<T>(state, size_outer, size_inner, iter, reducesumf);
+}
+
+template <typename T>
+static void BM_PARALLEL_SUM_CACHE(benchmark::State &state, int64_t size,
+                                  int64_t iter, int64_t threshold,
+                                  int64_t num_thread, CacheState cache,
+                                  ReduceBackend backend,
+                                  parallelsum_fn<T> psumf) {
+  ScopedCacheState scoped_cache(cache);
+  BM_PARALLEL_SUM<T>(state, size, iter, threshold, num_thread, backend, psumf);
+}
+
+template <typename T>
+static void BM_ONECORE_ROWWISE_REDUCESUM(benchmark::State &state,
+                                         int64_t size_outer, int64_t size_inner,
+                                         int64_t iter,
+                                         reducesum_fn<T> reducesumf) {
+  std::shared_ptr<const T> data = dataset<T>({size_outer, size_inner});
+  const T *data_ = data.get();
+  OutputBuffer<T> out({size_outer});
+  PerfCounters perf(PerfScope::THREAD);
+  for (auto _ : state) {
+    state.PauseTiming();
+    state.counters["size"] = -1;
+    state.counters["size_inner"] = size_inner;
+    state.counters["size_outer"] = size_outer;
+    state.counters["stride"] = 1;
+    state.counters["threshold"] = -1;
+    out.reset();
+    T *out_data_ = out.data();
+    int64_t size = size_outer * size_inner;
+    time_and_report(state, iter, data_, size * sizeof(T),
+                    CallWork(size, size, size * sizeof(T)), -1, perf, [&] {
+                      reducesumf(data_, out_data_, 0, size_outer, 0,
+                                 size_inner, size_inner);
+                    });
+  }
+}
+
+template <typename T>
+static void BM_PARALLEL_ROWWISE_REDUCESUM(benchmark::State &state,
+                                          int64_t size_outer,
+                                          int64_t size_inner, int64_t iter,
+                                          int64_t threshold, int64_t num_thread,
+                                          parallelreducesum_fn<T> preducesumf) {
+  task_scheduler_init init(num_thread);
+  omp_set_num_threads(num_thread);
+  warm_up_runtimes(num_thread);
+  std::shared_ptr<const T> data = dataset<T>({size_outer, size_inner});
+  const T *data_ = data.get();
+  OutputBuffer<T> out({size_outer});
+  PerfCounters perf(PerfScope::PROCESS);
+  for (auto _ : state) {
+    state.PauseTiming();
+    state.counters["size"] = -1;
+    state.counters["size_inner"] = size_inner;
+    state.counters["size_outer"] = size_outer;
+    state.counters["stride"] = 1;
+    state.counters["threshold"] = threshold;
+    out.reset();
+    T *out_data_ = out.data();
+    int64_t size = size_outer * size_inner;
+    time_and_report(state, iter, data_, size * sizeof(T),
+                    CallWork(size, size, size * sizeof(T)), num_thread, perf,
+                    [&] {
+                      preducesumf(data_, out_data_, 0, size_outer, 0,
+                                  size_inner, size_inner, threshold,
+                                  num_thread);
+                    });
   }
+  init.terminate();
 }
 
-static void BM_ONECORE_SUM(benchmark::State &state, int64_t size, int64_t iter,
-                           void (*sumf)(float &, const float *, size_t,
-                                        size_t)) {
+// 3-d shapes of 16M elements, shared with the ATen sum(dim) benchmarks in
+// compare_eigen.cpp
+std::vector<std::vector<int64_t>> reducesum_nd_shapes() {
+  return {{256, 256, 256},
+          {64, 1024, 256},
+          {1024, 64, 256},
+          {256, 1024, 64},
+          {16, 16384, 64}};
+}
+
+// Registered as reducesum_nd_engine*, apart from the reducesum_nd* kernels the
+// 2-d benchmarks run on the same engine
+template <typename T>
+static void BM_REDUCESUM_ND(benchmark::State &state, std::vector<int64_t> shape,
+                            int64_t dim, int64_t iter, int64_t num_thread,
+                            ReduceBackend backend) {
+  task_scheduler_init init(num_thread > 0 ? num_thread : 1);
+  omp_set_num_threads(num_thread > 0 ? num_thread : 1);
+  warm_up_runtimes(num_thread > 0 ? num_thread : 1);
+  std::shared_ptr<const T> data = dataset<T>(shape);
+  const T *data_ = data.get();
+  OutputBuffer<T> out({shape_numel(shape) / shape[dim]}, Fill::ZERO);
+  PerfCounters perf(PerfScope::PROCESS);
   for (auto _ : state) {
     state.PauseTiming();
-    state.counters["iter"] = iter;
-    state.counters["num_thread"] = -1;
+    int64_t size = shape[0] * shape[1] * shape[2];
     state.counters["size"] = size;
     state.counters["size_inner"] = -1;
     state.counters["size_outer"] = -1;
+    state.counters["stride"] = 1;
+    state.counters["threshold"] = at::internal::GRAIN_SIZE;
+    state.counters["shape0"] = shape[0];
+    state.counters["shape1"] = shape[1];
+    state.counters["shape2"] = shape[2];
+    state.counters["reduce_dim"] = dim;
+    out.reset();
+    T *out_data_ = out.data();
+    std::vector<int64_t> strides = {shape[1] * shape[2], shape[2], 1};
+    time_and_report(state, iter, data_, size * sizeof(T),
+                    CallWork(size, size, size * sizeof(T)), num_thread, perf,
+                    [&] {
+                      reducesum_nd(data_, out_data_, shape, strides, {dim},
+                                   backend, at::internal::GRAIN_SIZE,
+                                   num_thread);
+                    });
+  }
+  init.terminate();
+}
+
+// Owns the outputs of a column-wise statistics kernel
+struct StatsColumnsData {
+  std::vector<float> sum, sumsq, min, max;
+  std::vector<int64_t> argmax;
+
+  StatsColumnsData(size_t size)
+      : sum(size, 0), sumsq(size, 0),
+        min(size, std::numeric_limits<float>::infinity()),
+        max(size, -std::numeric_limits<float>::infinity()),
+        argmax(size, -1) {}
+
+  StatsColumns columns() {
+    return {sum.data(), sumsq.data(), min.data(), max.data(), argmax.data()};
+  }
+};
+
+// passes is how often a kernel reads its input, see stats_passes
+static void BM_ONECORE_STATS(benchmark::State &state, int64_t size,
+                             int64_t iter, int64_t passes, stats_fn statsf) {
+  std::shared_ptr<const float> data = dataset<float>({size});
+  const float *data_ = data.get();
+  PerfCounters perf(PerfScope::THREAD);
+  for (auto _ : state) {
+    state.PauseTiming();
+    state.counters["size"] = size;
+    state.counters["size_inner"] = -1;
+    state.counters["size_outer"] = -1;
+    state.counters["stride"] = 1;
     state.counters["threshold"] = -1;
-    int64_t steps = iter;
-    float sum = get_random_value();
-    float *data_ = NULL;
-    make_float_data(&data_, size);
-    make_vector(data_, size);
-    state.ResumeTiming();
-    for (int64_t step = 0; step < iter; step++) {
-      sumf(sum, data_, 0, size);
-    }
+    Stats stats = stats_identity();
+    time_and_report(
+        state, iter, data_, size * sizeof(float),
+        CallWork(size, _STATS_FLOPS * size, passes * size * sizeof(float)),
+        -1, perf, [&] { statsf(stats, data_, 0, size); },
+        [&] { benchmark::DoNotOptimize(stats); });
+  }
+}
+
+static void BM_PARALLEL_STATS(benchmark::State &state, int64_t size,
+                              int64_t iter, int64_t passes, int64_t threshold,
+                              int64_t num_thread, parallelstats_fn pstatsf) {
+  task_scheduler_init init(num_thread);
+  omp_set_num_threads(num_thread);
+  warm_up_runtimes(num_thread);
+  std::shared_ptr<const float> data = dataset<float>({size});
+  const float *data_ = data.get();
+  PerfCounters perf(PerfScope::PROCESS);
+  for (auto _ : state) {
     state.PauseTiming();
-    free(data_);
-    state.ResumeTiming();
+    state.counters["size"] = size;
+    state.counters["size_inner"] = -1;
+    state.counters["size_outer"] = -1;
+    state.counters["stride"] = 1;
+    state.counters["threshold"] = threshold;
+    Stats stats = stats_identity();
+    time_and_report(
+        state, iter, data_, size * sizeof(float),
+        CallWork(size, _STATS_FLOPS * size, passes * size * sizeof(float)),
+        num_thread, perf,
+        [&] { pstatsf(stats, data_, 0, size, threshold, num_thread); },
+        [&] { benchmark::DoNotOptimize(stats); });
   }
+  init.terminate();
 }
 
-static void BM_ONECORE_REDUCESUM(benchmark::State &state, int64_t size_outer,
-                                 int64_t size_inner, int64_t iter,
-                                 void (*reducesumf)(const float *, float *,
-                                                    size_t, size_t, size_t,
-                                                    size_t, size_t)) {
+static void BM_ONECORE_REDUCESTATS(benchmark::State &state, int64_t size_outer,
+                                   int64_t size_inner, int64_t iter,
+                                   int64_t passes,
+                                   reducestats_fn reducestatsf) {
+  std::shared_ptr<const float> data = dataset<float>({size_outer, size_inner});
+  const float *data_ = data.get();
+  PerfCounters perf(PerfScope::THREAD);
   for (auto _ : state) {
     state.PauseTiming();
-    state.counters["iter"] = iter;
-    state.counters["num_thread"] = -1;
     state.counters["size"] = -1;
     state.counters["size_inner"] = size_inner;
     state.counters["size_outer"] = size_outer;
+    state.counters["stride"] = 1;
     state.counters["threshold"] = -1;
-    int64_t steps = iter;
-    float sum = get_random_value();
-    float *data_ = NULL;
-    make_float_data(&data_, size_outer * size_inner);
-    make_vector(data_, size_outer * size_inner);
-    float *out_data_ = NULL;
-    make_float_data(&out_data_, size_inner);
-    make_vector(out_data_, size_inner);
-    state.ResumeTiming();
-    for (int64_t step = 0; step < iter; step++) {
-      reducesumf(data_, out_data_, 0, size_outer, 0, size_inner, size_inner);
-    }
+    StatsColumnsData out(size_inner);
+    int64_t size = size_outer * size_inner;
+    time_and_report(
+        state, iter, data_, size * sizeof(float),
+        CallWork(size, _STATS_FLOPS * size, passes * size * sizeof(float)),
+        -1, perf, [&] {
+          reducestatsf(data_, out.columns(), 0, size_outer, 0, size_inner,
+                       size_inner);
+        });
+  }
+}
+
+static void BM_PARALLEL_REDUCESTATS(benchmark::State &state, int64_t size_outer,
+                                    int64_t size_inner, int64_t iter,
+                                    int64_t passes, int64_t threshold,
+                                    int64_t num_thread,
+                                    parallelreducestats_fn preducestatsf) {
+  task_scheduler_init init(num_thread);
+  omp_set_num_threads(num_thread);
+  warm_up_runtimes(num_thread);
+  std::shared_ptr<const float> data = dataset<float>({size_outer, size_inner});
+  const float *data_ = data.get();
+  PerfCounters perf(PerfScope::PROCESS);
+  for (auto _ : state) {
     state.PauseTiming();
-    free(data_);
-    free(out_data_);
-    state.ResumeTiming();
+    state.counters["size"] = -1;
+    state.counters["size_inner"] = size_inner;
+    state.counters["size_outer"] = size_outer;
+    state.counters["stride"] = 1;
+    state.counters["threshold"] = threshold;
+    StatsColumnsData out(size_inner);
+    int64_t size = size_outer * size_inner;
+    time_and_report(
+        state, iter, data_, size * sizeof(float),
+        CallWork(size, _STATS_FLOPS * size, passes * size * sizeof(float)),
+        num_thread, perf, [&] {
+          preducestatsf(data_, out.columns(), 0, size_outer, 0, size_inner,
+                        size_inner, threshold, num_thread);
+        });
   }
+  init.terminate();
 }
 
-static void BM_PARALLEL_SUM(benchmark::State &state, int64_t size, int64_t iter,
-                            int64_t threshold, int64_t num_thread,
-                            void (*psumf)(float &, const float *, size_t,
-                                          size_t, size_t, size_t)) {
+template <typename T>
+static void BM_ONECORE_STRIDED_SUM(benchmark::State &state, int64_t size,
+                                   int64_t stride, int64_t iter,
+                                   stridedsum_fn<T> sumf) {
+  std::shared_ptr<const T> data = dataset<T>({size, stride});
+  const T *data_ = data.get();
+  // Checked once, see BM_ONECORE_SUM
+  T result = 0;
+  T reference = 0;
+  sumf(result, data_, 0, size, stride);
+  sum_strided_naive(reference, data_, 0, size, stride);
+  state.counters["rel_error"] = relative_error(result, reference);
+  PerfCounters perf(PerfScope::THREAD);
   for (auto _ : state) {
     state.PauseTiming();
-    state.counters["iter"] = iter;
-    state.counters["num_thread"] = num_thread;
     state.counters["size"] = size;
     state.counters["size_inner"] = -1;
     state.counters["size_outer"] = -1;
-    state.counters["threshold"] = threshold;
-    int64_t steps = iter;
-    float sum = get_random_value();
-    float *data_ = NULL;
-    make_float_data(&data_, size);
-    make_vector(data_, size);
-    task_scheduler_init init(num_thread);
-    omp_set_num_threads(num_thread);
-    state.ResumeTiming();
-    for (int64_t step = 0; step < iter; step++) {
-      psumf(sum, data_, 0, size, threshold, num_thread);
-    }
+    state.counters["stride"] = stride;
+    state.counters["threshold"] = -1;
+    T sum = get_random_value();
+    time_and_report(state, iter, data_, size * stride * sizeof(T),
+                    CallWork(size, size, size * sizeof(T)), -1, perf,
+                    [&] { sumf(sum, data_, 0, size, stride); });
+  }
+}
+
+template <typename T>
+static void BM_ONECORE_STRIDED_REDUCESUM(benchmark::State &state,
+                                         int64_t size_outer, int64_t size_inner,
+                                         int64_t stride, int64_t iter,
+                                         stridedreducesum_fn<T> reducesumf) {
+  std::shared_ptr<const T> data = dataset<T>({size_outer, size_inner, stride});
+  const T *data_ = data.get();
+  OutputBuffer<T> out({size_inner});
+  PerfCounters perf(PerfScope::THREAD);
+  for (auto _ : state) {
     state.PauseTiming();
-    init.terminate();
-    free(data_);
-    state.ResumeTiming();
+    state.counters["size"] = -1;
+    state.counters["size_inner"] = size_inner;
+    state.counters["size_outer"] = size_outer;
+    state.counters["stride"] = stride;
+    state.counters["threshold"] = -1;
+    out.reset();
+    T *out_data_ = out.data();
+    int64_t size = size_outer * size_inner;
+    time_and_report(state, iter, data_, size * stride * sizeof(T),
+                    CallWork(size, size, size * sizeof(T)), -1, perf, [&] {
+                      reducesumf(data_, out_data_, 0, size_outer, 0,
+                                 size_inner, size_inner, stride);
+                    });
   }
 }
 
-static void BM_PARALLEL_REDUCESUM(
-    benchmark::State &state, int64_t size_outer, int64_t size_inner,
-    int64_t iter, int64_t threshold, int64_t num_thread,
-    void (*preducesumf)(const float *, float *, size_t, size_t, size_t, size_t,
-                        size_t, size_t, size_t)) {
+template <typename T>
+static void BM_PARALLEL_STRIDED_SUM(benchmark::State &state, int64_t size,
+                                    int64_t stride, int64_t iter,
+                                    int64_t threshold, int64_t num_thread,
+                                    parallelstridedsum_fn<T> psumf) {
+  task_scheduler_init init(num_thread);
+  omp_set_num_threads(num_thread);
+  warm_up_runtimes(num_thread);
+  std::shared_ptr<const T> data = dataset<T>({size, stride});
+  const T *data_ = data.get();
+  // Checked once, see BM_PARALLEL_SUM
+  T result = 0;
+  T reference = 0;
+  psumf(result, data_, 0, size, stride, threshold, num_thread);
+  sum_strided_naive(reference, data_, 0, size, stride);
+  state.counters["rel_error"] = relative_error(result, reference);
+  PerfCounters perf(PerfScope::PROCESS);
+  for (auto _ : state) {
+    state.PauseTiming();
+    state.counters["size"] = size;
+    state.counters["size_inner"] = -1;
+    state.counters["size_outer"] = -1;
+    state.counters["stride"] = stride;
+    state.counters["threshold"] = threshold;
+    T sum = get_random_value();
+    time_and_report(
+        state, iter, data_, size * stride * sizeof(T),
+        CallWork(size, size, size * sizeof(T)), num_thread, perf,
+        [&] { psumf(sum, data_, 0, size, stride, threshold, num_thread); });
+  }
+  init.terminate();
+}
+
+template <typename T>
+static void
+BM_PARALLEL_STRIDED_REDUCESUM(benchmark::State &state, int64_t size_outer,
+                              int64_t size_inner, int64_t stride, int64_t iter,
+                              int64_t threshold, int64_t num_thread,
+                              parallelstridedreducesum_fn<T> preducesumf) {
+  task_scheduler_init init(num_thread);
+  omp_set_num_threads(num_thread);
+  warm_up_runtimes(num_thread);
+  std::shared_ptr<const T> data = dataset<T>({size_outer, size_inner, stride});
+  const T *data_ = data.get();
+  OutputBuffer<T> out({size_inner});
+  PerfCounters perf(PerfScope::PROCESS);
   for (auto _ : state) {
     state.PauseTiming();
-    state.counters["iter"] = iter;
-    state.counters["num_thread"] = num_thread;
     state.counters["size"] = -1;
     state.counters["size_inner"] = size_inner;
     state.counters["size_outer"] = size_outer;
+    state.counters["stride"] = stride;
     state.counters["threshold"] = threshold;
-    int64_t steps = iter;
-    float sum = get_random_value();
-    float *data_ = NULL;
-    make_float_data(&data_, size_outer * size_inner);
-    make_vector(data_, size_outer * size_inner);
-    float *out_data_ = NULL;
-    make_float_data(&out_data_, size_inner);
-    make_vector(out_data_, size_inner);
-    task_scheduler_init init(num_thread);
-    omp_set_num_threads(num_thread);
-    state.ResumeTiming();
-    for (int64_t step = 0; step < iter; step++) {
-      preducesumf(data_, out_data_, 0, size_outer, 0, size_inner, size_inner,
-                  threshold, num_thread);
+    out.reset();
+    T *out_data_ = out.data();
+    int64_t size = size_outer * size_inner;
+    time_and_report(state, iter, data_, size * stride * sizeof(T),
+                    CallWork(size, size, size * sizeof(T)), num_thread, perf,
+                    [&] {
+                      preducesumf(data_, out_data_, 0, size_outer, 0,
+                                  size_inner, size_inner, stride, threshold,
+                                  num_thread);
+                    });
+  }
+  init.terminate();
+}
+
+// Compensated and pairwise kernels don't match the naive summation order, so
+// they are checked against a double reference. The error is taken relative to
+// the sum of magnitudes so that cancellation in a column doesn't dominate.
+template <typename T>
+void check_reducesum_accuracy(std::string name, const T *arr, const T *outarr,
+                              size_t size1b, size_t size1e, size_t size2b,
+                              size_t size2e, size_t size2) {
+  for (size_t j = size2b; j < size2e; j++) {
+    double ref = 0;
+    double magnitude = 0;
+    for (size_t i = size1b; i < size1e; i++) {
+      ref += arr[i * size2 + j];
+      magnitude += std::abs((double)arr[i * size2 + j]);
+    }
+    double error = std::abs(outarr[j] - ref) / magnitude;
+    if (error > 1e-5) {
+      throw std::runtime_error("check_reducesum_accuracy failed - name: " +
+                               name + " - ref: " + std::to_string(ref) +
+                               " - comp: " + std::to_string(outarr[j]) +
+                               " - error: " + std::to_string(error));
     }
-    state.PauseTiming();
-    init.terminate();
-    free(data_);
-    free(out_data_);
-    state.ResumeTiming();
   }
 }
 
-void test_sum(std::string name,
-              void (*sumf_comp)(float &, const float *, size_t, size_t)) {
+template <typename T>
+void test_sum(std::string name, sum_fn<T> sumf_comp, bool accurate = false) {
   int64_t size = 367 * 107;
-  float *data_ = NULL;
-  make_float_data(&data_, size);
+  T *data_ = NULL;
+  make_data(&data_, size);
   make_random_vector(data_, size);
   task_scheduler_init init(10);
   omp_set_num_threads(10);
   for (int64_t offset = 0; offset < 1000; offset = (offset + 3) * 13) {
-    float sum_ref = 0;
-    float sum_comp = 0;
+    T sum_ref = 0;
+    T sum_comp = 0;
     sum_naive(sum_ref, data_, offset, size - offset);
     sumf_comp(sum_comp, data_, offset, size - offset);
-    float ratio = std::abs(sum_ref - sum_comp) / std::abs(sum_ref);
+    if (accurate) {
+      // A sum is a reduction of a single column
+      check_reducesum_accuracy(name, data_, &sum_comp, offset, size - offset, 0,
+                               1, 1);
+      continue;
+    }
+    double ratio = std::abs((double)sum_ref - (double)sum_comp) /
+                   std::abs((double)sum_ref);
     if (ratio > 1e-3) {
       for (int64_t i = offset; i < size - offset; i++) {
         std::cout << "i: " << i << " - " << data_[i] << std::endl;
@@ -595,28 +3739,34 @@ void test_sum(std::string name,
     }
   }
   init.terminate();
-  free(data_);
+  free_buffer(data_);
 }
 
-void test_sum_parallel(std::string name,
-                       void (*sumf_comp)(float &, const float *, size_t, size_t,
-                                         size_t, size_t)) {
+template <typename T>
+void test_sum_parallel(std::string name, parallelsum_fn<T> sumf_comp,
+                       bool accurate = false) {
   int64_t size = 367 * 107 * 10;
-  float *data_ = NULL;
+  T *data_ = NULL;
   // It is very important that his happens here!
   // Otherwise subsequent calls to tbb parallel constructs won't be affected
   // by the number of threads set if this is called first.
   task_scheduler_init init(10);
   omp_set_num_threads(10);
-  make_float_data(&data_, size);
+  make_data(&data_, size);
   make_random_vector(data_, size);
   for (int64_t offset = 0; offset < 1000; offset = (offset + 3) * 13) {
-    float sum_ref = 0;
-    float sum_comp = 0;
+    T sum_ref = 0;
+    T sum_comp = 0;
     sum_naive(sum_ref, data_, offset, size - offset);
     sumf_comp(sum_comp, data_, offset, size - offset, 128,
               omp_get_max_threads());
-    float ratio = std::abs(sum_ref - sum_comp) / std::abs(sum_ref);
+    if (accurate) {
+      check_reducesum_accuracy(name, data_, &sum_comp, offset, size - offset, 0,
+                               1, 1);
+      continue;
+    }
+    double ratio = std::abs((double)sum_ref - (double)sum_comp) /
+                   std::abs((double)sum_ref);
     if (ratio > 1e-3) {
       throw std::runtime_error("test_sum_parallel failed - name: " + name +
                                " - sum_ref: " + std::to_string(sum_ref) +
@@ -625,176 +3775,1353 @@ void test_sum_parallel(std::string name,
     }
   }
   init.terminate();
-  free(data_);
+  free_buffer(data_);
+}
+
+// The deterministic kernels must not only be close to the reference, they must
+// reproduce the single core result bit for bit whatever the thread count and
+// threshold.
+template <typename T>
+void test_sum_deterministic(std::string name, parallelsum_fn<T> sumf_comp) {
+  int64_t size = 367 * 107 * 10;
+  T *data_ = NULL;
+  make_data(&data_, size);
+  make_random_vector(data_, size);
+  for (int64_t offset = 0; offset < 1000; offset = (offset + 3) * 13) {
+    T sum_ref = 0;
+    sum_deterministic_128<T, sum_simple_128<T>>(sum_ref, data_, offset,
+                                                size - offset);
+    for (int64_t num_thread : {1, 2, 3, 7, 10}) {
+      task_scheduler_init init(num_thread);
+      omp_set_num_threads(num_thread);
+      for (int64_t threshold : {128, 4096, 100000}) {
+        T sum_comp = 0;
+        sumf_comp(sum_comp, data_, offset, size - offset, threshold,
+                  num_thread);
+        if (std::memcmp(&sum_ref, &sum_comp, sizeof(T)) != 0) {
+          throw std::runtime_error(
+              "test_sum_deterministic failed - name: " + name +
+              " - sum_ref: " + std::to_string(sum_ref) +
+              " - sum_comp: " + std::to_string(sum_comp) +
+              " - num_thread: " + std::to_string(num_thread) +
+              " - threshold: " + std::to_string(threshold));
+        }
+      }
+      init.terminate();
+    }
+  }
+  free_buffer(data_);
 }
 
-void test_reducesum(std::string name,
-                    void (*reducef_comp)(const float *, float *, size_t, size_t,
-                                         size_t, size_t, size_t)) {
+template <typename T>
+void test_reducesum(std::string name, reducesum_fn<T> reducef_comp,
+                    bool accurate = false) {
 
   size_t inner_size = 3670;
   size_t outer_size = 107 * 10;
-  float *data_ = NULL;
-  float *out_data_ = NULL;
-  float *out_data_comp_ = NULL;
+  T *data_ = NULL;
+  T *out_data_ = NULL;
+  T *out_data_comp_ = NULL;
   // It is very important that his happens here!
   // Otherwise subsequent calls to tbb parallel constructs won't be affected
   // by the number of threads set if this is called first.
   task_scheduler_init init(10);
   omp_set_num_threads(10);
-  make_float_data(&data_, outer_size * inner_size);
+  make_data(&data_, outer_size * inner_size);
   make_random_vector(data_, outer_size * inner_size);
-  make_float_data(&out_data_, inner_size);
-  make_float_data(&out_data_comp_, inner_size);
+  make_data(&out_data_, inner_size);
+  make_data(&out_data_comp_, inner_size);
   for (int64_t offset = 0; offset < 1000; offset = (offset + 3) * 13) {
+    if (accurate) {
+      memset(out_data_comp_, 0, inner_size * sizeof(T));
+      reducef_comp(data_, out_data_comp_, offset, outer_size - offset, offset,
+                   inner_size - offset, inner_size);
+      check_reducesum_accuracy(name, data_, out_data_comp_, offset,
+                               outer_size - offset, offset, inner_size - offset,
+                               inner_size);
+      continue;
+    }
     reducesum_naive(data_, out_data_, offset, outer_size - offset, offset,
                     inner_size - offset, inner_size);
     reducef_comp(data_, out_data_comp_, offset, outer_size - offset, offset,
                  inner_size - offset, inner_size);
     for (int64_t i = offset; i < inner_size - offset; i++) {
-      float ratio =
-          std::abs(out_data_[i] - out_data_comp_[i]) / std::abs(out_data_[i]);
+      double ratio =
+          std::abs((double)out_data_[i] - (double)out_data_comp_[i]) /
+          std::abs((double)out_data_[i]);
+      if (ratio > 1e-3) {
+        std::string wrong_out = std::to_string(out_data_[i]);
+        std::string wrong_out_comp = std::to_string(out_data_comp_[i]);
+        std::string s1 = "test_reducesum failed - name: " + name;
+        std::string s2 = " - out_data_[" + std::to_string(i);
+        std::string s3 = "]: " + wrong_out + " - out_data_comp_[";
+        std::string s4 = std::to_string(i) + "]: " + wrong_out_comp;
+        std::string s5 = " - error: " + std::to_string(ratio);
+        throw std::runtime_error(s1 + s2 + s3 + s4 + s5);
+      }
+    }
+  }
+  init.terminate();
+  free_buffer(data_);
+  free_buffer(out_data_);
+  free_buffer(out_data_comp_);
+}
+
+template <typename T>
+void test_parallelreducesum_shape(std::string name,
+                                  parallelreducesum_fn<T> parallelreducef_comp,
+                                  bool accurate, size_t outer_size,
+                                  size_t inner_size) {
+  T *data_ = NULL;
+  T *out_data_ = NULL;
+  T *out_data_comp_ = NULL;
+  // It is very important that his happens here!
+  // Otherwise subsequent calls to tbb parallel constructs won't be affected
+  // by the number of threads set if this is called first.
+  task_scheduler_init init(10);
+  omp_set_num_threads(10);
+  make_data(&data_, outer_size * inner_size);
+  make_random_vector(data_, outer_size * inner_size);
+  make_data(&out_data_, inner_size);
+  make_data(&out_data_comp_, inner_size);
+  // Kernels that split the rows add them up in a different order. A column
+  // that almost cancels out then fails the relative check, so a mismatch also
+  // has to be large relative to the sum of magnitudes, as in
+  // check_reducesum_accuracy.
+  std::vector<double> magnitude(inner_size, 0);
+  for (size_t i = 0; i < outer_size; i++) {
+    for (size_t j = 0; j < inner_size; j++) {
+      magnitude[j] += std::abs((double)data_[i * inner_size + j]);
+    }
+  }
+  int64_t calls = 0;
+  for (int64_t offset = 0; offset < 1000 && 2 * offset < inner_size;
+       offset = (offset + 3) * 13) {
+    if (accurate) {
+      memset(out_data_comp_, 0, inner_size * sizeof(T));
+      parallelreducef_comp(data_, out_data_comp_, 0, outer_size, offset,
+                           inner_size - offset, inner_size, 128,
+                           omp_get_max_threads());
+      check_reducesum_accuracy(name, data_, out_data_comp_, 0, outer_size,
+                               offset, inner_size - offset, inner_size);
+      continue;
+    }
+    reducesum_naive(data_, out_data_, 0, outer_size, offset,
+                    inner_size - offset, inner_size);
+    parallelreducef_comp(data_, out_data_comp_, 0, outer_size, offset,
+                         inner_size - offset, inner_size, 128,
+                         omp_get_max_threads());
+    // The ranges shrink, so every column checked here was summed calls times
+    calls++;
+    for (int64_t i = offset; i < inner_size - offset; i++) {
+      double diff = std::abs((double)out_data_[i] - (double)out_data_comp_[i]);
+      double ratio = diff / std::abs((double)out_data_[i]);
+      if (ratio > 1e-3 && diff / (magnitude[i] * calls) > 1e-5) {
+        std::string wrong_out = std::to_string(out_data_[i]);
+        std::string wrong_out_comp = std::to_string(out_data_comp_[i]);
+        std::string s1 = "test_parallelreducesum failed - name: " + name;
+        std::string s2 = " - out_data_[" + std::to_string(i);
+        std::string s3 = "]: " + wrong_out + " - out_data_comp_[";
+        std::string s4 = std::to_string(i) + "]: " + wrong_out_comp;
+        std::string s5 = " - error: " + std::to_string(ratio);
+        throw std::runtime_error(s1 + s2 + s3 + s4 + s5);
+      }
+    }
+  }
+  init.terminate();
+  free_buffer(data_);
+  free_buffer(out_data_);
+  free_buffer(out_data_comp_);
+}
+
+template <typename T>
+void test_parallelreducesum(std::string name,
+                            parallelreducesum_fn<T> parallelreducef_comp,
+                            bool accurate = false) {
+  // The narrow shape only has parallelism along the outer dimension
+  std::vector<std::pair<size_t, size_t>> shapes = {{107 * 10, 3670},
+                                                   {40000, 12}};
+  for (auto shape : shapes) {
+    test_parallelreducesum_shape(name, parallelreducef_comp, accurate,
+                                 shape.first, shape.second);
+  }
+}
+
+template <typename T>
+void check_rowwise_reducesum(std::string name, const T *out_ref,
+                             const T *out_comp, size_t size1b, size_t size1e) {
+  for (size_t i = size1b; i < size1e; i++) {
+    double ratio = std::abs((double)out_ref[i] - (double)out_comp[i]) /
+                   std::abs((double)out_ref[i]);
+    if (ratio > 1e-3) {
+      throw std::runtime_error("test_rowwise_reducesum failed - name: " + name +
+                               " - out_ref[" + std::to_string(i) +
+                               "]: " + std::to_string(out_ref[i]) +
+                               " - out_comp: " + std::to_string(out_comp[i]) +
+                               " - error: " + std::to_string(ratio));
+    }
+  }
+}
+
+template <typename T>
+void test_rowwise_reducesum(std::string name, reducesum_fn<T> reducef_comp) {
+  size_t inner_size = 367;
+  size_t outer_size = 1070;
+  T *data_ = NULL;
+  make_data(&data_, outer_size * inner_size);
+  make_random_vector(data_, outer_size * inner_size);
+  std::vector<T> out_ref(outer_size);
+  std::vector<T> out_comp(outer_size);
+  for (int64_t offset = 0; offset < 100; offset = (offset + 3) * 5) {
+    std::fill(out_ref.begin(), out_ref.end(), 0);
+    std::fill(out_comp.begin(), out_comp.end(), 0);
+    reducesum_rowwise_naive(data_, out_ref.data(), offset, outer_size - offset,
+                            offset, inner_size - offset, inner_size);
+    reducef_comp(data_, out_comp.data(), offset, outer_size - offset, offset,
+                 inner_size - offset, inner_size);
+    check_rowwise_reducesum(name, out_ref.data(), out_comp.data(), offset,
+                            outer_size - offset);
+  }
+  free_buffer(data_);
+}
+
+template <typename T>
+void test_rowwise_parallelreducesum(
+    std::string name, parallelreducesum_fn<T> parallelreducef_comp) {
+  size_t inner_size = 367;
+  size_t outer_size = 1070 * 10;
+  task_scheduler_init init(10);
+  omp_set_num_threads(10);
+  T *data_ = NULL;
+  make_data(&data_, outer_size * inner_size);
+  make_random_vector(data_, outer_size * inner_size);
+  std::vector<T> out_ref(outer_size);
+  std::vector<T> out_comp(outer_size);
+  for (int64_t offset = 0; offset < 1000; offset = (offset + 3) * 13) {
+    std::fill(out_ref.begin(), out_ref.end(), 0);
+    std::fill(out_comp.begin(), out_comp.end(), 0);
+    reducesum_rowwise_naive(data_, out_ref.data(), offset, outer_size - offset,
+                            0, inner_size, inner_size);
+    parallelreducef_comp(data_, out_comp.data(), offset, outer_size - offset, 0,
+                         inner_size, inner_size, 1024, omp_get_max_threads());
+    check_rowwise_reducesum(name, out_ref.data(), out_comp.data(), offset,
+                            outer_size - offset);
+  }
+  free_buffer(data_);
+  init.terminate();
+}
+
+template <typename T>
+void reducesum_nd_reference(const T *arr, T *outarr,
+                            const std::vector<int64_t> &sizes,
+                            const std::vector<int64_t> &strides,
+                            const std::vector<int64_t> &reduce_dims) {
+  int64_t numel = 1;
+  for (int64_t size : sizes) {
+    numel *= size;
+  }
+  for (int64_t linear = 0; linear < numel; linear++) {
+    int64_t rest = linear;
+    int64_t in = 0;
+    int64_t out = 0;
+    int64_t out_stride = 1;
+    for (int64_t d = sizes.size() - 1; d >= 0; d--) {
+      int64_t index = rest % sizes[d];
+      rest /= sizes[d];
+      in += index * strides[d];
+      if (std::find(reduce_dims.begin(), reduce_dims.end(), d) ==
+          reduce_dims.end()) {
+        out += index * out_stride;
+        out_stride *= sizes[d];
+      }
+    }
+    outarr[out] += arr[in];
+  }
+}
+
+// Runs the engine over contiguous and permuted 3-d inputs for every subset of
+// reduced axes and every backend. The empty shapes must leave the output
+// zero.
+template <typename T> void test_reducesum_nd() {
+  std::vector<std::vector<int64_t>> shapes = {
+      {37, 59, 83}, {3, 1, 1001}, {1, 307, 7},
+      {129, 5, 1},  {0, 5, 7},    {4, 0, 3}};
+  std::vector<std::vector<int64_t>> reduce_dims = {
+      {0}, {1}, {2}, {0, 1}, {0, 2}, {1, 2}, {0, 1, 2}};
+  task_scheduler_init init(10);
+  omp_set_num_threads(10);
+  for (const std::vector<int64_t> &shape : shapes) {
+    int64_t size = shape[0] * shape[1] * shape[2];
+    T *data_ = NULL;
+    make_data(&data_, size);
+    make_random_vector(data_, size);
+    // Contiguous, and a view whose innermost axis has the largest stride
+    std::vector<std::vector<int64_t>> strides = {
+        {shape[1] * shape[2], shape[2], 1},
+        {shape[1], 1, shape[0] * shape[1]}};
+    for (const std::vector<int64_t> &stride : strides) {
+      for (const std::vector<int64_t> &dims : reduce_dims) {
+        for (ReduceBackend backend : {ReduceBackend::SERIAL, ReduceBackend::OMP,
+                                      ReduceBackend::TBB, ReduceBackend::WS}) {
+          // A grain of 1 splits the reduced rows of the column plans
+          for (int64_t grain :
+               {(int64_t)at::internal::GRAIN_SIZE, (int64_t)1}) {
+            int64_t out_size = 1;
+            for (int64_t d = 0; d < 3; d++) {
+              if (std::find(dims.begin(), dims.end(), d) == dims.end()) {
+                out_size *= shape[d];
+              }
+            }
+            std::vector<T> out_ref(out_size, 0);
+            std::vector<T> out_comp(out_size, 0);
+            reducesum_nd_reference(data_, out_ref.data(), shape, stride, dims);
+            reducesum_nd(data_, out_comp.data(), shape, stride, dims, backend,
+                         grain);
+            for (int64_t i = 0; i < out_size; i++) {
+              double ref = out_ref[i];
+              double error = std::abs(ref - (double)out_comp[i]);
+              if (error > 1e-3 * std::abs(ref)) {
+                throw std::runtime_error(
+                    "test_reducesum_nd failed - dtype: " + dtype_name<T>() +
+                    " - shape: " + std::to_string(shape[0]) + "x" +
+                    std::to_string(shape[1]) + "x" + std::to_string(shape[2]) +
+                    " - backend: " + std::to_string((int)backend) +
+                    " - grain: " + std::to_string(grain) +
+                    " - out_ref[" + std::to_string(i) +
+                    "]: " + std::to_string(out_ref[i]) +
+                    " - out_comp: " + std::to_string(out_comp[i]));
+              }
+            }
+          }
+        }
+      }
+    }
+    free_buffer(data_);
+  }
+  init.terminate();
+}
+
+void check_stats(std::string name, const Stats &ref, const Stats &comp) {
+  double sum_error = std::abs((double)ref.sum - comp.sum) / std::abs(ref.sum);
+  double sumsq_error =
+      std::abs((double)ref.sumsq - comp.sumsq) / std::abs(ref.sumsq);
+  if (sum_error > 1e-3 || sumsq_error > 1e-3 || ref.min != comp.min ||
+      ref.max != comp.max || ref.argmax != comp.argmax) {
+    throw std::runtime_error(
+        "test_stats failed - name: " + name +
+        " - sum: " + std::to_string(ref.sum) + " vs " +
+        std::to_string(comp.sum) + " - sumsq: " + std::to_string(ref.sumsq) +
+        " vs " + std::to_string(comp.sumsq) +
+        " - min: " + std::to_string(ref.min) + " vs " +
+        std::to_string(comp.min) + " - max: " + std::to_string(ref.max) +
+        " vs " + std::to_string(comp.max) +
+        " - argmax: " + std::to_string(ref.argmax) + " vs " +
+        std::to_string(comp.argmax));
+  }
+}
+
+// The maximum is planted twice so that argmax has to return the first one
+void test_stats(std::string name, stats_fn statsf) {
+  int64_t size = 367 * 107;
+  float *data_ = NULL;
+  make_data(&data_, size);
+  make_random_vector(data_, size);
+  data_[size / 3] = 100;
+  data_[size / 2] = 100;
+  for (int64_t offset = 0; offset < 1000; offset = (offset + 3) * 13) {
+    Stats ref = stats_identity();
+    Stats comp = stats_identity();
+    stats_naive<STAT_ALL>(ref, data_, offset, size - offset);
+    statsf(comp, data_, offset, size - offset);
+    check_stats(name, ref, comp);
+  }
+  free_buffer(data_);
+}
+
+void test_stats_parallel(std::string name, parallelstats_fn pstatsf) {
+  int64_t size = 367 * 107 * 10;
+  task_scheduler_init init(10);
+  omp_set_num_threads(10);
+  float *data_ = NULL;
+  make_data(&data_, size);
+  make_random_vector(data_, size);
+  data_[size / 3] = 100;
+  data_[size / 2] = 100;
+  for (int64_t offset = 0; offset < 1000; offset = (offset + 3) * 13) {
+    Stats ref = stats_identity();
+    Stats comp = stats_identity();
+    stats_naive<STAT_ALL>(ref, data_, offset, size - offset);
+    pstatsf(comp, data_, offset, size - offset, 128, omp_get_max_threads());
+    check_stats(name, ref, comp);
+  }
+  init.terminate();
+  free_buffer(data_);
+}
+
+template <typename F, typename... Args>
+void test_reducestats_impl(std::string name, size_t outer_size,
+                           size_t inner_size, F reducestatsf, Args... args) {
+  float *data_ = NULL;
+  make_data(&data_, outer_size * inner_size);
+  make_random_vector(data_, outer_size * inner_size);
+  // A repeated maximum in column 5
+  data_[3 * inner_size + 5] = 100;
+  data_[7 * inner_size + 5] = 100;
+  for (int64_t offset = 0; offset < 100; offset = (offset + 3) * 5) {
+    // Skips up to 3 leading rows too, argmax is relative to the first row
+    size_t row = offset % 4;
+    StatsColumnsData ref(inner_size);
+    StatsColumnsData comp(inner_size);
+    reducestats_naive_all(data_, ref.columns(), row, outer_size, offset,
+                          inner_size - offset, inner_size);
+    reducestatsf(data_, comp.columns(), row, outer_size, offset,
+                 inner_size - offset, inner_size, args...);
+    for (size_t j = offset; j < inner_size - offset; j++) {
+      check_stats(name + " - column " + std::to_string(j),
+                  {ref.sum[j], ref.sumsq[j], ref.min[j], ref.max[j],
+                   ref.argmax[j]},
+                  {comp.sum[j], comp.sumsq[j], comp.min[j], comp.max[j],
+                   comp.argmax[j]});
+    }
+  }
+  free_buffer(data_);
+}
+
+void test_reducestats(std::string name, reducestats_fn reducestatsf) {
+  test_reducestats_impl(name, 107, 367, reducestatsf);
+}
+
+void test_reducestats_parallel(std::string name,
+                               parallelreducestats_fn preducestatsf) {
+  task_scheduler_init init(10);
+  omp_set_num_threads(10);
+  test_reducestats_impl(name, 107, 3670, preducestatsf, (size_t)128,
+                        (size_t)omp_get_max_threads());
+  init.terminate();
+}
+
+// The strided tests check every kernel against the naive strided loop for a
+// few strides, including ones that aren't a power of two.
+template <typename T>
+void test_strided_sum(std::string name, stridedsum_fn<T> sumf_comp) {
+  int64_t size = 367 * 107;
+  for (size_t stride : {1, 3, 8}) {
+    T *data_ = NULL;
+    make_data(&data_, size * stride);
+    make_random_vector(data_, size * stride);
+    for (int64_t offset = 0; offset < 1000; offset = (offset + 3) * 13) {
+      T sum_ref = 0;
+      T sum_comp = 0;
+      sum_strided_naive(sum_ref, data_, offset, size - offset, stride);
+      sumf_comp(sum_comp, data_, offset, size - offset, stride);
+      double ratio = std::abs((double)sum_ref - (double)sum_comp) /
+                     std::abs((double)sum_ref);
+      if (ratio > 1e-3) {
+        throw std::runtime_error("test_strided_sum failed - name: " + name +
+                                 " - stride: " + std::to_string(stride) +
+                                 " - sum_ref: " + std::to_string(sum_ref) +
+                                 " - sum_comp: " + std::to_string(sum_comp) +
+                                 " - error: " + std::to_string(ratio));
+      }
+    }
+    free_buffer(data_);
+  }
+}
+
+template <typename T>
+void test_strided_sum_parallel(std::string name,
+                               parallelstridedsum_fn<T> sumf_comp) {
+  int64_t size = 367 * 107 * 10;
+  task_scheduler_init init(10);
+  omp_set_num_threads(10);
+  for (size_t stride : {1, 3, 8}) {
+    T *data_ = NULL;
+    make_data(&data_, size * stride);
+    make_random_vector(data_, size * stride);
+    for (int64_t offset = 0; offset < 1000; offset = (offset + 3) * 13) {
+      T sum_ref = 0;
+      T sum_comp = 0;
+      sum_strided_naive(sum_ref, data_, offset, size - offset, stride);
+      sumf_comp(sum_comp, data_, offset, size - offset, stride, 128,
+                omp_get_max_threads());
+      double ratio = std::abs((double)sum_ref - (double)sum_comp) /
+                     std::abs((double)sum_ref);
       if (ratio > 1e-3) {
-        std::string wrong_out = std::to_string(out_data_[i]);
-        std::string wrong_out_comp = std::to_string(out_data_comp_[i]);
-        std::string s1 = "test_reducesum failed - name: " + name;
-        std::string s2 = " - out_data_[" + std::to_string(i);
-        std::string s3 = "]: " + wrong_out + " - out_data_comp_[";
-        std::string s4 = std::to_string(i) + "]: " + wrong_out_comp;
-        std::string s5 = " - error: " + std::to_string(ratio);
-        throw std::runtime_error(s1 + s2 + s3 + s4 + s5);
+        throw std::runtime_error(
+            "test_strided_sum_parallel failed - name: " + name +
+            " - stride: " + std::to_string(stride) +
+            " - sum_ref: " + std::to_string(sum_ref) +
+            " - sum_comp: " + std::to_string(sum_comp) +
+            " - error: " + std::to_string(ratio));
       }
     }
+    free_buffer(data_);
   }
   init.terminate();
-  free(data_);
-  free(out_data_);
-  free(out_data_comp_);
 }
 
-void test_parallelreducesum(std::string name,
-                            void (*parallelreducef_comp)(const float *, float *,
-                                                         size_t, size_t, size_t,
-                                                         size_t, size_t, size_t,
-                                                         size_t)) {
+template <typename T>
+void check_strided_reducesum(std::string name, const T *out_ref,
+                             const T *out_comp, size_t size2b, size_t size2e,
+                             size_t stride) {
+  for (size_t i = size2b; i < size2e; i++) {
+    double ratio = std::abs((double)out_ref[i] - (double)out_comp[i]) /
+                   std::abs((double)out_ref[i]);
+    if (ratio > 1e-3) {
+      throw std::runtime_error("test_strided_reducesum failed - name: " + name +
+                               " - stride: " + std::to_string(stride) +
+                               " - out_ref[" + std::to_string(i) +
+                               "]: " + std::to_string(out_ref[i]) +
+                               " - out_comp: " + std::to_string(out_comp[i]) +
+                               " - error: " + std::to_string(ratio));
+    }
+  }
+}
+
+template <typename T>
+void test_strided_reducesum(std::string name,
+                            stridedreducesum_fn<T> reducef_comp) {
+  size_t inner_size = 367;
+  size_t outer_size = 107;
+  for (size_t stride : {1, 3, 8}) {
+    T *data_ = NULL;
+    make_data(&data_, outer_size * inner_size * stride);
+    make_random_vector(data_, outer_size * inner_size * stride);
+    std::vector<T> out_ref(inner_size);
+    std::vector<T> out_comp(inner_size);
+    for (int64_t offset = 0; offset < 100; offset = (offset + 3) * 5) {
+      std::fill(out_ref.begin(), out_ref.end(), 0);
+      std::fill(out_comp.begin(), out_comp.end(), 0);
+      reducesum_strided_naive(data_, out_ref.data(), offset,
+                              outer_size - offset, offset, inner_size - offset,
+                              inner_size, stride);
+      reducef_comp(data_, out_comp.data(), offset, outer_size - offset, offset,
+                   inner_size - offset, inner_size, stride);
+      check_strided_reducesum(name, out_ref.data(), out_comp.data(), offset,
+                              inner_size - offset, stride);
+    }
+    free_buffer(data_);
+  }
+}
 
+template <typename T>
+void test_strided_parallelreducesum(
+    std::string name, parallelstridedreducesum_fn<T> parallelreducef_comp) {
   size_t inner_size = 3670;
-  size_t outer_size = 107 * 10;
-  float *data_ = NULL;
-  float *out_data_ = NULL;
-  float *out_data_comp_ = NULL;
-  // It is very important that his happens here!
-  // Otherwise subsequent calls to tbb parallel constructs won't be affected
-  // by the number of threads set if this is called first.
+  size_t outer_size = 107;
   task_scheduler_init init(10);
   omp_set_num_threads(10);
-  make_float_data(&data_, outer_size * inner_size);
-  make_random_vector(data_, outer_size * inner_size);
-  make_float_data(&out_data_, inner_size);
-  make_float_data(&out_data_comp_, inner_size);
-  for (int64_t offset = 0; offset < 1000; offset = (offset + 3) * 13) {
-    reducesum_naive(data_, out_data_, 0, outer_size, offset,
-                    inner_size - offset, inner_size);
-    parallelreducef_comp(data_, out_data_comp_, 0, outer_size, offset,
-                         inner_size - offset, inner_size, 128,
-                         omp_get_max_threads());
-    for (int64_t i = offset; i < inner_size - offset; i++) {
-      float ratio =
-          std::abs(out_data_[i] - out_data_comp_[i]) / std::abs(out_data_[i]);
-      if (ratio > 1e-3) {
-        std::string wrong_out = std::to_string(out_data_[i]);
-        std::string wrong_out_comp = std::to_string(out_data_comp_[i]);
-        std::string s1 = "test_parallelreducesum failed - name: " + name;
-        std::string s2 = " - out_data_[" + std::to_string(i);
-        std::string s3 = "]: " + wrong_out + " - out_data_comp_[";
-        std::string s4 = std::to_string(i) + "]: " + wrong_out_comp;
-        std::string s5 = " - error: " + std::to_string(ratio);
-        throw std::runtime_error(s1 + s2 + s3 + s4 + s5);
-      }
+  for (size_t stride : {1, 3, 8}) {
+    T *data_ = NULL;
+    make_data(&data_, outer_size * inner_size * stride);
+    make_random_vector(data_, outer_size * inner_size * stride);
+    std::vector<T> out_ref(inner_size);
+    std::vector<T> out_comp(inner_size);
+    for (int64_t offset = 0; offset < 1000; offset = (offset + 3) * 13) {
+      std::fill(out_ref.begin(), out_ref.end(), 0);
+      std::fill(out_comp.begin(), out_comp.end(), 0);
+      reducesum_strided_naive(data_, out_ref.data(), 0, outer_size, offset,
+                              inner_size - offset, inner_size, stride);
+      parallelreducef_comp(data_, out_comp.data(), 0, outer_size, offset,
+                           inner_size - offset, inner_size, stride, 128,
+                           omp_get_max_threads());
+      check_strided_reducesum(name, out_ref.data(), out_comp.data(), offset,
+                              inner_size - offset, stride);
     }
+    free_buffer(data_);
   }
   init.terminate();
-  free(data_);
-  free(out_data_);
-  free(out_data_comp_);
 }
 
-int main(int argc, char **argv) {
-  std::map<std::string, void (*)(float &, const float *, size_t, size_t)>
-      sum_funcs;
+// AUTOTUNING
 
-  sum_funcs["sum_naive"] = &sum_naive;
-  sum_funcs["sum_naive_32"] = &sum_naive_32;
-  sum_funcs["sum_simple"] = &sum_simple;
-  sum_funcs["sum_simple_128"] = &sum_simple_128;
-  sum_funcs["sum_simple_128_aligned"] = &sum_simple_128_aligned;
-  sum_funcs["sum_simple_256"] = &sum_simple_256;
+// With AVX_SUM_AUTOTUNE=1 the binary searches threshold and thread count of
+// every parallel sum and reducesum kernel per size and shape, writes the
+// winners to the table at AVX_SUM_TUNE_TABLE (avx_sum_tune.txt by default) and
+// exits. Otherwise an existing table is loaded at startup. The *_tuned
+// benchmarks then run every tuned kernel with its own threshold and thread
+// count. The kernels themselves never read the table, so the untuned sweep
+// keeps the configuration it registered. The table lives in tune_table.h.
 
-  for (auto &kv : sum_funcs) {
-    std::cerr << "Testing: " << kv.first << std::endl;
+// Nanoseconds per call, best of three batches of at least a millisecond
+double time_call(const std::function<void()> &call) {
+  call();
+  double best = std::numeric_limits<double>::max();
+  for (int trial = 0; trial < 3; trial++) {
+    int64_t calls = 0;
+    double elapsed = 0;
+    tbb::tick_count start = tbb::tick_count::now();
+    while (elapsed < 1e6) {
+      call();
+      calls++;
+      elapsed = (tbb::tick_count::now() - start).seconds() * 1e9;
+    }
+    best = std::min(best, elapsed / calls);
+  }
+  return best;
+}
+
+// Thread counts to try, powers of two up to the hardware concurrency
+std::vector<int64_t> tune_num_threads() {
+  int64_t max_nt = std::max<int64_t>(std::thread::hardware_concurrency(), 1);
+  std::vector<int64_t> num_threads;
+  for (int64_t nt = 1; nt < max_nt; nt *= 2) {
+    num_threads.push_back(nt);
+  }
+  num_threads.push_back(max_nt);
+  return num_threads;
+}
+
+// Hill climb over the log2 grids of threshold (1K to 1M) and thread count.
+// Starts from the middle threshold on all threads and moves to the fastest
+// neighbour until none is faster by more than 2%, so it usually measures a
+// small fraction of the grid.
+ParallelConfig
+tune_parallel_config(const std::function<double(int64_t, int64_t)> &measure,
+                     int64_t &evaluations) {
+  std::vector<int64_t> thresholds;
+  for (int64_t th = 1 << 10; th <= (1 << 20); th *= 2) {
+    thresholds.push_back(th);
+  }
+  std::vector<int64_t> num_threads = tune_num_threads();
+  std::map<std::pair<int64_t, int64_t>, double> seen;
+  auto evaluate = [&](int64_t ti, int64_t ni) {
+    auto key = std::make_pair(ti, ni);
+    if (seen.count(key) == 0) {
+      seen[key] = measure(thresholds[ti], num_threads[ni]);
+    }
+    return seen[key];
+  };
+  int64_t ti = thresholds.size() / 2;
+  int64_t ni = num_threads.size() - 1;
+  double best = evaluate(ti, ni);
+  while (true) {
+    int64_t next_ti = ti;
+    int64_t next_ni = ni;
+    double next = best;
+    for (auto step : {std::make_pair(-1, 0), std::make_pair(1, 0),
+                      std::make_pair(0, -1), std::make_pair(0, 1)}) {
+      int64_t t = ti + step.first;
+      int64_t n = ni + step.second;
+      if (t < 0 || t >= (int64_t)thresholds.size() || n < 0 ||
+          n >= (int64_t)num_threads.size()) {
+        continue;
+      }
+      double ns = evaluate(t, n);
+      if (ns < next) {
+        next = ns;
+        next_ti = t;
+        next_ni = n;
+      }
+    }
+    if (next > 0.98 * best) {
+      break;
+    }
+    ti = next_ti;
+    ni = next_ni;
+    best = next;
+  }
+  evaluations = seen.size();
+  return {thresholds[ti], num_threads[ni], best};
+}
+
+template <typename T>
+static void BM_PARALLEL_SUM_TUNED(benchmark::State &state, int64_t size,
+                                  int64_t iter, std::string name,
+                                  parallelsum_fn<T> psumf) {
+  // Only registered for tuned kernels
+  ParallelConfig config;
+  if (!tuned_parallel_config(name, dtype_name<T>(), 1, size, config)) {
+    state.SkipWithError("kernel not in the tune table");
+    return;
+  }
+  BM_PARALLEL_SUM<T>(state, size, iter, config.threshold, config.num_thread,
+                     parallel_backend(name), psumf);
+  state.counters["tuned"] = 1;
+}
+
+template <typename T>
+static void BM_PARALLEL_REDUCESUM_TUNED(benchmark::State &state,
+                                        int64_t size_outer, int64_t size_inner,
+                                        int64_t iter, std::string name,
+                                        parallelreducesum_fn<T> preducesumf) {
+  ParallelConfig config;
+  if (!tuned_parallel_config(name, dtype_name<T>(), size_outer, size_inner,
+                             config)) {
+    state.SkipWithError("kernel not in the tune table");
+    return;
+  }
+  BM_PARALLEL_REDUCESUM<T>(state, size_outer, size_inner, iter,
+                           config.threshold, config.num_thread,
+                           parallel_backend(name), parallel_split(name),
+                           preducesumf);
+  state.counters["tuned"] = 1;
+}
+
+// REGISTRATION
+
+template <typename T> struct Registry {
+  std::map<std::string, sum_fn<T>> sum_funcs;
+  std::map<std::string, parallelsum_fn<T>> parallelsum_funcs;
+  std::map<std::string, reducesum_fn<T>> reducesum_funcs;
+  std::map<std::string, parallelreducesum_fn<T>> parallelreducesum_funcs;
+  std::vector<SumConfig<T>> sum_configs;
+  std::vector<PrefetchConfig<sum_fn<T>>> sum_prefetch_configs;
+  std::vector<PrefetchConfig<reducesum_fn<T>>> reducesum_prefetch_configs;
+  std::map<std::string, reducesum_fn<T>> rowwisereducesum_funcs;
+  std::map<std::string, parallelreducesum_fn<T>> parallelrowwisereducesum_funcs;
+  std::map<std::string, stats_fn> stats_funcs;
+  std::map<std::string, parallelstats_fn> parallelstats_funcs;
+  std::map<std::string, reducestats_fn> reducestats_funcs;
+  std::map<std::string, parallelreducestats_fn> parallelreducestats_funcs;
+  std::map<std::string, stridedsum_fn<T>> stridedsum_funcs;
+  std::map<std::string, parallelstridedsum_fn<T>> parallelstridedsum_funcs;
+  std::map<std::string, stridedreducesum_fn<T>> stridedreducesum_funcs;
+  std::map<std::string, parallelstridedreducesum_fn<T>>
+      parallelstridedreducesum_funcs;
+};
+
+// Kernels that are available for every dtype
+template <typename T> Registry<T> make_registry() {
+  Registry<T> r;
+
+  r.sum_funcs["sum_naive"] = &sum_naive<T>;
+  r.sum_funcs["sum_naive_32"] = &sum_naive_32<T>;
+  r.sum_funcs["sum_simple"] = &sum_simple<T>;
+  r.sum_funcs["sum_simple_128"] = &sum_simple_128<T>;
+  r.sum_funcs["sum_simple_128_aligned"] = &sum_simple_128_aligned<T>;
+  r.sum_funcs["sum_simple_256"] = &sum_simple_256<T>;
+  r.sum_funcs["sum_deterministic_128"] =
+      &sum_deterministic_128<T, sum_simple_128<T>>;
+  r.sum_configs = make_sum_configs<T>();
+  r.sum_prefetch_configs = make_sum_prefetch_configs<T>();
+  r.reducesum_prefetch_configs = make_reducesum_prefetch_configs<T>();
+
+  r.parallelsum_funcs["sum_omp_naive_simd"] = &sum_omp_naive_simd<T>;
+  r.parallelsum_funcs["sum_omp_naive"] = &sum_omp_naive<T>;
+  r.parallelsum_funcs["sum_omp_simple_128"] =
+      &sum_omp_simple_128<T, sum_simple_128<T>>;
+  r.parallelsum_funcs["sum_omp_reduce_128"] =
+      &sum_omp_reduce_128<T, sum_simple_128<T>>;
+  r.parallelsum_funcs["sum_tbb_simp"] = &sum_tbb_simp<T, sum_simple_128<T>>;
+  r.parallelsum_funcs["sum_tbb_ap"] = &sum_tbb_ap<T, sum_simple_128<T>>;
+  r.parallelsum_funcs["sum_ws_simple_128"] =
+      &sum_ws_simple_128<T, sum_simple_128<T>>;
+  r.parallelsum_funcs["sum_aten_simple_128"] =
+      &sum_aten_simple_128<T, sum_simple_128<T>, false>;
+  r.parallelsum_funcs["sum_aten_simple_128_grain"] =
+      &sum_aten_simple_128<T, sum_simple_128<T>, true>;
+  r.parallelsum_funcs["sum_std_reduce_par"] = &sum_std_reduce<T, false>;
+  r.parallelsum_funcs["sum_std_reduce_par_unseq"] = &sum_std_reduce<T, true>;
+  r.parallelsum_funcs["sum_std_transform_reduce_128"] =
+      &sum_std_transform_reduce_128<T, sum_simple_128<T>>;
+  r.parallelsum_funcs["sum_tbb_ap_arena"] =
+      &sum_tbb_ap_arena<T, sum_simple_128<T>>;
+  r.parallelsum_funcs["sum_omp_deterministic_128"] =
+      &sum_omp_deterministic_128<T, sum_simple_128<T>>;
+  r.parallelsum_funcs["sum_tbb_deterministic_128"] =
+      &sum_tbb_deterministic_128<T, sum_simple_128<T>>;
+  r.parallelsum_funcs["sum_tbb_default"] =
+      &sum_tbb_default<T, sum_simple_128<T>>;
+
+  r.reducesum_funcs["reducesum_naive"] = &reducesum_naive<T>;
+  r.reducesum_funcs["reducesum_simple"] = &reducesum_simple<T>;
+  r.reducesum_funcs["reducesum_simple_128"] = &reducesum_simple_128<T>;
+
+  r.parallelreducesum_funcs["reducesum_omp_simple_128"] =
+      &reducesum_omp_simple_128<T, reducesum_simple_128<T>>;
+  r.parallelreducesum_funcs["reducesum_tbb_simple_128"] =
+      &reducesum_tbb_simple_128<T, reducesum_simple_128<T>>;
+  r.parallelreducesum_funcs["reducesum_tbb_simple_128_arena"] =
+      &reducesum_tbb_simple_128_arena<T, reducesum_simple_128<T>>;
+  r.parallelreducesum_funcs["reducesum_ws_simple_128"] =
+      &reducesum_ws_simple_128<T, reducesum_simple_128<T>>;
+  r.parallelreducesum_funcs["reducesum_aten_simple_128"] =
+      &reducesum_aten_simple_128<T, reducesum_simple_128<T>, false>;
+  r.parallelreducesum_funcs["reducesum_aten_simple_128_grain"] =
+      &reducesum_aten_simple_128<T, reducesum_simple_128<T>, true>;
+  r.parallelreducesum_funcs["reducesum_std_simple_128"] =
+      &reducesum_std_simple_128<T, reducesum_simple_128<T>, false>;
+  r.parallelreducesum_funcs["reducesum_std_simple_128_unseq"] =
+      &reducesum_std_simple_128<T, reducesum_simple_128<T>, true>;
+  r.parallelreducesum_funcs["reducesum_omp_outer_128"] =
+      &reducesum_omp_outer_128<T, reducesum_simple_128<T>>;
+  r.parallelreducesum_funcs["reducesum_tbb_outer_128"] =
+      &reducesum_tbb_outer_128<T, reducesum_simple_128<T>>;
+  r.parallelreducesum_funcs["reducesum_omp_split_128"] =
+      &reducesum_omp_split_128<T, reducesum_simple_128<T>>;
+  r.parallelreducesum_funcs["reducesum_tbb_split_128"] =
+      &reducesum_tbb_split_128<T, reducesum_simple_128<T>>;
+
+  r.rowwisereducesum_funcs["reducesum_rowwise_naive"] =
+      &reducesum_rowwise_naive<T>;
+  r.rowwisereducesum_funcs["reducesum_rowwise_simple"] =
+      &reducesum_rowwise_simple<T>;
+  r.rowwisereducesum_funcs["reducesum_rowwise_interleaved_4"] =
+      &reducesum_rowwise_interleaved_4<T>;
+  r.rowwisereducesum_funcs["reducesum_rowwise_interleaved_8"] =
+      &reducesum_rowwise_interleaved_8<T>;
+
+  r.parallelrowwisereducesum_funcs["reducesum_rowwise_omp_simple"] =
+      &reducesum_rowwise_omp<T, reducesum_rowwise_simple<T>>;
+  r.parallelrowwisereducesum_funcs["reducesum_rowwise_omp_interleaved_8"] =
+      &reducesum_rowwise_omp<T, reducesum_rowwise_interleaved_8<T>>;
+  r.parallelrowwisereducesum_funcs["reducesum_rowwise_tbb_simple"] =
+      &reducesum_rowwise_tbb<T, reducesum_rowwise_simple<T>>;
+  r.parallelrowwisereducesum_funcs["reducesum_rowwise_tbb_interleaved_8"] =
+      &reducesum_rowwise_tbb<T, reducesum_rowwise_interleaved_8<T>>;
+
+  r.reducesum_funcs["reducesum_nd"] =
+      &reducesum_nd_columns<T, ReduceBackend::SERIAL>;
+  r.parallelreducesum_funcs["reducesum_nd_omp"] =
+      &reducesum_nd_columns_parallel<T, ReduceBackend::OMP>;
+  r.parallelreducesum_funcs["reducesum_nd_tbb"] =
+      &reducesum_nd_columns_parallel<T, ReduceBackend::TBB>;
+  r.rowwisereducesum_funcs["reducesum_rowwise_nd"] =
+      &reducesum_nd_rows<T, ReduceBackend::SERIAL>;
+  r.parallelrowwisereducesum_funcs["reducesum_rowwise_nd_omp"] =
+      &reducesum_nd_rows_parallel<T, ReduceBackend::OMP>;
+  r.parallelrowwisereducesum_funcs["reducesum_rowwise_nd_tbb"] =
+      &reducesum_nd_rows_parallel<T, ReduceBackend::TBB>;
+  return r;
+}
+
+// ISA tiers are only written for float
+void add_isa_funcs(Registry<float> &r) {
+  r.sum_funcs["sum_simple_sse42"] = &sum_simple_sse42;
+  r.sum_funcs["sum_simple_128_sse42"] = &sum_simple_128_sse42;
+  r.sum_funcs["sum_simple_256_sse42"] = &sum_simple_256_sse42;
+  r.sum_funcs["sum_simple_dispatch"] = &sum_simple_dispatch;
+  r.sum_funcs["sum_simple_128_dispatch"] = &sum_simple_128_dispatch;
+  r.sum_funcs["sum_simple_256_dispatch"] = &sum_simple_256_dispatch;
+  if (supported_cpu_capability() >= CPUCapability::AVX512) {
+    r.sum_funcs["sum_simple_avx512"] = &sum_simple_avx512;
+    r.sum_funcs["sum_simple_128_avx512"] = &sum_simple_128_avx512;
+    r.sum_funcs["sum_simple_256_avx512"] = &sum_simple_256_avx512;
+  }
+
+  r.parallelsum_funcs["sum_omp_simple_128_sse42"] =
+      &sum_omp_simple_128<float, sum_simple_128_sse42>;
+  r.parallelsum_funcs["sum_omp_reduce_128_sse42"] =
+      &sum_omp_reduce_128<float, sum_simple_128_sse42>;
+  r.parallelsum_funcs["sum_tbb_simp_sse42"] =
+      &sum_tbb_simp<float, sum_simple_128_sse42>;
+  r.parallelsum_funcs["sum_tbb_ap_sse42"] =
+      &sum_tbb_ap<float, sum_simple_128_sse42>;
+  r.parallelsum_funcs["sum_tbb_ap_arena_sse42"] =
+      &sum_tbb_ap_arena<float, sum_simple_128_sse42>;
+  r.parallelsum_funcs["sum_tbb_default_sse42"] =
+      &sum_tbb_default<float, sum_simple_128_sse42>;
+  r.parallelsum_funcs["sum_ws_simple_128_sse42"] =
+      &sum_ws_simple_128<float, sum_simple_128_sse42>;
+  if (supported_cpu_capability() >= CPUCapability::AVX512) {
+    r.parallelsum_funcs["sum_omp_simple_128_avx512"] =
+        &sum_omp_simple_128<float, sum_simple_128_avx512>;
+    r.parallelsum_funcs["sum_omp_reduce_128_avx512"] =
+        &sum_omp_reduce_128<float, sum_simple_128_avx512>;
+    r.parallelsum_funcs["sum_tbb_simp_avx512"] =
+        &sum_tbb_simp<float, sum_simple_128_avx512>;
+    r.parallelsum_funcs["sum_tbb_ap_avx512"] =
+        &sum_tbb_ap<float, sum_simple_128_avx512>;
+    r.parallelsum_funcs["sum_tbb_ap_arena_avx512"] =
+        &sum_tbb_ap_arena<float, sum_simple_128_avx512>;
+    r.parallelsum_funcs["sum_tbb_default_avx512"] =
+        &sum_tbb_default<float, sum_simple_128_avx512>;
+    r.parallelsum_funcs["sum_ws_simple_128_avx512"] =
+        &sum_ws_simple_128<float, sum_simple_128_avx512>;
+  }
+
+  r.reducesum_funcs["reducesum_simple_sse42"] = &reducesum_simple_sse42;
+  r.reducesum_funcs["reducesum_simple_128_sse42"] = &reducesum_simple_128_sse42;
+  r.reducesum_funcs["reducesum_simple_dispatch"] = &reducesum_simple_dispatch;
+  r.reducesum_funcs["reducesum_simple_128_dispatch"] =
+      &reducesum_simple_128_dispatch;
+  if (supported_cpu_capability() >= CPUCapability::AVX512) {
+    r.reducesum_funcs["reducesum_simple_avx512"] = &reducesum_simple_avx512;
+    r.reducesum_funcs["reducesum_simple_128_avx512"] =
+        &reducesum_simple_128_avx512;
+  }
+
+  r.parallelreducesum_funcs["reducesum_omp_simple_128_sse42"] =
+      &reducesum_omp_simple_128<float, reducesum_simple_128_sse42>;
+  r.parallelreducesum_funcs["reducesum_tbb_simple_128_sse42"] =
+      &reducesum_tbb_simple_128<float, reducesum_simple_128_sse42>;
+  r.parallelreducesum_funcs["reducesum_tbb_simple_128_arena_sse42"] =
+      &reducesum_tbb_simple_128_arena<float, reducesum_simple_128_sse42>;
+  r.parallelreducesum_funcs["reducesum_ws_simple_128_sse42"] =
+      &reducesum_ws_simple_128<float, reducesum_simple_128_sse42>;
+  if (supported_cpu_capability() >= CPUCapability::AVX512) {
+    r.parallelreducesum_funcs["reducesum_omp_simple_128_avx512"] =
+        &reducesum_omp_simple_128<float, reducesum_simple_128_avx512>;
+    r.parallelreducesum_funcs["reducesum_tbb_simple_128_avx512"] =
+        &reducesum_tbb_simple_128<float, reducesum_simple_128_avx512>;
+    r.parallelreducesum_funcs["reducesum_tbb_simple_128_arena_avx512"] =
+        &reducesum_tbb_simple_128_arena<float, reducesum_simple_128_avx512>;
+    r.parallelreducesum_funcs["reducesum_ws_simple_128_avx512"] =
+        &reducesum_ws_simple_128<float, reducesum_simple_128_avx512>;
+  }
+}
+
+// Fused statistics are only written for float
+void add_stats_funcs(Registry<float> &r) {
+  r.stats_funcs["stats_naive"] = &stats_naive_all;
+  r.stats_funcs["stats_fused_64"] = &stats_fused_64;
+  r.stats_funcs["stats_separate_64"] = &stats_separate_64;
+
+  r.parallelstats_funcs["stats_omp_fused_64"] = &stats_omp<stats_fused_64>;
+  r.parallelstats_funcs["stats_omp_separate_64"] =
+      &stats_omp<stats_separate_64>;
+  r.parallelstats_funcs["stats_tbb_fused_64"] = &stats_tbb<stats_fused_64>;
+  r.parallelstats_funcs["stats_tbb_separate_64"] =
+      &stats_tbb<stats_separate_64>;
+
+  r.reducestats_funcs["reducestats_naive"] = &reducestats_naive_all;
+  r.reducestats_funcs["reducestats_fused_64"] = &reducestats_fused_64;
+  r.reducestats_funcs["reducestats_separate_64"] = &reducestats_separate_64;
+
+  r.parallelreducestats_funcs["reducestats_omp_fused_64"] =
+      &reducestats_omp<reducestats_fused_64>;
+  r.parallelreducestats_funcs["reducestats_omp_separate_64"] =
+      &reducestats_omp<reducestats_separate_64>;
+  r.parallelreducestats_funcs["reducestats_tbb_fused_64"] =
+      &reducestats_tbb<reducestats_fused_64>;
+  r.parallelreducestats_funcs["reducestats_tbb_separate_64"] =
+      &reducestats_tbb<reducestats_separate_64>;
+}
+
+// Gathers are only written for float
+void add_strided_funcs(Registry<float> &r) {
+  r.stridedsum_funcs["sum_strided_naive"] = &sum_strided_naive<float>;
+  r.stridedsum_funcs["sum_strided_scalar"] = &sum_strided_scalar;
+  r.stridedsum_funcs["sum_strided_gather"] = &sum_strided_gather;
+  r.stridedsum_funcs["sum_strided_pack"] = &sum_strided_pack;
+
+  r.parallelstridedsum_funcs["sum_omp_strided_scalar"] =
+      &sum_omp_strided<float, sum_strided_scalar>;
+  r.parallelstridedsum_funcs["sum_omp_strided_gather"] =
+      &sum_omp_strided<float, sum_strided_gather>;
+  r.parallelstridedsum_funcs["sum_omp_strided_pack"] =
+      &sum_omp_strided<float, sum_strided_pack>;
+  r.parallelstridedsum_funcs["sum_tbb_strided_scalar"] =
+      &sum_tbb_strided<float, sum_strided_scalar>;
+  r.parallelstridedsum_funcs["sum_tbb_strided_gather"] =
+      &sum_tbb_strided<float, sum_strided_gather>;
+  r.parallelstridedsum_funcs["sum_tbb_strided_pack"] =
+      &sum_tbb_strided<float, sum_strided_pack>;
+
+  r.stridedreducesum_funcs["reducesum_strided_naive"] =
+      &reducesum_strided_naive<float>;
+  r.stridedreducesum_funcs["reducesum_strided_gather"] =
+      &reducesum_strided_gather;
+  r.stridedreducesum_funcs["reducesum_strided_pack"] = &reducesum_strided_pack;
+
+  r.parallelstridedreducesum_funcs["reducesum_omp_strided_naive"] =
+      &reducesum_omp_strided<float, reducesum_strided_naive<float>>;
+  r.parallelstridedreducesum_funcs["reducesum_omp_strided_gather"] =
+      &reducesum_omp_strided<float, reducesum_strided_gather>;
+  r.parallelstridedreducesum_funcs["reducesum_omp_strided_pack"] =
+      &reducesum_omp_strided<float, reducesum_strided_pack>;
+  r.parallelstridedreducesum_funcs["reducesum_tbb_strided_naive"] =
+      &reducesum_tbb_strided<float, reducesum_strided_naive<float>>;
+  r.parallelstridedreducesum_funcs["reducesum_tbb_strided_gather"] =
+      &reducesum_tbb_strided<float, reducesum_strided_gather>;
+  r.parallelstridedreducesum_funcs["reducesum_tbb_strided_pack"] =
+      &reducesum_tbb_strided<float, reducesum_strided_pack>;
+}
+
+template <typename T> void test_registry(const Registry<T> &r) {
+  for (auto &kv : r.sum_funcs) {
+    std::cerr << "Testing: " << kv.first << "<" << dtype_name<T>() << ">"
+              << std::endl;
     test_sum(kv.first, kv.second);
   }
+  for (auto &config : r.sum_configs) {
+    std::cerr << "Testing: " << config.name << "<" << dtype_name<T>() << ">"
+              << std::endl;
+    test_sum(config.name, config.sumf);
+  }
+  for (auto &config : r.sum_prefetch_configs) {
+    std::cerr << "Testing: " << config.name << "<" << dtype_name<T>() << ">"
+              << std::endl;
+    test_sum(config.name, config.fn);
+  }
+  for (auto &config : r.reducesum_prefetch_configs) {
+    std::cerr << "Testing: " << config.name << "<" << dtype_name<T>() << ">"
+              << std::endl;
+    test_reducesum(config.name, config.fn);
+  }
+  for (auto &kv : r.parallelsum_funcs) {
+    std::cerr << "Testing: " << kv.first << "<" << dtype_name<T>() << ">"
+              << std::endl;
+    test_sum_parallel(kv.first, kv.second);
+    if (kv.first.find("deterministic") != std::string::npos) {
+      test_sum_deterministic(kv.first, kv.second);
+    }
+  }
+  for (auto &kv : r.reducesum_funcs) {
+    std::cerr << "Testing: " << kv.first << "<" << dtype_name<T>() << ">"
+              << std::endl;
+    test_reducesum(kv.first, kv.second);
+  }
+  for (auto &kv : r.parallelreducesum_funcs) {
+    std::cerr << "Testing: " << kv.first << "<" << dtype_name<T>() << ">"
+              << std::endl;
+    test_parallelreducesum(kv.first, kv.second);
+  }
+  for (auto &kv : r.rowwisereducesum_funcs) {
+    std::cerr << "Testing: " << kv.first << "<" << dtype_name<T>() << ">"
+              << std::endl;
+    test_rowwise_reducesum(kv.first, kv.second);
+  }
+  for (auto &kv : r.parallelrowwisereducesum_funcs) {
+    std::cerr << "Testing: " << kv.first << "<" << dtype_name<T>() << ">"
+              << std::endl;
+    test_rowwise_parallelreducesum(kv.first, kv.second);
+  }
+  std::cerr << "Testing: reducesum_nd (3-d)<" << dtype_name<T>() << ">"
+            << std::endl;
+  test_reducesum_nd<T>();
+  for (auto &kv : r.stats_funcs) {
+    std::cerr << "Testing: " << kv.first << std::endl;
+    test_stats(kv.first, kv.second);
+  }
+  for (auto &kv : r.parallelstats_funcs) {
+    std::cerr << "Testing: " << kv.first << std::endl;
+    test_stats_parallel(kv.first, kv.second);
+  }
+  for (auto &kv : r.reducestats_funcs) {
+    std::cerr << "Testing: " << kv.first << std::endl;
+    test_reducestats(kv.first, kv.second);
+  }
+  for (auto &kv : r.parallelreducestats_funcs) {
+    std::cerr << "Testing: " << kv.first << std::endl;
+    test_reducestats_parallel(kv.first, kv.second);
+  }
+  for (auto &kv : r.stridedsum_funcs) {
+    std::cerr << "Testing: " << kv.first << "<" << dtype_name<T>() << ">"
+              << std::endl;
+    test_strided_sum(kv.first, kv.second);
+  }
+  for (auto &kv : r.parallelstridedsum_funcs) {
+    std::cerr << "Testing: " << kv.first << "<" << dtype_name<T>() << ">"
+              << std::endl;
+    test_strided_sum_parallel(kv.first, kv.second);
+  }
+  for (auto &kv : r.stridedreducesum_funcs) {
+    std::cerr << "Testing: " << kv.first << "<" << dtype_name<T>() << ">"
+              << std::endl;
+    test_strided_reducesum(kv.first, kv.second);
+  }
+  for (auto &kv : r.parallelstridedreducesum_funcs) {
+    std::cerr << "Testing: " << kv.first << "<" << dtype_name<T>() << ">"
+              << std::endl;
+    test_strided_parallelreducesum(kv.first, kv.second);
+  }
+}
 
-  std::map<std::string,
-           void (*)(float &, const float *, size_t, size_t, size_t, size_t)>
-      parallelsum_funcs;
+// Compensated and pairwise kernels are tested against a double reference
+// before they join the registry.
+void add_accurate_funcs(Registry<float> &r) {
+  std::map<std::string, sum_fn<float>> accurate_sum_funcs;
 
-  parallelsum_funcs["sum_omp_naive_simd"] = &sum_omp_naive_simd;
-  parallelsum_funcs["sum_omp_naive"] = &sum_omp_naive;
-  parallelsum_funcs["sum_omp_simple_128"] = &sum_omp_simple_128;
-  parallelsum_funcs["sum_omp_reduce_128"] = &sum_omp_reduce_128;
-  parallelsum_funcs["sum_tbb_simp"] = &sum_tbb_simp;
-  parallelsum_funcs["sum_tbb_ap"] = &sum_tbb_ap;
-  parallelsum_funcs["sum_tbb_ap_arena"] = &sum_tbb_ap_arena;
-  parallelsum_funcs["sum_tbb_default"] = &sum_tbb_default;
+  accurate_sum_funcs["sum_kahan_128"] = &sum_kahan_128;
+  accurate_sum_funcs["sum_neumaier_128"] = &sum_neumaier_128;
+  accurate_sum_funcs["sum_pairwise_128"] = &sum_pairwise_128;
 
-  for (auto &kv : parallelsum_funcs) {
+  for (auto &kv : accurate_sum_funcs) {
     std::cerr << "Testing: " << kv.first << std::endl;
-    test_sum_parallel(kv.first, kv.second);
+    test_sum(kv.first, kv.second, true);
+    r.sum_funcs.insert(kv);
   }
 
-  std::map<std::string, void (*)(const float *, float *, size_t, size_t, size_t,
-                                 size_t, size_t)>
-      reducesum_funcs;
+  std::map<std::string, parallelsum_fn<float>> accurate_parallelsum_funcs;
 
-  reducesum_funcs["reducesum_naive"] = &reducesum_naive;
-  reducesum_funcs["reducesum_simple"] = &reducesum_simple;
-  reducesum_funcs["reducesum_simple_128"] = &reducesum_simple_128;
+  accurate_parallelsum_funcs["sum_omp_kahan_128"] =
+      &sum_omp_accurate_128<sum_kahan_128>;
+  accurate_parallelsum_funcs["sum_omp_neumaier_128"] =
+      &sum_omp_accurate_128<sum_neumaier_128>;
+  accurate_parallelsum_funcs["sum_omp_pairwise_128"] =
+      &sum_omp_accurate_128<sum_pairwise_128>;
+  accurate_parallelsum_funcs["sum_tbb_kahan_128"] =
+      &sum_tbb_accurate_128<sum_kahan_128>;
+  accurate_parallelsum_funcs["sum_tbb_neumaier_128"] =
+      &sum_tbb_accurate_128<sum_neumaier_128>;
+  accurate_parallelsum_funcs["sum_tbb_pairwise_128"] =
+      &sum_tbb_accurate_128<sum_pairwise_128>;
 
-  for (auto &kv : reducesum_funcs) {
+  for (auto &kv : accurate_parallelsum_funcs) {
     std::cerr << "Testing: " << kv.first << std::endl;
-    test_reducesum(kv.first, kv.second);
+    test_sum_parallel(kv.first, kv.second, true);
+    r.parallelsum_funcs.insert(kv);
   }
 
-  std::map<std::string, void (*)(const float *, float *, size_t, size_t, size_t,
-                                 size_t, size_t, size_t, size_t)>
-      parallelreducesum_funcs;
+  std::map<std::string, reducesum_fn<float>> accurate_reducesum_funcs;
 
-  parallelreducesum_funcs["reducesum_omp_simple_128"] =
-      &reducesum_omp_simple_128;
-  parallelreducesum_funcs["reducesum_tbb_simple_128"] =
-      &reducesum_tbb_simple_128;
-  parallelreducesum_funcs["reducesum_tbb_simple_128_arena"] =
-      &reducesum_tbb_simple_128_arena;
+  accurate_reducesum_funcs["reducesum_kahan_128"] = &reducesum_kahan_128;
+  accurate_reducesum_funcs["reducesum_neumaier_128"] = &reducesum_neumaier_128;
+  accurate_reducesum_funcs["reducesum_pairwise_128"] = &reducesum_pairwise_128;
 
-  for (auto &kv : parallelreducesum_funcs) {
+  for (auto &kv : accurate_reducesum_funcs) {
     std::cerr << "Testing: " << kv.first << std::endl;
-    test_parallelreducesum(kv.first, kv.second);
+    test_reducesum(kv.first, kv.second, true);
+    r.reducesum_funcs.insert(kv);
+  }
+
+  std::map<std::string, parallelreducesum_fn<float>>
+      accurate_parallelreducesum_funcs;
+
+  accurate_parallelreducesum_funcs["reducesum_omp_kahan_128"] =
+      &reducesum_omp_simple_128<float, reducesum_kahan_128>;
+  accurate_parallelreducesum_funcs["reducesum_omp_neumaier_128"] =
+      &reducesum_omp_simple_128<float, reducesum_neumaier_128>;
+  accurate_parallelreducesum_funcs["reducesum_omp_pairwise_128"] =
+      &reducesum_omp_simple_128<float, reducesum_pairwise_128>;
+  accurate_parallelreducesum_funcs["reducesum_tbb_kahan_128"] =
+      &reducesum_tbb_simple_128<float, reducesum_kahan_128>;
+  accurate_parallelreducesum_funcs["reducesum_tbb_neumaier_128"] =
+      &reducesum_tbb_simple_128<float, reducesum_neumaier_128>;
+  accurate_parallelreducesum_funcs["reducesum_tbb_pairwise_128"] =
+      &reducesum_tbb_simple_128<float, reducesum_pairwise_128>;
+
+  for (auto &kv : accurate_parallelreducesum_funcs) {
+    std::cerr << "Testing: " << kv.first << std::endl;
+    test_parallelreducesum(kv.first, kv.second, true);
+    r.parallelreducesum_funcs.insert(kv);
+  }
+}
+
+// Kernels whose chunking doesn't follow threshold, ATen's GRAIN_SIZE or the
+// standard library's own. A tuned threshold would mean nothing for them, and
+// the sweep runs them once with a threshold of -1.
+bool ignores_threshold(const std::string &name) {
+  return name.find("_grain") != std::string::npos ||
+         name.find("sum_std_reduce") != std::string::npos;
+}
+
+// Tunes every parallel sum and reducesum kernel that follows threshold on a
+// coarse version of the benchmark sizes and shapes
+template <typename T>
+void tune_registry(const Registry<T> &r, TuneTable &table) {
+  int64_t min_s = (8 << 12) / 2;
+  int64_t max_s = (8 << 25) * sizeof(float) / sizeof(T);
+  int64_t grid = 11 * tune_num_threads().size();
+  std::string dtype = dtype_name<T>();
+
+  auto report = [&](const std::string &name, int64_t so, int64_t si,
+                    const ParallelConfig &config, int64_t evaluations) {
+    std::cerr << "Tuned: " << name << "<" << dtype << "> " << so << "x" << si
+              << " - threshold: " << config.threshold
+              << " - num_thread: " << config.num_thread << " - "
+              << evaluations << " of " << grid << " configurations"
+              << std::endl;
+  };
+
+  for (int64_t s = min_s; s < max_s; s *= 16) {
+    T *data_ = NULL;
+    make_data(&data_, s);
+    make_vector(data_, s);
+    for (auto &kv : r.parallelsum_funcs) {
+      if (ignores_threshold(kv.first)) {
+        continue;
+      }
+      int64_t evaluations;
+      ParallelConfig config = tune_parallel_config(
+          [&](int64_t threshold, int64_t num_thread) {
+            task_scheduler_init init(num_thread);
+            omp_set_num_threads(num_thread);
+            T sum = 0;
+            double ns = time_call(
+                [&] { kv.second(sum, data_, 0, s, threshold, num_thread); });
+            benchmark::DoNotOptimize(sum);
+            init.terminate();
+            return ns;
+          },
+          evaluations);
+      table.insert({kv.first, dtype, size_bucket(1), size_bucket(s)}, config);
+      report(kv.first, 1, s, config, evaluations);
+    }
+    free_buffer(data_);
+  }
+
+  for (int64_t k = 4; k < max_s / 8; k = k * 16) {
+    int64_t so = max_s / k / 16;
+    int64_t si = k;
+    T *data_ = NULL;
+    make_data(&data_, so * si);
+    make_vector(data_, so * si);
+    T *out_data_ = NULL;
+    make_data(&out_data_, si);
+    for (auto &kv : r.parallelreducesum_funcs) {
+      if (ignores_threshold(kv.first)) {
+        continue;
+      }
+      int64_t evaluations;
+      ParallelConfig config = tune_parallel_config(
+          [&](int64_t threshold, int64_t num_thread) {
+            task_scheduler_init init(num_thread);
+            omp_set_num_threads(num_thread);
+            double ns = time_call([&] {
+              kv.second(data_, out_data_, 0, so, 0, si, si, threshold,
+                        num_thread);
+            });
+            init.terminate();
+            return ns;
+          },
+          evaluations);
+      table.insert({kv.first, dtype, size_bucket(so), size_bucket(si)},
+                   config);
+      report(kv.first, so, si, config, evaluations);
+    }
+    free_buffer(data_);
+    free_buffer(out_data_);
   }
+}
+
+// Thread counts of the parallel sweeps in register_benchmarks, from
+// _MIN_NUM_THREAD up to _MAX_NUM_THREAD by doubling
+constexpr int64_t _MIN_NUM_THREAD = 2;
+constexpr int64_t _MAX_NUM_THREAD = 20;
 
+template <typename T> void register_benchmarks(const Registry<T> &r) {
+  // Keep the largest buffers at the same number of bytes as for float
   int64_t min_s = (8 << 12) / 2;
-  int64_t max_s = 8 << 25;
+  int64_t max_s = (8 << 25) * sizeof(float) / sizeof(T);
   int64_t ratio_s = max_s / 2;
   int64_t min_th = 8 * 1024;
   int64_t max_th = 128 * 1024;
 
-  int64_t min_nt = 2;
-  int64_t max_nt = 20;
+  int64_t min_nt = _MIN_NUM_THREAD;
+  int64_t max_nt = _MAX_NUM_THREAD;
+
+  std::string suffix = "<" + dtype_name<T>() + ">";
 
   for (int64_t s = min_s; s < max_s; s *= 2) {
-    for (auto &kv : sum_funcs) {
-      benchmark::RegisterBenchmark(kv.first.c_str(), &BM_ONECORE_SUM, s, 128,
-                                   kv.second);
+    for (auto &kv : r.sum_funcs) {
+      benchmark::RegisterBenchmark((kv.first + suffix).c_str(),
+                                   &BM_ONECORE_SUM<T>, s, 128, kv.second);
+    }
+  }
+
+  // Coarser size steps, the sweep is about in-cache ILP
+  for (int64_t s = min_s; s < max_s; s *= 8) {
+    for (auto &config : r.sum_configs) {
+      benchmark::RegisterBenchmark((config.name + suffix).c_str(),
+                                   &BM_ONECORE_SUM_SWEEP<T>, s, 128, config);
+    }
+  }
+
+  // Prefetching is about the DRAM-bound end, so only the larger sizes
+  for (int64_t s = max_s / 64; s < max_s; s *= 4) {
+    for (auto &config : r.sum_prefetch_configs) {
+      benchmark::RegisterBenchmark((config.name + suffix).c_str(),
+                                   &BM_ONECORE_SUM_PREFETCH<T>, s, 16, config);
+    }
+  }
+  // Allocation modes, only the sizes that no longer fit the default TLB reach
+  std::vector<AllocMode> alloc_modes = {AllocMode::DEFAULT, AllocMode::PAGES_4K,
+                                        AllocMode::THP, AllocMode::HUGETLB,
+                                        AllocMode::POPULATE};
+  std::vector<std::string> alloc_sum_funcs = {"sum_simple_128",
+                                              "sum_simple_256"};
+  std::vector<std::string> alloc_reducesum_funcs = {"reducesum_omp_simple_128",
+                                                    "reducesum_tbb_simple_128"};
+  for (auto mode : alloc_modes) {
+    std::string alloc_suffix = "_alloc_" + alloc_mode_name(mode) + suffix;
+    for (auto &name : alloc_sum_funcs) {
+      if (r.sum_funcs.count(name) == 0) {
+        continue;
+      }
+      for (int64_t s = max_s / 64; s < max_s; s *= 4) {
+        benchmark::RegisterBenchmark((name + alloc_suffix).c_str(),
+                                     &BM_ONECORE_SUM_ALLOC<T>, s, 16, mode,
+                                     r.sum_funcs.at(name));
+      }
+    }
+    for (auto &name : alloc_reducesum_funcs) {
+      if (r.parallelreducesum_funcs.count(name) == 0) {
+        continue;
+      }
+      for (int64_t k = 64; k < ratio_s / 4; k = k * 8) {
+        for (int64_t nt = min_nt; nt < max_nt; nt *= 4) {
+          benchmark::RegisterBenchmark(
+              (name + alloc_suffix).c_str(), &BM_PARALLEL_REDUCESUM_ALLOC<T>,
+              max_s / k / 16, k, 16, min_th * 4, nt, mode,
+              r.parallelreducesum_funcs.at(name));
+        }
+      }
+    }
+  }
+
+  // NUMA placement for every parallel kernel, at one large size and enough
+  // threads to span two sockets
+  std::vector<NumaPolicy> numa_policies = {
+      NumaPolicy::SERIAL, NumaPolicy::FIRST_TOUCH, NumaPolicy::LOCAL,
+      NumaPolicy::REMOTE, NumaPolicy::INTERLEAVE};
+  for (auto policy : numa_policies) {
+    std::string numa_suffix = "_numa_" + numa_policy_name(policy) + suffix;
+    int64_t nt = 16;
+    for (auto &kv : r.parallelsum_funcs) {
+      benchmark::RegisterBenchmark(
+          (kv.first + numa_suffix).c_str(), &BM_PARALLEL_SUM_NUMA<T>,
+          max_s / 2, 16, min_th * 4, nt, policy, parallel_backend(kv.first),
+          kv.second);
+    }
+    for (auto &kv : r.parallelreducesum_funcs) {
+      benchmark::RegisterBenchmark(
+          (kv.first + numa_suffix).c_str(), &BM_PARALLEL_REDUCESUM_NUMA<T>, 16,
+          max_s / 32, 16, min_th * 4, nt, policy, parallel_backend(kv.first),
+          parallel_split(kv.first), kv.second);
+    }
+  }
+
+  // Cache state at the start of every call, for the sizes up to a few LLCs
+  // that back to back calls always measure hot
+  std::vector<CacheState> cache_states = {CacheState::WARM, CacheState::FLUSH,
+                                          CacheState::EVICT};
+  std::vector<std::string> cache_sum_funcs = {"sum_naive", "sum_simple_128"};
+  std::vector<std::string> cache_reducesum_funcs = {"reducesum_naive",
+                                                    "reducesum_simple_128"};
+  std::vector<std::string> cache_parallelsum_funcs = {"sum_omp_simple_128",
+                                                      "sum_tbb_ap"};
+  for (auto cache : cache_states) {
+    std::string cache_suffix = "_cache_" + cache_state_name(cache) + suffix;
+    for (int64_t s = min_s; s <= max_s / 64; s *= 4) {
+      for (auto &name : cache_sum_funcs) {
+        if (r.sum_funcs.count(name) > 0) {
+          benchmark::RegisterBenchmark((name + cache_suffix).c_str(),
+                                       &BM_ONECORE_SUM_CACHE<T>, s, 16, cache,
+                                       r.sum_funcs.at(name));
+        }
+      }
+      for (auto &name : cache_reducesum_funcs) {
+        if (r.reducesum_funcs.count(name) == 0) {
+          continue;
+        }
+        for (int64_t si = 64; si < s; si *= 64) {
+          benchmark::RegisterBenchmark((name + cache_suffix).c_str(),
+                                       &BM_ONECORE_REDUCESUM_CACHE<T>, s / si,
+                                       si, 16, cache,
+                                       r.reducesum_funcs.at(name));
+        }
+      }
+      for (auto &name : cache_parallelsum_funcs) {
+        if (r.parallelsum_funcs.count(name) > 0) {
+          benchmark::RegisterBenchmark(
+              (name + cache_suffix).c_str(), &BM_PARALLEL_SUM_CACHE<T>, s, 16,
+              min_th, min_nt * 2, cache, parallel_backend(name),
+              r.parallelsum_funcs.at(name));
+        }
+      }
+    }
+  }
+
+  for (int64_t k = 64; k < ratio_s / 4; k = k * 8) {
+    int64_t so = max_s / k / 16;
+    int64_t si = k;
+    for (auto &config : r.reducesum_prefetch_configs) {
+      benchmark::RegisterBenchmark((config.name + suffix).c_str(),
+                                   &BM_ONECORE_REDUCESUM_PREFETCH<T>, so, si,
+                                   16, config);
     }
   }
 
@@ -805,19 +5132,36 @@ int main(int argc, char **argv) {
       if (so == 0 or si == 0) {
         continue;
       }
-      for (auto &kv : reducesum_funcs) {
-        benchmark::RegisterBenchmark(kv.first.c_str(), &BM_ONECORE_REDUCESUM,
-                                     so, si, 16, kv.second);
+      for (auto &kv : r.reducesum_funcs) {
+        benchmark::RegisterBenchmark((kv.first + suffix).c_str(),
+                                     &BM_ONECORE_REDUCESUM<T>, so, si, 16,
+                                     kv.second);
+      }
+      for (auto &kv : r.rowwisereducesum_funcs) {
+        benchmark::RegisterBenchmark((kv.first + suffix).c_str(),
+                                     &BM_ONECORE_ROWWISE_REDUCESUM<T>, so, si,
+                                     16, kv.second);
       }
     }
   }
 
   for (int64_t nt = min_nt; nt < max_nt; nt *= 2) {
     for (int64_t s = min_s; s < max_s; s *= 4) {
+      for (auto &kv : r.parallelsum_funcs) {
+        if (ignores_threshold(kv.first)) {
+          benchmark::RegisterBenchmark((kv.first + suffix).c_str(),
+                                       &BM_PARALLEL_SUM<T>, s, 128, -1, nt,
+                                       parallel_backend(kv.first), kv.second);
+        }
+      }
       for (int64_t th = min_th; th < max_th; th *= 2) {
-        for (auto &kv : parallelsum_funcs) {
-          benchmark::RegisterBenchmark(kv.first.c_str(), &BM_PARALLEL_SUM, s,
-                                       128, th, nt, kv.second);
+        for (auto &kv : r.parallelsum_funcs) {
+          if (ignores_threshold(kv.first)) {
+            continue;
+          }
+          benchmark::RegisterBenchmark((kv.first + suffix).c_str(),
+                                       &BM_PARALLEL_SUM<T>, s, 128, th, nt,
+                                       parallel_backend(kv.first), kv.second);
         }
       }
     }
@@ -828,17 +5172,219 @@ int main(int argc, char **argv) {
         if (so == 0 or si == 0) {
           continue;
         }
+        for (auto &kv : r.parallelreducesum_funcs) {
+          if (ignores_threshold(kv.first)) {
+            benchmark::RegisterBenchmark(
+                (kv.first + suffix).c_str(), &BM_PARALLEL_REDUCESUM<T>, so, si,
+                128, -1, nt, parallel_backend(kv.first),
+                parallel_split(kv.first), kv.second);
+          }
+        }
         for (int64_t th = min_th; th < max_th; th *= 4) {
-          for (auto &kv : parallelreducesum_funcs) {
-            benchmark::RegisterBenchmark(kv.first.c_str(),
-                                         &BM_PARALLEL_REDUCESUM, so, si, 128,
-                                         th, nt, kv.second);
+          for (auto &kv : r.parallelreducesum_funcs) {
+            if (ignores_threshold(kv.first)) {
+              continue;
+            }
+            benchmark::RegisterBenchmark(
+                (kv.first + suffix).c_str(), &BM_PARALLEL_REDUCESUM<T>, so, si,
+                128, th, nt, parallel_backend(kv.first),
+                parallel_split(kv.first), kv.second);
           }
+          for (auto &kv : r.parallelrowwisereducesum_funcs) {
+            benchmark::RegisterBenchmark((kv.first + suffix).c_str(),
+                                         &BM_PARALLEL_ROWWISE_REDUCESUM<T>, so,
+                                         si, 128, th, nt, kv.second);
+          }
+        }
+      }
+    }
+  }
+
+  // Kernels with an entry in the tuning table, on their tuned configuration
+  for (auto &kv : r.parallelsum_funcs) {
+    if (!tune_table().has_kernel(kv.first, dtype_name<T>())) {
+      continue;
+    }
+    for (int64_t s = min_s; s < max_s; s *= 4) {
+      benchmark::RegisterBenchmark((kv.first + "_tuned" + suffix).c_str(),
+                                   &BM_PARALLEL_SUM_TUNED<T>, s, 128, kv.first,
+                                   kv.second);
+    }
+  }
+  for (auto &kv : r.parallelreducesum_funcs) {
+    if (!tune_table().has_kernel(kv.first, dtype_name<T>())) {
+      continue;
+    }
+    for (int64_t kk = 1; kk < 8; kk = kk * 2) {
+      for (int64_t k = 4; k < ratio_s / 4; k = k * 2) {
+        int64_t so = max_s / k / kk / 16;
+        int64_t si = k;
+        if (so == 0 or si == 0) {
+          continue;
+        }
+        benchmark::RegisterBenchmark((kv.first + "_tuned" + suffix).c_str(),
+                                     &BM_PARALLEL_REDUCESUM_TUNED<T>, so, si,
+                                     128, kv.first, kv.second);
+      }
+    }
+  }
+
+  for (const std::vector<int64_t> &shape : reducesum_nd_shapes()) {
+    for (int64_t dim = 0; dim < 3; dim++) {
+      benchmark::RegisterBenchmark(("reducesum_nd_engine" + suffix).c_str(),
+                                   &BM_REDUCESUM_ND<T>, shape, dim, 16, -1,
+                                   ReduceBackend::SERIAL);
+      for (int64_t nt = min_nt; nt < max_nt; nt *= 2) {
+        benchmark::RegisterBenchmark(
+            ("reducesum_nd_engine_omp" + suffix).c_str(), &BM_REDUCESUM_ND<T>,
+            shape, dim, 16, nt, ReduceBackend::OMP);
+        benchmark::RegisterBenchmark(
+            ("reducesum_nd_engine_tbb" + suffix).c_str(), &BM_REDUCESUM_ND<T>,
+            shape, dim, 16, nt, ReduceBackend::TBB);
+      }
+    }
+  }
+
+  for (int64_t s = min_s; s < max_s; s *= 4) {
+    for (auto &kv : r.stats_funcs) {
+      benchmark::RegisterBenchmark((kv.first + suffix).c_str(),
+                                   &BM_ONECORE_STATS, s, 16,
+                                   stats_passes(kv.first), kv.second);
+    }
+    for (int64_t nt = min_nt; nt < max_nt; nt *= 2) {
+      for (auto &kv : r.parallelstats_funcs) {
+        benchmark::RegisterBenchmark((kv.first + suffix).c_str(),
+                                     &BM_PARALLEL_STATS, s, 16,
+                                     stats_passes(kv.first), min_th, nt,
+                                     kv.second);
+      }
+    }
+  }
+  for (int64_t k = 4; k < ratio_s / 4; k = k * 4) {
+    int64_t so = max_s / k / 16;
+    int64_t si = k;
+    for (auto &kv : r.reducestats_funcs) {
+      benchmark::RegisterBenchmark((kv.first + suffix).c_str(),
+                                   &BM_ONECORE_REDUCESTATS, so, si, 16,
+                                   stats_passes(kv.first), kv.second);
+    }
+    for (int64_t nt = min_nt; nt < max_nt; nt *= 2) {
+      for (auto &kv : r.parallelreducestats_funcs) {
+        benchmark::RegisterBenchmark((kv.first + suffix).c_str(),
+                                     &BM_PARALLEL_REDUCESTATS, so, si, 16,
+                                     stats_passes(kv.first), min_th, nt,
+                                     kv.second);
+      }
+    }
+  }
+
+  // Same stride sweep as compare_eigen. The logical size is kept fixed across
+  // strides, so the footprint grows with the stride.
+  for (int64_t stride = 1; stride < 16; stride *= 2) {
+    for (int64_t s = min_s; s * stride < max_s; s *= 8) {
+      for (auto &kv : r.stridedsum_funcs) {
+        benchmark::RegisterBenchmark((kv.first + suffix).c_str(),
+                                     &BM_ONECORE_STRIDED_SUM<T>, s, stride, 128,
+                                     kv.second);
+      }
+    }
+    for (int64_t k = 4; k < ratio_s / 4; k = k * 8) {
+      int64_t so = max_s / k / 16 / stride;
+      int64_t si = k;
+      if (so == 0 or si == 0) {
+        continue;
+      }
+      for (auto &kv : r.stridedreducesum_funcs) {
+        benchmark::RegisterBenchmark((kv.first + suffix).c_str(),
+                                     &BM_ONECORE_STRIDED_REDUCESUM<T>, so, si,
+                                     stride, 16, kv.second);
+      }
+    }
+    for (int64_t nt = min_nt; nt < max_nt; nt *= 2) {
+      for (int64_t s = min_s; s * stride < max_s; s *= 8) {
+        for (auto &kv : r.parallelstridedsum_funcs) {
+          benchmark::RegisterBenchmark((kv.first + suffix).c_str(),
+                                       &BM_PARALLEL_STRIDED_SUM<T>, s, stride,
+                                       128, min_th, nt, kv.second);
+        }
+      }
+      for (int64_t k = 4; k < ratio_s / 4; k = k * 8) {
+        int64_t so = max_s / k / 16 / stride;
+        int64_t si = k;
+        if (so == 0 or si == 0) {
+          continue;
+        }
+        for (auto &kv : r.parallelstridedreducesum_funcs) {
+          benchmark::RegisterBenchmark((kv.first + suffix).c_str(),
+                                       &BM_PARALLEL_STRIDED_REDUCESUM<T>, so,
+                                       si, stride, 16, min_th, nt, kv.second);
         }
       }
     }
   }
+}
+
+int main(int argc, char **argv) {
+  resolve_dispatch();
+  std::cerr << "Dispatching to: "
+            << cpu_capability_name(get_cpu_capability()) << std::endl;
+
+  Registry<float> float_funcs = make_registry<float>();
+  add_isa_funcs(float_funcs);
+  add_strided_funcs(float_funcs);
+  add_stats_funcs(float_funcs);
+  test_registry(float_funcs);
+  add_accurate_funcs(float_funcs);
+
+  Registry<double> double_funcs = make_registry<double>();
+  test_registry(double_funcs);
+
+  Registry<int32_t> int32_funcs = make_registry<int32_t>();
+  test_registry(int32_funcs);
+
+  Registry<int64_t> int64_funcs = make_registry<int64_t>();
+  test_registry(int64_funcs);
+
+  const char *autotune = std::getenv("AVX_SUM_AUTOTUNE");
+  if (autotune && std::string(autotune) == "1") {
+    TuneTable table;
+    tune_registry(float_funcs, table);
+    tune_registry(double_funcs, table);
+    tune_registry(int32_funcs, table);
+    tune_registry(int64_funcs, table);
+    table.save(tune_table_path());
+    std::cerr << "Wrote " << tune_table_path() << std::endl;
+    return 0;
+  }
+  if (tune_table().load(tune_table_path())) {
+    std::cerr << "Loaded " << tune_table_path() << std::endl;
+  }
+
+  register_benchmarks(float_funcs);
+  register_benchmarks(double_funcs);
+  register_benchmarks(int32_funcs);
+  register_benchmarks(int64_funcs);
+
+  // Every task count, the arena kernels can ask for any of them
+  for (int64_t tasks = 1; tasks <= 32; tasks++) {
+    benchmark::RegisterBenchmark("arena_switch_direct", &BM_ARENA_SWITCH, tasks,
+                                 128, ArenaSwitch::DIRECT);
+    benchmark::RegisterBenchmark("arena_switch_arena", &BM_ARENA_SWITCH, tasks,
+                                 128, ArenaSwitch::ARENA);
+    benchmark::RegisterBenchmark("arena_switch_empty", &BM_ARENA_SWITCH, tasks,
+                                 128, ArenaSwitch::EMPTY);
+  }
 
   benchmark::Initialize(&argc, argv);
+
+  // One core, the sweep and the tuned configurations, the fixed counts of
+  // register_benchmarks are all in the sweep
+  std::set<int64_t> thread_counts = tune_table().num_threads();
+  thread_counts.insert(1);
+  for (int64_t nt = _MIN_NUM_THREAD; nt < _MAX_NUM_THREAD; nt *= 2) {
+    thread_counts.insert(nt);
+  }
+  register_rooflines(thread_counts);
+
   benchmark::RunSpecifiedBenchmarks();
 }
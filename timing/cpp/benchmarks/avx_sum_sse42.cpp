@@ -0,0 +1,117 @@
+#include "avx_sum_sse42.h"
+
+#include <cstdint>
+
+#include "immintrin.h"
+
+#ifdef __AVX__
+#error "avx_sum_sse42.cpp must be built without AVX, see avx_sum_sse42.h"
+#endif
+
+// Scalar tail, like sum_naive in avx_sum.cpp
+static void sum_tail(float &sum, const float *arr, size_t start, size_t end) {
+  for (size_t i = start; i < end; i += 1) {
+    sum += arr[i];
+  }
+}
+
+void sum_simple_sse42(float &sum, const float *arr, size_t start, size_t end) {
+  __m128 a = _mm_set1_ps(0);
+  int64_t blocks = (end - start) / 4;
+  for (int64_t k = 0; k < blocks; k++) {
+    a = _mm_add_ps(a, _mm_loadu_ps(arr + start + k * 4));
+  }
+  float sarr[4];
+  _mm_storeu_ps(sarr, a);
+  for (int i = 0; i < 4; i++) {
+    sum += sarr[i];
+  }
+  sum_tail(sum, arr, start + blocks * 4, end);
+}
+
+void sum_simple_128_sse42(float &sum, const float *arr, size_t start,
+                          size_t end) {
+  __m128 a[8]; // 128 bytes (two cache lines)
+  for (size_t i = 0; i < 8; i++) {
+    a[i] = _mm_set1_ps(0);
+  }
+  for (int64_t k = 0; k < (end - start) / 32; k++) {
+    for (size_t i = 0; i < 8; i++) {
+      a[i] = _mm_add_ps(a[i], _mm_loadu_ps(arr + start + k * 32 + i * 4));
+    }
+  }
+  for (size_t i = 0; i < 8; i++) {
+    float sarr[4];
+    _mm_storeu_ps(sarr, a[i]);
+    for (int i = 0; i < 4; i++) {
+      sum += sarr[i];
+    }
+  }
+  sum_tail(sum, arr, start + ((end - start) / 32) * 32, end);
+}
+
+void sum_simple_256_sse42(float &sum, const float *arr, size_t start,
+                          size_t end) {
+  __m128 a[16]; // 256 bytes (four cache lines)
+  for (size_t i = 0; i < 16; i++) {
+    a[i] = _mm_set1_ps(0);
+  }
+  for (int64_t k = 0; k < (end - start) / 64; k++) {
+    for (size_t i = 0; i < 16; i++) {
+      a[i] = _mm_add_ps(a[i], _mm_loadu_ps(arr + start + k * 64 + i * 4));
+    }
+  }
+  for (size_t i = 0; i < 16; i++) {
+    float sarr[4];
+    _mm_storeu_ps(sarr, a[i]);
+    for (int i = 0; i < 4; i++) {
+      sum += sarr[i];
+    }
+  }
+  sum_tail(sum, arr, start + ((end - start) / 64) * 64, end);
+}
+
+void reducesum_simple_sse42(const float *arr, float *outarr, size_t size1b,
+                            size_t size1e, size_t size2b, size_t size2e,
+                            size_t size2) {
+  int64_t blocks2 = (size2e - size2b) / 4;
+  for (size_t k = 0; k < blocks2; k++) {
+    __m128 b = _mm_loadu_ps(outarr + size2b + k * 4);
+    for (size_t i = size1b; i < size1e; i++) {
+      __m128 a = _mm_loadu_ps(arr + i * size2 + size2b + k * 4);
+      b = _mm_add_ps(a, b);
+    }
+    _mm_storeu_ps(outarr + size2b + k * 4, b);
+  }
+  for (size_t j = size2b + blocks2 * 4; j < size2e; j += 1) {
+    for (size_t i = size1b; i < size1e; i += 1) {
+      outarr[j] += arr[i * size2 + j];
+    }
+  }
+}
+
+void reducesum_simple_128_sse42(const float *arr, float *outarr,
+                                size_t size1b, size_t size1e, size_t size2b,
+                                size_t size2e, size_t size2) {
+  size_t blocks2 = (size2e - size2b) / 32;
+  for (size_t k = 0; k < blocks2; k++) {
+    __m128 b[8];
+    for (size_t ib = 0; ib < 8; ib++) {
+      b[ib] = _mm_loadu_ps(outarr + size2b + k * 32 + ib * 4);
+    }
+    for (size_t i = size1b; i < size1e; i += 1) {
+      for (size_t ib = 0; ib < 8; ib++) {
+        __m128 val = _mm_loadu_ps(arr + i * size2 + size2b + k * 32 + ib * 4);
+        b[ib] = _mm_add_ps(val, b[ib]);
+      }
+    }
+    for (size_t ib = 0; ib < 8; ib++) {
+      _mm_storeu_ps(outarr + size2b + k * 32 + ib * 4, b[ib]);
+    }
+  }
+  for (size_t j = size2b + blocks2 * 32; j < size2e; j += 1) {
+    for (size_t i = size1b; i < size1e; i += 1) {
+      outarr[j] += arr[i * size2 + j];
+    }
+  }
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+// SSE4.2 tier of the dispatched sum and column-wise reduction kernels, see
+// CPU DISPATCH in avx_sum.cpp. Built in avx_sum_sse42.cpp without -mavx2, so
+// that the kernels are legacy SSE encoded and measure what that encoding
+// costs. A target("sse4.2") attribute in an -mavx2 translation unit would
+// still emit VEX encodings. The rest of the binary needs AVX2, so the tier is
+// only reached with AVX_SUM_CPU_CAPABILITY=sse42 and never on a CPU without
+// AVX.
+
+#include <cstddef>
+
+void sum_simple_sse42(float &sum, const float *arr, size_t start, size_t end);
+void sum_simple_128_sse42(float &sum, const float *arr, size_t start,
+                          size_t end);
+void sum_simple_256_sse42(float &sum, const float *arr, size_t start,
+                          size_t end);
+
+void reducesum_simple_sse42(const float *arr, float *outarr, size_t size1b,
+                            size_t size1e, size_t size2b, size_t size2e,
+                            size_t size2);
+void reducesum_simple_128_sse42(const float *arr, float *outarr,
+                                size_t size1b, size_t size1e, size_t size2b,
+                                size_t size2e, size_t size2);
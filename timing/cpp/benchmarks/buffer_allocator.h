@@ -0,0 +1,334 @@
+#pragma once
+
+// Pluggable allocator for benchmark buffers. The page size and when pages get
+// faulted in change what the large sizes measure, so the allocation mode can
+// be swept like any other benchmark dimension.
+//
+//  DEFAULT   posix_memalign with 64 byte alignment plus memset, as before
+//  PAGES_4K  page aligned mmap plus madvise(MADV_NOHUGEPAGE), which keeps THP
+//            away. madvise only takes page aligned ranges.
+//  THP       2MB aligned posix_memalign plus madvise(MADV_HUGEPAGE)
+//  HUGETLB   explicit 2MB pages via mmap(MAP_HUGETLB), needs reserved pages in
+//            /proc/sys/vm/nr_hugepages and falls back to THP otherwise, see
+//            buffer_alloc_mode
+//  POPULATE  4K mmap(MAP_POPULATE), faulted in by the kernel at mmap time
+//
+// Orthogonal to the mode, the NUMA policy decides which node the pages end up
+// on. By default the allocating thread touches every page, so on a multi
+// socket machine all of it lands on that thread's node.
+//
+//  SERIAL       memset on the allocating thread, as before
+//  FIRST_TOUCH  fresh untouched pages, the caller initializes them in parallel
+//               with the same partitioning the kernel uses
+//  LOCAL        bound to the node of the allocating thread
+//  REMOTE       bound to the next node over, the worst case for that thread
+//  INTERLEAVE   pages round robin over all nodes
+//
+// Every policy but SERIAL gets a mapping of its own, so that binding it never
+// moves pages that the heap shares with neighbouring allocations.
+
+#include <numa.h>
+#include <numaif.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+
+enum class AllocMode { DEFAULT = 0, PAGES_4K, THP, HUGETLB, POPULATE };
+
+// Mimic TH alignment
+constexpr size_t _BUFFER_ALIGNMENT = 64;
+constexpr size_t _HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+
+inline std::string alloc_mode_name(AllocMode mode) {
+  switch (mode) {
+  case AllocMode::PAGES_4K:
+    return "4k";
+  case AllocMode::THP:
+    return "thp";
+  case AllocMode::HUGETLB:
+    return "hugetlb";
+  case AllocMode::POPULATE:
+    return "populate";
+  default:
+    return "default";
+  }
+}
+
+enum class NumaPolicy { SERIAL = 0, FIRST_TOUCH, LOCAL, REMOTE, INTERLEAVE };
+
+inline std::string numa_policy_name(NumaPolicy policy) {
+  switch (policy) {
+  case NumaPolicy::FIRST_TOUCH:
+    return "first_touch";
+  case NumaPolicy::LOCAL:
+    return "local";
+  case NumaPolicy::REMOTE:
+    return "remote";
+  case NumaPolicy::INTERLEAVE:
+    return "interleave";
+  default:
+    return "serial";
+  }
+}
+
+struct BufferInfo {
+  size_t bytes;
+  bool mapped;
+  // Mode the buffer actually got
+  AllocMode mode;
+};
+
+// Mode used by alloc_buffer, see ScopedAllocMode
+inline AllocMode &current_alloc_mode() {
+  static AllocMode mode = AllocMode::DEFAULT;
+  return mode;
+}
+
+// Sets the allocation mode for the lifetime of the object
+struct ScopedAllocMode {
+  AllocMode previous;
+  explicit ScopedAllocMode(AllocMode mode) : previous(current_alloc_mode()) {
+    current_alloc_mode() = mode;
+  }
+  ~ScopedAllocMode() { current_alloc_mode() = previous; }
+};
+
+// Policy used by alloc_buffer, see ScopedNumaPolicy
+inline NumaPolicy &current_numa_policy() {
+  static NumaPolicy policy = NumaPolicy::SERIAL;
+  return policy;
+}
+
+// Sets the NUMA policy for the lifetime of the object
+struct ScopedNumaPolicy {
+  NumaPolicy previous;
+  explicit ScopedNumaPolicy(NumaPolicy policy)
+      : previous(current_numa_policy()) {
+    current_numa_policy() = policy;
+  }
+  ~ScopedNumaPolicy() { current_numa_policy() = previous; }
+};
+
+// free_buffer needs to know whether a pointer came from mmap and its size.
+// Buffers that didn't get the DEFAULT mode are kept too, for buffer_alloc_mode.
+inline std::map<void *, BufferInfo> &buffer_infos() {
+  static std::map<void *, BufferInfo> infos;
+  return infos;
+}
+
+inline std::mutex &buffer_infos_mutex() {
+  static std::mutex mutex;
+  return mutex;
+}
+
+inline size_t round_up_bytes(size_t bytes, size_t multiple) {
+  return (bytes + multiple - 1) / multiple * multiple;
+}
+
+inline void warn_once(bool &warned, const std::string &message) {
+  if (!warned) {
+    std::cerr << message << std::endl;
+    warned = true;
+  }
+}
+
+// ptr has to be page aligned, otherwise madvise fails with EINVAL
+inline void advise_buffer(void *ptr, size_t bytes, int advice) {
+  if (madvise(ptr, round_up_bytes(bytes, sysconf(_SC_PAGESIZE)), advice)) {
+    static bool warned = false;
+    warn_once(warned, "madvise failed, the page size hint is ignored.");
+  }
+}
+
+inline void *alloc_aligned_buffer(size_t bytes, size_t alignment, int advice) {
+  void *ptr = NULL;
+  if (posix_memalign(&ptr, alignment, bytes))
+    throw std::runtime_error("posix_memalign failed");
+  if (advice >= 0) {
+    advise_buffer(ptr, bytes, advice);
+  }
+  return ptr;
+}
+
+inline void *alloc_mapped_buffer(size_t bytes, int flags) {
+  void *ptr = mmap(NULL, bytes, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | flags, -1, 0);
+  return ptr == MAP_FAILED ? NULL : ptr;
+}
+
+// Binds the pages of [ptr, ptr + bytes) according to policy. MPOL_MF_MOVE
+// migrates pages that were already touched, e.g. MAP_POPULATE mappings, so ptr
+// must not share pages with other allocations.
+inline void place_buffer(void *ptr, size_t bytes, NumaPolicy policy) {
+  if (policy == NumaPolicy::SERIAL || policy == NumaPolicy::FIRST_TOUCH) {
+    return;
+  }
+  static bool warned_numa = false;
+  if (numa_available() < 0) {
+    warn_once(warned_numa, "NUMA is not available, ignoring the policy.");
+    return;
+  }
+  int num_nodes = numa_max_node() + 1;
+  int local_node = numa_node_of_cpu(sched_getcpu());
+  struct bitmask *nodes = numa_allocate_nodemask();
+  int mode = MPOL_BIND;
+  if (policy == NumaPolicy::LOCAL) {
+    numa_bitmask_setbit(nodes, local_node);
+  } else if (policy == NumaPolicy::REMOTE) {
+    static bool warned_remote = false;
+    if (num_nodes == 1) {
+      warn_once(warned_remote, "Only one NUMA node, remote equals local.");
+    }
+    numa_bitmask_setbit(nodes, (local_node + 1) % num_nodes);
+  } else {
+    for (int node = 0; node < num_nodes; node++) {
+      numa_bitmask_setbit(nodes, node);
+    }
+    mode = MPOL_INTERLEAVE;
+  }
+  // mbind works on whole pages
+  size_t page = sysconf(_SC_PAGESIZE);
+  uintptr_t begin = (uintptr_t)ptr / page * page;
+  uintptr_t end = round_up_bytes((uintptr_t)ptr + bytes, page);
+  if (mbind((void *)begin, end - begin, mode, nodes->maskp, nodes->size + 1,
+            MPOL_MF_MOVE)) {
+    static bool warned_mbind = false;
+    warn_once(warned_mbind, "mbind failed, pages are not placed.");
+  }
+  numa_free_nodemask(nodes);
+}
+
+inline void warn_hugetlb_fallback() {
+  static bool warned = false;
+  warn_once(warned, "MAP_HUGETLB failed, falling back to THP. Reserve pages "
+                    "with /proc/sys/vm/nr_hugepages.");
+}
+
+// posix_memalign can hand back heap memory that was touched before, or that
+// shares pages with other allocations, so first touch and mbind need a fresh
+// mapping. The mode only contributes its madvise hint.
+inline void *alloc_untouched_buffer(size_t bytes, BufferInfo &info) {
+  AllocMode mode = current_alloc_mode();
+  void *ptr = NULL;
+  if (mode == AllocMode::HUGETLB) {
+    info.bytes = round_up_bytes(bytes, _HUGE_PAGE_SIZE);
+    ptr = alloc_mapped_buffer(info.bytes, MAP_HUGETLB);
+    if (!ptr) {
+      warn_hugetlb_fallback();
+      mode = AllocMode::THP;
+    }
+  }
+  info.mode = mode;
+  if (!ptr) {
+    info.bytes = bytes;
+    ptr = alloc_mapped_buffer(bytes, 0);
+    if (!ptr)
+      throw std::runtime_error("mmap failed");
+    if (mode == AllocMode::THP) {
+      advise_buffer(ptr, bytes, MADV_HUGEPAGE);
+    } else if (mode == AllocMode::PAGES_4K) {
+      advise_buffer(ptr, bytes, MADV_NOHUGEPAGE);
+    }
+  }
+  info.mapped = true;
+  return ptr;
+}
+
+// Buffer of at least bytes, aligned to at least 64 bytes. Zeroed unless the
+// NUMA policy is FIRST_TOUCH, in which case no page has been faulted in yet.
+inline void *alloc_buffer(size_t bytes) {
+  void *ptr = NULL;
+  NumaPolicy policy = current_numa_policy();
+  AllocMode mode = current_alloc_mode();
+  BufferInfo info = {bytes, false, mode};
+  if (policy == NumaPolicy::FIRST_TOUCH ||
+      (policy != NumaPolicy::SERIAL && mode != AllocMode::POPULATE)) {
+    ptr = alloc_untouched_buffer(bytes, info);
+  } else {
+    switch (mode) {
+    case AllocMode::PAGES_4K:
+      // Untouched pages, the advice has to come before the first fault
+      ptr = alloc_mapped_buffer(bytes, 0);
+      if (!ptr)
+        throw std::runtime_error("mmap failed");
+      advise_buffer(ptr, bytes, MADV_NOHUGEPAGE);
+      info.mapped = true;
+      break;
+    case AllocMode::HUGETLB:
+      info.bytes = round_up_bytes(bytes, _HUGE_PAGE_SIZE);
+      ptr = alloc_mapped_buffer(info.bytes, MAP_HUGETLB);
+      if (ptr) {
+        info.mapped = true;
+        break;
+      }
+      warn_hugetlb_fallback();
+      info.bytes = bytes;
+      info.mode = AllocMode::THP;
+    // fallthrough
+    case AllocMode::THP:
+      ptr = alloc_aligned_buffer(bytes, _HUGE_PAGE_SIZE, MADV_HUGEPAGE);
+      break;
+    case AllocMode::POPULATE:
+      ptr = alloc_mapped_buffer(bytes, MAP_POPULATE);
+      if (!ptr)
+        throw std::runtime_error("mmap with MAP_POPULATE failed");
+      info.mapped = true;
+      break;
+    default:
+      ptr = alloc_aligned_buffer(bytes, _BUFFER_ALIGNMENT, -1);
+    }
+  }
+  place_buffer(ptr, bytes, policy);
+  if (info.mapped || info.mode != AllocMode::DEFAULT) {
+    std::lock_guard<std::mutex> lock(buffer_infos_mutex());
+    buffer_infos()[ptr] = info;
+  }
+  // The 4K pages are faulted in here like the DEFAULT ones, so that the two
+  // only differ in page size. Bound buffers are faulted in right after mbind,
+  // so that they are placed before the kernel runs.
+  if (policy != NumaPolicy::FIRST_TOUCH &&
+      (!info.mapped || mode == AllocMode::PAGES_4K ||
+       policy != NumaPolicy::SERIAL)) {
+    memset(ptr, 0, bytes);
+  }
+  return ptr;
+}
+
+inline void free_buffer(void *ptr) {
+  if (ptr == NULL) {
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(buffer_infos_mutex());
+    auto it = buffer_infos().find(ptr);
+    if (it != buffer_infos().end()) {
+      bool mapped = it->second.mapped;
+      if (mapped) {
+        munmap(ptr, it->second.bytes);
+      }
+      buffer_infos().erase(it);
+      if (mapped) {
+        return;
+      }
+    }
+  }
+  free(ptr);
+}
+
+// Mode a pointer returned by alloc_buffer actually got. HUGETLB buffers
+// report THP when MAP_HUGETLB failed, so that the hugetlb benchmarks don't
+// silently measure THP.
+inline AllocMode buffer_alloc_mode(const void *ptr) {
+  std::lock_guard<std::mutex> lock(buffer_infos_mutex());
+  auto it = buffer_infos().find((void *)ptr);
+  return it == buffer_infos().end() ? AllocMode::DEFAULT : it->second.mode;
+}
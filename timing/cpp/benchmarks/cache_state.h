@@ -0,0 +1,189 @@
+#pragma once
+
+// State of the caches at the start of every timed call. The benchmarks run
+// iter calls back to back on the same buffer, so anything up to the LLC size
+// is always hot. Production reductions mostly see cold data.
+//
+//  WARM   calls back to back, as before
+//  FLUSH  clflushopt over the input before every call, clflush on CPUs
+//         without it. Only the input leaves the cache hierarchy.
+//  EVICT  read sweep over a buffer of twice the LLC before every call, which
+//         also evicts code, stack and anything else the call would touch
+//
+// In the cold states the timer is paused around the preparation, and call_ns
+// reports the calls alone so the Pause/ResumeTiming overhead stays out of it.
+// The state defaults to the CACHE_STATE environment variable (warm, flush or
+// evict) so that harnesses without a cache sweep can be run cold as a whole.
+
+#include <benchmark/benchmark.h>
+#include <cpuid.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "immintrin.h"
+#include "perf_counters.h"
+
+enum class CacheState { WARM = 0, FLUSH, EVICT };
+
+constexpr size_t _CACHE_LINE = 64;
+
+inline std::string cache_state_name(CacheState cache) {
+  switch (cache) {
+  case CacheState::FLUSH:
+    return "flush";
+  case CacheState::EVICT:
+    return "evict";
+  default:
+    return "warm";
+  }
+}
+
+inline CacheState cache_state_from_env() {
+  const char *cache = std::getenv("CACHE_STATE");
+  if (cache == NULL) {
+    return CacheState::WARM;
+  }
+  std::string s(cache);
+  if (s == "flush") {
+    return CacheState::FLUSH;
+  }
+  if (s == "evict") {
+    return CacheState::EVICT;
+  }
+  return CacheState::WARM;
+}
+
+// State used by run_calls, see ScopedCacheState
+inline CacheState &current_cache_state() {
+  static CacheState cache = cache_state_from_env();
+  return cache;
+}
+
+// Sets the cache state for the lifetime of the object
+struct ScopedCacheState {
+  CacheState previous;
+  explicit ScopedCacheState(CacheState cache)
+      : previous(current_cache_state()) {
+    current_cache_state() = cache;
+  }
+  ~ScopedCacheState() { current_cache_state() = previous; }
+};
+
+// Size of the last level cache in bytes. Containers often hide it from
+// sysconf, so sysfs is the fallback and 64MB, more than any current LLC
+// slice, the last resort.
+inline size_t llc_bytes() {
+  long bytes = sysconf(_SC_LEVEL3_CACHE_SIZE);
+  if (bytes > 0) {
+    return bytes;
+  }
+  std::ifstream size("/sys/devices/system/cpu/cpu0/cache/index3/size");
+  std::string s;
+  if (size >> s) {
+    size_t value = std::atol(s.c_str());
+    if (!s.empty() && s.back() == 'K') {
+      value <<= 10;
+    } else if (!s.empty() && s.back() == 'M') {
+      value <<= 20;
+    }
+    if (value > 0) {
+      return value;
+    }
+  }
+  return 64 << 20;
+}
+
+inline bool has_clflushopt() {
+  unsigned int eax, ebx, ecx, edx;
+  if (!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)) {
+    return false;
+  }
+  return ebx & bit_CLFLUSHOPT;
+}
+
+__attribute__((target("clflushopt"))) inline void
+flush_lines_opt(const char *begin, const char *end) {
+  for (const char *p = begin; p < end; p += _CACHE_LINE) {
+    _mm_clflushopt((void *)p);
+  }
+}
+
+inline void flush_lines(const char *begin, const char *end) {
+  for (const char *p = begin; p < end; p += _CACHE_LINE) {
+    _mm_clflush(p);
+  }
+}
+
+// Writes back and invalidates every line of [data, data + bytes)
+inline void flush_buffer(const void *data, size_t bytes) {
+  static const bool opt = has_clflushopt();
+  const char *begin = (const char *)((uintptr_t)data & ~(_CACHE_LINE - 1));
+  const char *end = (const char *)data + bytes;
+  if (opt) {
+    flush_lines_opt(begin, end);
+  } else {
+    flush_lines(begin, end);
+  }
+  // clflushopt is only ordered by fences
+  _mm_mfence();
+}
+
+// Reads a buffer of twice the LLC size, one load per line
+inline void evict_caches() {
+  static std::vector<char> sweep(2 * llc_bytes(), 1);
+  char sum = 0;
+  for (size_t i = 0; i < sweep.size(); i += _CACHE_LINE) {
+    sum += sweep[i];
+  }
+  benchmark::DoNotOptimize(sum);
+}
+
+inline void prepare_cache(CacheState cache, const void *data, size_t bytes) {
+  if (cache == CacheState::FLUSH) {
+    flush_buffer(data, bytes);
+  } else if (cache == CacheState::EVICT) {
+    evict_caches();
+  }
+}
+
+// Runs call iter times in the current cache state, the input being the bytes
+// at data. Called with the timer running. perf counts the calls, like call_ns
+// without the cache preparation. Returns the mean time of a call in
+// nanoseconds.
+template <typename F>
+double run_calls(benchmark::State &state, int64_t iter, const void *data,
+                 size_t bytes, PerfCounters &perf, F call) {
+  using clock = std::chrono::steady_clock;
+  CacheState cache = current_cache_state();
+  perf.count_calls(iter);
+  if (cache == CacheState::WARM) {
+    perf.resume();
+    clock::time_point start = clock::now();
+    for (int64_t step = 0; step < iter; step++) {
+      call();
+    }
+    std::chrono::duration<double, std::nano> elapsed = clock::now() - start;
+    perf.pause();
+    return elapsed.count() / iter;
+  }
+  double ns = 0;
+  for (int64_t step = 0; step < iter; step++) {
+    state.PauseTiming();
+    prepare_cache(cache, data, bytes);
+    state.ResumeTiming();
+    perf.resume();
+    clock::time_point start = clock::now();
+    call();
+    std::chrono::duration<double, std::nano> elapsed = clock::now() - start;
+    perf.pause();
+    ns += elapsed.count();
+  }
+  return ns / iter;
+}
@@ -1,5 +1,9 @@
 #define EIGEN_FAST_MATH 0
 #define EIGEN_USE_MKL_ALL 1
+#include "buffer_allocator.h"
+#include "cache_state.h"
+#include "dataset_cache.h"
+#include "roofline.h"
 #include <ATen/ATen.h>
 #include <Eigen/Core>
 #include <Eigen/Dense>
@@ -8,23 +12,13 @@
 #include <omp.h>
 #include <sleef.h>
 #include <stdexcept>
+#include <tuple>
 #include <typeinfo>
+#include <vector>
 
 // Mimic TH alignment
 constexpr size_t _ALIGNMENT = 64;
 
-void make_vector(float *data_, size_t size) {
-  for (size_t i = 0; i < size; i++) {
-    data_[i] = (float)(i % 1024);
-  }
-}
-
-void make_float_data(float **data_, size_t size) {
-  if (posix_memalign((void **)data_, _ALIGNMENT, size * sizeof(float)))
-    throw std::invalid_argument("received negative value");
-  memset(*data_, 0, size * sizeof(float));
-}
-
 float get_random_value() {
   std::random_device
       rd; // Will be used to obtain a seed for the random number engine
@@ -52,192 +46,280 @@ using EigenVectorMap =
                Eigen::AlignmentType::Aligned64,
                Eigen::Stride<Eigen::Dynamic, Eigen::Dynamic>>;
 
-// General benchmark setup: Allocate fresh memory every 64 iterations
+template <typename T>
+using ConstEigenMatrixMap =
+    Eigen::Map<const Eigen::Matrix<T, Eigen::Dynamic, Eigen::Dynamic>,
+               Eigen::AlignmentType::Aligned64,
+               Eigen::Stride<Eigen::Dynamic, Eigen::Dynamic>>;
+
+template <typename T>
+using ConstEigenVectorMap =
+    Eigen::Map<const Eigen::Matrix<T, Eigen::Dynamic, 1>,
+               Eigen::AlignmentType::Aligned64,
+               Eigen::Stride<Eigen::Dynamic, Eigen::Dynamic>>;
+
+// Read-only ATen view of a cached dataset, see dataset_cache.h
+at::Tensor dataset_tensor(const std::shared_ptr<const float> &data,
+                          at::IntList shape) {
+  return at::from_blob((void *)data.get(), shape, at::CPU(at::kFloat));
+}
+
+// General benchmark setup: Inputs come from the dataset cache, the Eigen ones
+// filled like avx_sum.cpp and the ATen ones uniform like at::rand. Outputs
+// are allocated once and reset before every iteration. The calls run warm or
+// cold depending on CACHE_STATE, see cache_state.h. report_roofline counts
+// one flop per element, exp and log included, and as bytes the input plus
+// writes floats of output per element. ATen runs on the OpenMP threads.
 // Call the op once to warmup, once after outside timings to maintain lifespan.
 
 #define BM_BenchATenReduceOp(name, op)                                         \
   static void BM_ATen##name(benchmark::State &state, int64_t stride,           \
                             int64_t size__, int64_t iter) {                    \
+    double size_ = std::sqrt((double)(size__));                                \
+    int64_t size = (int64_t)(size_);                                           \
+    std::shared_ptr<const float> data =                                        \
+        dataset<float>({size, size, stride}, Fill::UNIFORM);                   \
+    OutputBuffer<float> out({size, stride}, Fill::UNIFORM);                    \
+    PerfCounters perf(PerfScope::PROCESS);                                     \
     for (auto _ : state) {                                                     \
       state.PauseTiming();                                                     \
       benchmark::ClobberMemory();                                              \
-      double size_ = std::sqrt((double)(size__));                              \
-      int size = (int)(size_);                                                 \
       state.counters["stride"] = stride;                                       \
       state.counters["size"] = size;                                           \
-      state.counters["iter"] = iter;                                           \
       benchmark::ClobberMemory();                                              \
-      at::Tensor a =                                                           \
-          at::rand({size, size, stride}, at::CPU(at::kFloat)).select(2, 0);    \
+      out.reset();                                                             \
+      at::Tensor a = dataset_tensor(data, {size, size, stride}).select(2, 0);  \
       at::Tensor b =                                                           \
-          at::rand({size, stride}, at::CPU(at::kFloat)).select(1, 0);          \
+          at::from_blob(out.data(), {size, stride}, at::CPU(at::kFloat))       \
+              .select(1, 0);                                                   \
       op;                                                                      \
       benchmark::ClobberMemory();                                              \
       benchmark::ClobberMemory();                                              \
-      state.ResumeTiming();                                                    \
-      for (int j = 0; j < iter; ++j) {                                         \
-        op;                                                                    \
-      }                                                                        \
-      state.PauseTiming();                                                     \
-      op;                                                                      \
-      benchmark::ClobberMemory();                                              \
-      benchmark::ClobberMemory();                                              \
-      state.ResumeTiming();                                                    \
+      time_and_report(                                                         \
+          state, iter, data.get(), size * size * stride * sizeof(float),       \
+          CallWork(size * size, size * size, size * size * sizeof(float)),     \
+          omp_get_max_threads(), perf, [&] { op; },                            \
+          [&] {                                                                \
+            op;                                                                \
+            benchmark::ClobberMemory();                                        \
+            benchmark::ClobberMemory();                                        \
+          });                                                                  \
     }                                                                          \
   }
 
-#define BM_BenchATenOp(name, op)                                               \
+#define BM_BenchATenOp(name, op, writes)                                       \
   static void BM_ATen##name(benchmark::State &state, int64_t stride,           \
                             int64_t size, int64_t iter) {                      \
+    std::shared_ptr<const float> data =                                        \
+        dataset<float>({size, stride}, Fill::UNIFORM);                         \
+    OutputBuffer<float> out({size, stride}, Fill::UNIFORM);                    \
+    PerfCounters perf(PerfScope::PROCESS);                                     \
     for (auto _ : state) {                                                     \
       state.PauseTiming();                                                     \
       benchmark::ClobberMemory();                                              \
       state.counters["stride"] = stride;                                       \
       state.counters["size"] = size;                                           \
-      state.counters["iter"] = iter;                                           \
-      at::Tensor a =                                                           \
-          at::rand({size, stride}, at::CPU(at::kFloat)).select(1, 0);          \
+      out.reset();                                                             \
+      at::Tensor a = dataset_tensor(data, {size, stride}).select(1, 0);        \
       at::Tensor b =                                                           \
-          at::rand({size, stride}, at::CPU(at::kFloat)).select(1, 0);          \
+          at::from_blob(out.data(), {size, stride}, at::CPU(at::kFloat))       \
+              .select(1, 0);                                                   \
       at::Tensor c;                                                            \
       op;                                                                      \
       benchmark::ClobberMemory();                                              \
       benchmark::ClobberMemory();                                              \
-      state.ResumeTiming();                                                    \
-      for (int j = 0; j < iter; ++j) {                                         \
-        op;                                                                    \
-      }                                                                        \
-      state.PauseTiming();                                                     \
-      op;                                                                      \
-      benchmark::ClobberMemory();                                              \
-      benchmark::ClobberMemory();                                              \
-      state.ResumeTiming();                                                    \
+      time_and_report(                                                         \
+          state, iter, data.get(), size * stride * sizeof(float),              \
+          CallWork(size, size, (1 + writes) * size * sizeof(float)),           \
+          omp_get_max_threads(), perf, [&] { op; },                            \
+          [&] {                                                                \
+            op;                                                                \
+            benchmark::ClobberMemory();                                        \
+            benchmark::ClobberMemory();                                        \
+          });                                                                  \
     }                                                                          \
   }
 
 #define BM_BenchEigenReduceOp(name, op, dim)                                   \
   static void BM_Eigen##name(benchmark::State &state, int64_t stride,          \
                              int64_t size__, int64_t iter) {                   \
+    double size_ = std::sqrt((double)(size__));                                \
+    int64_t size = (int64_t)(size_);                                           \
+    std::shared_ptr<const float> data = dataset<float>({size, size, stride});  \
+    OutputBuffer<float> out({size, stride});                                   \
+    PerfCounters perf(PerfScope::PROCESS);                                     \
     for (auto _ : state) {                                                     \
       state.PauseTiming();                                                     \
-      double size_ = std::sqrt((double)(size__));                              \
-      int size = (int)(size_);                                                 \
       state.counters["stride"] = stride;                                       \
       state.counters["size"] = size;                                           \
-      state.counters["iter"] = iter;                                           \
-      float *data_ = NULL;                                                     \
-      make_float_data(&data_, size *size *stride);                             \
-      make_vector(data_, size *size *stride);                                  \
-      float *out_data_ = NULL;                                                 \
-      make_float_data(&out_data_, size *stride);                               \
-      make_vector(out_data_, size *stride);                                    \
-      EigenMatrixMap<float> a(                                                 \
-          data_, size, size,                                                   \
+      out.reset();                                                             \
+      ConstEigenMatrixMap<float> a(                                            \
+          data.get(), size, size,                                              \
           Eigen::Stride<Eigen::Dynamic, Eigen::Dynamic>(1, stride));           \
       EigenVectorMap<float> b(                                                 \
-          out_data_, size,                                                     \
+          out.data(), size,                                                    \
           Eigen::Stride<Eigen::Dynamic, Eigen::Dynamic>(1, stride));           \
       op;                                                                      \
       benchmark::ClobberMemory();                                              \
       benchmark::ClobberMemory();                                              \
-      state.ResumeTiming();                                                    \
-      for (int j = 0; j < iter; ++j) {                                         \
-        op;                                                                    \
-      }                                                                        \
-      state.PauseTiming();                                                     \
-      op;                                                                      \
-      free(data_);                                                             \
-      free(out_data_);                                                         \
-      benchmark::ClobberMemory();                                              \
-      benchmark::ClobberMemory();                                              \
-      state.ResumeTiming();                                                    \
+      time_and_report(                                                         \
+          state, iter, data.get(), size * size * stride * sizeof(float),       \
+          CallWork(size * size, size * size, size * size * sizeof(float)), 1,  \
+          perf, [&] { op; },                                                   \
+          [&] {                                                                \
+            op;                                                                \
+            benchmark::ClobberMemory();                                        \
+            benchmark::ClobberMemory();                                        \
+          });                                                                  \
     }                                                                          \
   }
 
-#define BM_BenchEigenOp(name, op)                                              \
+#define BM_BenchEigenOp(name, op, writes)                                      \
   static void BM_Eigen##name(benchmark::State &state, int64_t stride,          \
                              int64_t size, int64_t iter) {                     \
+    std::shared_ptr<const float> data = dataset<float>({size, stride});        \
+    OutputBuffer<float> out({size, stride});                                   \
+    PerfCounters perf(PerfScope::PROCESS);                                     \
     for (auto _ : state) {                                                     \
       state.PauseTiming();                                                     \
       state.counters["stride"] = stride;                                       \
       state.counters["size"] = size;                                           \
-      state.counters["iter"] = iter;                                           \
-      float *data_ = NULL;                                                     \
-      make_float_data(&data_, size *stride);                                   \
-      make_vector(data_, size *stride);                                        \
-      float *out_data_ = NULL;                                                 \
-      make_float_data(&out_data_, size *stride);                               \
-      make_vector(out_data_, size *stride);                                    \
-      EigenVectorMap<float> a(                                                 \
-          data_, size,                                                         \
+      out.reset();                                                             \
+      ConstEigenVectorMap<float> a(                                            \
+          data.get(), size,                                                    \
           Eigen::Stride<Eigen::Dynamic, Eigen::Dynamic>(1, stride));           \
       EigenVectorMap<float> b(                                                 \
-          out_data_, size,                                                     \
+          out.data(), size,                                                    \
           Eigen::Stride<Eigen::Dynamic, Eigen::Dynamic>(1, stride));           \
       float c = get_random_value();                                            \
       op;                                                                      \
       benchmark::ClobberMemory();                                              \
       benchmark::ClobberMemory();                                              \
-      state.ResumeTiming();                                                    \
-      for (int j = 0; j < iter; ++j) {                                         \
-        op;                                                                    \
-      }                                                                        \
-      state.PauseTiming();                                                     \
-      c = do_something(c);                                                     \
-      op;                                                                      \
-      free(data_);                                                             \
-      free(out_data_);                                                         \
-      benchmark::ClobberMemory();                                              \
-      benchmark::ClobberMemory();                                              \
-      state.ResumeTiming();                                                    \
+      time_and_report(                                                         \
+          state, iter, data.get(), size * stride * sizeof(float),              \
+          CallWork(size, size, (1 + writes) * size * sizeof(float)), 1, perf,  \
+          [&] { op; },                                                         \
+          [&] {                                                                \
+            c = do_something(c);                                               \
+            op;                                                                \
+            benchmark::ClobberMemory();                                        \
+            benchmark::ClobberMemory();                                        \
+          });                                                                  \
     }                                                                          \
   }
 
 #define BM_BenchReduceOp(op)                                                   \
-  BM_BenchEigenOp(_reduce_##op, c += a.op());                                  \
+  BM_BenchEigenOp(_reduce_##op, c += a.op(), 0);                               \
   BM_BenchEigenReduceOp(_reduce_colwise_##op, b = a.colwise().op(), 0);        \
   BM_BenchEigenReduceOp(_reduce_rowwise_##op, b = a.rowwise().op(), 1);        \
-  BM_BenchATenOp(_reduce_##op, c = a.op());                                    \
+  BM_BenchATenOp(_reduce_##op, c = a.op(), 0);                                 \
   BM_BenchATenReduceOp(_reduce_colwise_##op, b = a.op(0));                     \
   BM_BenchATenReduceOp(_reduce_rowwise_##op, b = a.op(1));
 
 #define BM_BenchUnaryOp(op)                                                    \
-  BM_BenchEigenOp(_unary_##op, b = a.array().op());                            \
-  BM_BenchATenOp(_unary_##op, at::op##_out(b, a));
+  BM_BenchEigenOp(_unary_##op, b = a.array().op(), 1);                         \
+  BM_BenchATenOp(_unary_##op, at::op##_out(b, a), 1);
 
 #define BM_BenchUnaryWithSleefOp(op)                                           \
   static void BM_Sleef_##op(benchmark::State &state, int64_t size,             \
                             int64_t iter) {                                    \
+    std::shared_ptr<const float> data =                                        \
+        dataset<float>({size}, Fill::UNIFORM, _ALIGNMENT);                     \
+    OutputBuffer<float> out({size}, Fill::ZERO, _ALIGNMENT);                   \
+    PerfCounters perf(PerfScope::PROCESS);                                     \
     for (auto _ : state) {                                                     \
       state.PauseTiming();                                                     \
       benchmark::ClobberMemory();                                              \
       state.counters["stride"] = 1;                                            \
       state.counters["size"] = size;                                           \
-      state.counters["iter"] = iter;                                           \
-      float *a_ptr;                                                            \
-      float *b_ptr;                                                            \
-      int ret =                                                                \
-          posix_memalign((void **)&a_ptr, _ALIGNMENT, size * sizeof(float));   \
-      ret |=                                                                   \
-          posix_memalign((void **)&b_ptr, _ALIGNMENT, size * sizeof(float));   \
-      if (ret)                                                                 \
-        throw std::runtime_error("memory align failed");                       \
+      out.reset();                                                             \
+      const float *a_ptr = data.get();                                         \
+      float *b_ptr = out.data();                                               \
       int64_t vec_size = 8;                                                    \
       assert(size % _ALIGNMENT == 0);                                          \
       benchmark::ClobberMemory();                                              \
-      state.ResumeTiming();                                                    \
-      for (int j = 0; j < iter; ++j) {                                         \
-        int64_t d = 0;                                                         \
-        for (; d < size - (size % vec_size); d += vec_size) {                  \
-          __m256 values = _mm256_load_ps(a_ptr + d);                           \
-          values = Sleef_##op##f8_u10(values);                                 \
-          _mm256_store_ps(b_ptr + d, values);                                  \
-        }                                                                      \
-      }                                                                        \
+      time_and_report(state, iter, a_ptr, size * sizeof(float),                \
+                      CallWork(size, size, 2 * size * sizeof(float)), 1, perf, \
+                      [&] {                                                    \
+                        int64_t d = 0;                                         \
+                        for (; d < size - (size % vec_size); d += vec_size) {  \
+                          __m256 values = _mm256_load_ps(a_ptr + d);           \
+                          values = Sleef_##op##f8_u10(values);                 \
+                          _mm256_store_ps(b_ptr + d, values);                  \
+                        }                                                      \
+                      });                                                      \
     }                                                                          \
   }                                                                            \
   BM_BenchUnaryOp(op);
 
+// Reduction of one axis of a contiguous 3-d tensor. The shapes match
+// reducesum_nd_shapes() in avx_sum.cpp so the results line up with the tiled
+// reduction engine there.
+static void BM_ATen_reduce_sum_dim(benchmark::State &state,
+                                   std::vector<int64_t> shape, int64_t dim,
+                                   int64_t iter) {
+  std::shared_ptr<const float> data = dataset<float>(shape, Fill::UNIFORM);
+  PerfCounters perf(PerfScope::PROCESS);
+  for (auto _ : state) {
+    state.PauseTiming();
+    benchmark::ClobberMemory();
+    state.counters["stride"] = 1;
+    state.counters["size"] = shape[0] * shape[1] * shape[2];
+    state.counters["shape0"] = shape[0];
+    state.counters["shape1"] = shape[1];
+    state.counters["shape2"] = shape[2];
+    state.counters["reduce_dim"] = dim;
+    at::Tensor a = dataset_tensor(data, shape);
+    at::Tensor b = a.sum(dim);
+    benchmark::ClobberMemory();
+    int64_t size = shape_numel(shape);
+    time_and_report(
+        state, iter, data.get(), size * sizeof(float),
+        CallWork(size, size, size * sizeof(float)), omp_get_max_threads(),
+        perf, [&] { b = a.sum(dim); },
+        [&] {
+          b = a.sum(dim);
+          benchmark::ClobberMemory();
+        });
+  }
+}
+
+// ATen has no fused kernel for these, so this is the back to back baseline
+// for the fused stats_* and reducestats_* kernels in avx_sum.cpp: sum, sum of
+// squares, min, and max with argmax. The colwise variant reduces dim 0 of a
+// sqrt(size) x sqrt(size) matrix.
+static void BM_ATen_reduce_stats(benchmark::State &state, int64_t size,
+                                 int64_t iter, bool colwise) {
+  int64_t side = (int64_t)std::sqrt((double)size);
+  std::vector<int64_t> shape = colwise ? std::vector<int64_t>{side, side}
+                                       : std::vector<int64_t>{size};
+  std::shared_ptr<const float> data = dataset<float>(shape, Fill::UNIFORM);
+  PerfCounters perf(PerfScope::PROCESS);
+  for (auto _ : state) {
+    state.PauseTiming();
+    benchmark::ClobberMemory();
+    state.counters["stride"] = 1;
+    state.counters["size"] = colwise ? side : size;
+    at::Tensor a = dataset_tensor(data, shape);
+    at::Tensor sum, sumsq, min, max, argmax;
+    benchmark::ClobberMemory();
+    int64_t numel = shape_numel(shape);
+    // Flops of the fused kernels, _STATS_FLOPS in avx_sum.cpp, and the bytes
+    // they read, so that both sides are held against the same roofline
+    time_and_report(
+        state, iter, data.get(), numel * sizeof(float),
+        CallWork(numel, 5 * numel, numel * sizeof(float)),
+        omp_get_max_threads(), perf,
+        [&] {
+          sum = a.sum(0);
+          sumsq = a.pow(2).sum(0);
+          min = std::get<0>(a.min(0));
+          std::tie(max, argmax) = a.max(0);
+        },
+        [] { benchmark::ClobberMemory(); });
+  }
+}
+
 // Commented out means not supported
 // TODO: Add comparison between intrinsics and ATen
 BM_BenchReduceOp(sum);
@@ -264,6 +346,10 @@ int main(int argc, char **argv) {
   for (int64_t size = 32768; size < 64777264; size *= 2) {
     benchmark::RegisterBenchmark("BM_Sleef_log", &BM_Sleef_log, size, iter);
     benchmark::RegisterBenchmark("BM_Sleef_exp", &BM_Sleef_exp, size, iter);
+    benchmark::RegisterBenchmark("BM_ATen_reduce_stats", &BM_ATen_reduce_stats,
+                                 size, iter, false);
+    benchmark::RegisterBenchmark("BM_ATen_reduce_colwise_stats",
+                                 &BM_ATen_reduce_stats, size, iter, true);
     for (int64_t stride = 1; stride < 16; stride *= 2) {
       benchmark::RegisterBenchmark("BM_Eigen_unary_log", &BM_Eigen_unary_log,
                                    stride, size, iter);
@@ -316,7 +402,21 @@ int main(int argc, char **argv) {
                                    iter);
     }
   }
+  std::vector<std::vector<int64_t>> nd_shapes = {{256, 256, 256},
+                                                 {64, 1024, 256},
+                                                 {1024, 64, 256},
+                                                 {256, 1024, 64},
+                                                 {16, 16384, 64}};
+  for (const std::vector<int64_t> &shape : nd_shapes) {
+    for (int64_t dim = 0; dim < 3; dim++) {
+      benchmark::RegisterBenchmark("BM_ATen_reduce_sum_dim",
+                                   &BM_ATen_reduce_sum_dim, shape, dim, 16);
+    }
+  }
   benchmark::Initialize(&argc, argv);
+  // The ATen benchmarks run on the OpenMP threads, the Eigen and Sleef ones
+  // on one
+  register_rooflines({1, omp_get_max_threads()});
   benchmark::RunSpecifiedBenchmarks();
 }
 
@@ -0,0 +1,240 @@
+#pragma once
+
+// Process wide cache of benchmark inputs. Allocating and filling inputs of up
+// to 1GB in every benchmark iteration dominated the wall time of a sweep and
+// let the allocator leak into the measurement, so every input is materialized
+// once per
+//
+//   (dtype, shape, alignment, fill, allocation mode, NUMA policy)
+//
+// and shared as a read-only view by every benchmark that asks for it. The
+// shape is the layout, two shapes with the same number of elements are
+// different datasets. Mode and policy are part of the key since they decide
+// the page size and placement, see buffer_allocator.h.
+//
+// Datasets are handed out as shared_ptrs, so evicting one never pulls it from
+// under a running benchmark. The cache holds at most DATASET_CACHE_MB, half of
+// the physical memory by default, and drops the least recently used dataset
+// first.
+//
+// Outputs are written by the kernels and can't be shared. OutputBuffer keeps
+// a private copy that reset() restores from the cached dataset of the same
+// key.
+
+#include "buffer_allocator.h"
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <typeinfo>
+#include <vector>
+
+enum class Fill { ZERO = 0, RAMP, NORMAL, UNIFORM };
+
+// i % 1024, exact in every dtype
+template <typename T> void make_vector(T *data_, size_t size) {
+  for (size_t i = 0; i < size; i++) {
+    data_[i] = (T)(i % 1024);
+  }
+}
+
+template <typename T> void make_random_vector(T *data_, size_t size) {
+  // Fixed seed, the self tests compare float sums at a relative tolerance and
+  // would fail whenever a fresh draw happens to sum to almost zero.
+  std::mt19937 gen(1234); // Standard mersenne_twister_engine
+  std::normal_distribution<> dis{0, 1};
+  // Integers get a wider range so that they don't round to mostly zeros
+  double scale = std::is_integral<T>::value ? 1000 : 1;
+  for (size_t i = 0; i < size; i++) {
+    data_[i] = (T)(dis(gen) * scale);
+  }
+}
+
+// [0, 1) like at::rand, for the ATen and Sleef inputs
+template <typename T> void make_uniform_vector(T *data_, size_t size) {
+  std::mt19937 gen(1234);
+  std::uniform_real_distribution<> dis(0, 1);
+  for (size_t i = 0; i < size; i++) {
+    data_[i] = (T)dis(gen);
+  }
+}
+
+template <typename T> void fill_vector(T *data_, size_t size, Fill fill) {
+  switch (fill) {
+  case Fill::RAMP:
+    make_vector(data_, size);
+    break;
+  case Fill::NORMAL:
+    make_random_vector(data_, size);
+    break;
+  case Fill::UNIFORM:
+    make_uniform_vector(data_, size);
+    break;
+  default:
+    memset(data_, 0, size * sizeof(T));
+  }
+}
+
+inline int64_t shape_numel(const std::vector<int64_t> &shape) {
+  int64_t numel = 1;
+  for (int64_t s : shape) {
+    numel *= s;
+  }
+  return numel;
+}
+
+struct DatasetKey {
+  std::string dtype;
+  std::vector<int64_t> shape;
+  size_t alignment;
+  Fill fill;
+  AllocMode mode;
+  NumaPolicy policy;
+
+  bool operator<(const DatasetKey &other) const {
+    return std::tie(dtype, shape, alignment, fill, mode, policy) <
+           std::tie(other.dtype, other.shape, other.alignment, other.fill,
+                    other.mode, other.policy);
+  }
+};
+
+template <typename T>
+DatasetKey make_dataset_key(const std::vector<int64_t> &shape, Fill fill,
+                            size_t alignment) {
+  return {typeid(T).name(), shape,
+          std::max(alignment, _BUFFER_ALIGNMENT), fill,
+          current_alloc_mode(), current_numa_policy()};
+}
+
+// Buffer of bytes aligned to alignment, a power of two. alloc_buffer already
+// gives 64 bytes, larger alignments over-allocate and free the base pointer.
+inline std::shared_ptr<void> alloc_shared_buffer(size_t bytes,
+                                                 size_t alignment) {
+  if (alignment <= _BUFFER_ALIGNMENT) {
+    return std::shared_ptr<void>(alloc_buffer(bytes), free_buffer);
+  }
+  void *base = alloc_buffer(bytes + alignment);
+  uintptr_t aligned = round_up_bytes((uintptr_t)base, alignment);
+  return std::shared_ptr<void>((void *)aligned,
+                               [base](void *) { free_buffer(base); });
+}
+
+// Default capacity, half of the physical memory
+inline size_t default_dataset_cache_bytes() {
+  const char *mb = std::getenv("DATASET_CACHE_MB");
+  if (mb != NULL) {
+    return (size_t)std::atol(mb) << 20;
+  }
+  return (size_t)sysconf(_SC_PHYS_PAGES) * sysconf(_SC_PAGESIZE) / 2;
+}
+
+class DatasetCache {
+  struct Entry {
+    std::shared_ptr<void> data;
+    size_t bytes;
+    int64_t last_use;
+  };
+
+  std::map<DatasetKey, Entry> entries_;
+  size_t bytes_ = 0;
+  size_t capacity_;
+  int64_t clock_ = 0;
+  std::mutex mutex_;
+
+  // Makes room for bytes more, a dataset larger than the capacity is still
+  // handed out but not kept
+  void evict(size_t bytes) {
+    while (!entries_.empty() && bytes_ + bytes > capacity_) {
+      auto oldest = entries_.begin();
+      for (auto it = entries_.begin(); it != entries_.end(); it++) {
+        if (it->second.last_use < oldest->second.last_use) {
+          oldest = it;
+        }
+      }
+      bytes_ -= oldest->second.bytes;
+      entries_.erase(oldest);
+    }
+  }
+
+public:
+  explicit DatasetCache(size_t capacity) : capacity_(capacity) {}
+
+  template <typename T>
+  std::shared_ptr<const T> get(const std::vector<int64_t> &shape, Fill fill,
+                               size_t alignment) {
+    DatasetKey key = make_dataset_key<T>(shape, fill, alignment);
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = entries_.find(key);
+    if (it == entries_.end()) {
+      size_t bytes = shape_numel(shape) * sizeof(T);
+      evict(bytes);
+      std::shared_ptr<void> data = alloc_shared_buffer(bytes, key.alignment);
+      fill_vector((T *)data.get(), shape_numel(shape), fill);
+      if (bytes > capacity_) {
+        return std::static_pointer_cast<const T>(data);
+      }
+      it = entries_.insert({key, {data, bytes, 0}}).first;
+      bytes_ += bytes;
+    }
+    it->second.last_use = clock_++;
+    return std::static_pointer_cast<const T>(it->second.data);
+  }
+
+  void clear() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    entries_.clear();
+    bytes_ = 0;
+  }
+
+  size_t bytes() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return bytes_;
+  }
+};
+
+inline DatasetCache &dataset_cache() {
+  static DatasetCache cache(default_dataset_cache_bytes());
+  return cache;
+}
+
+// Read-only input of shape, filled with fill and aligned to alignment bytes
+template <typename T>
+std::shared_ptr<const T> dataset(const std::vector<int64_t> &shape,
+                                 Fill fill = Fill::RAMP,
+                                 size_t alignment = _BUFFER_ALIGNMENT) {
+  return dataset_cache().get<T>(shape, fill, alignment);
+}
+
+// Writable buffer that starts out, and is reset to, the dataset of the same
+// key. Allocated once per benchmark rather than once per iteration.
+template <typename T> class OutputBuffer {
+  std::shared_ptr<const T> initial_;
+  std::shared_ptr<void> data_;
+  size_t size_;
+
+public:
+  explicit OutputBuffer(const std::vector<int64_t> &shape,
+                        Fill fill = Fill::RAMP,
+                        size_t alignment = _BUFFER_ALIGNMENT)
+      : initial_(dataset<T>(shape, fill, alignment)),
+        data_(alloc_shared_buffer(shape_numel(shape) * sizeof(T),
+                                  std::max(alignment, _BUFFER_ALIGNMENT))),
+        size_(shape_numel(shape)) {
+    reset();
+  }
+
+  T *data() { return (T *)data_.get(); }
+  size_t size() const { return size_; }
+
+  void reset() { memcpy(data_.get(), initial_.get(), size_ * sizeof(T)); }
+};
@@ -0,0 +1,349 @@
+#include "immintrin.h"
+#include "runtime_env.h"
+#include "tbb/blocked_range.h"
+#include "tbb/parallel_for.h"
+#include "tbb/parallel_reduce.h"
+#include "tbb/task_scheduler_init.h"
+#include "work_stealing_pool.h"
+#include <benchmark/benchmark.h>
+#include <omp.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Fixed cost of entering and leaving a parallel region, per runtime. Every
+// benchmark iteration times exactly one region, the latency distribution over
+// the iterations is reported as counters in nanoseconds.
+//
+// OMP_WAIT_POLICY and KMP_BLOCKTIME are swept by run_fork_join.py, see
+// runtime_env.h. The persistent pool takes its spin count directly.
+//
+// grain_elements converts the median latency into the number of floats one
+// core sums in the same time, the smallest chunk for which a region can pay
+// off at all. The rate it uses is reported as sum_per_ns.
+
+using region_fn = std::function<void(int64_t)>;
+
+// Floats summed per nanosecond by one core on an L1 resident buffer, with four
+// AVX accumulators like sum_simple_128 in avx_sum.cpp so that the adds
+// pipeline instead of waiting on each other
+double sum_rate() {
+  static double rate = [] {
+    std::vector<float> data(4096, 1);
+    int64_t reps = 20000;
+    __m256 acc[4];
+    for (int j = 0; j < 4; j++) {
+      acc[j] = _mm256_setzero_ps();
+    }
+    auto start = std::chrono::steady_clock::now();
+    for (int64_t r = 0; r < reps; r++) {
+      for (size_t i = 0; i < data.size(); i += 32) {
+        for (int j = 0; j < 4; j++) {
+          acc[j] = _mm256_add_ps(acc[j], _mm256_loadu_ps(&data[i + 8 * j]));
+        }
+      }
+      benchmark::DoNotOptimize(acc);
+    }
+    std::chrono::duration<double, std::nano> elapsed =
+        std::chrono::steady_clock::now() - start;
+    return reps * data.size() / elapsed.count();
+  }();
+  return rate;
+}
+
+double percentile(std::vector<double> &samples, double p) {
+  size_t k = std::min(samples.size() - 1, (size_t)(p * samples.size()));
+  std::nth_element(samples.begin(), samples.begin() + k, samples.end());
+  return samples[k];
+}
+
+static void BM_FORK_JOIN(benchmark::State &state, int64_t num_thread,
+                         int64_t spin_count, region_fn region) {
+  tbb::task_scheduler_init init(num_thread);
+  omp_set_num_threads(num_thread);
+  // Warm up, thread creation is not what we are after
+  for (int i = 0; i < 16; i++) {
+    region(num_thread);
+  }
+  std::vector<double> samples;
+  for (auto _ : state) {
+    auto start = std::chrono::steady_clock::now();
+    region(num_thread);
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+    state.SetIterationTime(elapsed.count());
+    samples.push_back(elapsed.count() * 1e9);
+  }
+  state.counters["num_thread"] = num_thread;
+  state.counters["omp_wait_policy"] = omp_wait_policy();
+  state.counters["kmp_blocktime"] = kmp_blocktime();
+  state.counters["spin_count"] = spin_count;
+  state.counters["min_ns"] = *std::min_element(samples.begin(), samples.end());
+  state.counters["p50_ns"] = percentile(samples, 0.5);
+  state.counters["p90_ns"] = percentile(samples, 0.9);
+  state.counters["p99_ns"] = percentile(samples, 0.99);
+  state.counters["max_ns"] = *std::max_element(samples.begin(), samples.end());
+  state.counters["sum_per_ns"] = sum_rate();
+  state.counters["grain_elements"] = state.counters["p50_ns"] * sum_rate();
+  init.terminate();
+}
+
+void omp_parallel_empty(int64_t num_thread) {
+#pragma omp parallel num_threads(num_thread)
+  { benchmark::ClobberMemory(); }
+}
+
+// One iteration per thread
+void omp_parallel_for(int64_t num_thread) {
+#pragma omp parallel for num_threads(num_thread) schedule(static, 1)
+  for (int64_t i = 0; i < num_thread; i++) {
+    benchmark::DoNotOptimize(i);
+  }
+}
+
+void omp_parallel_reduce(int64_t num_thread) {
+  int64_t sum = 0;
+#pragma omp parallel for num_threads(num_thread) reduction(+ : sum)
+  for (int64_t i = 0; i < num_thread; i++) {
+    sum += i;
+  }
+  benchmark::DoNotOptimize(sum);
+}
+
+void tbb_parallel_for(int64_t num_thread) {
+  tbb::parallel_for(tbb::blocked_range<int64_t>(0, num_thread, 1),
+                    [](const tbb::blocked_range<int64_t> &r) {
+                      int64_t b = r.begin();
+                      benchmark::DoNotOptimize(b);
+                    },
+                    tbb::simple_partitioner());
+}
+
+void tbb_parallel_reduce(int64_t num_thread) {
+  int64_t sum = tbb::parallel_reduce(
+      tbb::blocked_range<int64_t>(0, num_thread, 1), int64_t(0),
+      [](const tbb::blocked_range<int64_t> &r, int64_t init) {
+        return init + r.begin();
+      },
+      std::plus<int64_t>(), tbb::simple_partitioner());
+  benchmark::DoNotOptimize(sum);
+}
+
+// No runtime at all, the threads are created and joined every time
+void std_thread_spawn_join(int64_t num_thread) {
+  std::vector<std::thread> threads;
+  for (int64_t t = 1; t < num_thread; t++) {
+    threads.emplace_back([t] {
+      int64_t i = t;
+      benchmark::DoNotOptimize(i);
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+}
+
+region_fn ws_parallel_for(ws::WorkStealingPool &pool) {
+  return [&pool](int64_t num_thread) {
+    ws::parallel_for(pool, 0, num_thread, 1, [](int64_t b, int64_t e) {
+      (void)e;
+      benchmark::DoNotOptimize(b);
+    });
+  };
+}
+
+// RUNTIME STARTUP AND RESIZING
+
+// BM_FORK_JOIN warms up before timing, these time what it leaves out. Every
+// iteration records the first region after
+//  BM_RUNTIME_STARTUP  the runtime was brought up from nothing
+//  BM_RUNTIME_SWITCH   the thread count changed from from_thread to num_thread
+// steady_ns is the median of the regions that follow in the same
+// configuration, overhead_ns is what the first region costs on top of that.
+// TBB is resized the way task_scheduler_init allows, by replacing it.
+
+// omp_pause_resource_all is OpenMP 5.0, libgomp has it since GCC 9 but still
+// reports 4.5
+#if _OPENMP >= 201811 || (defined(__GNUC__) && !defined(__clang__) &&         \
+                          __GNUC__ >= 9)
+#define HAS_OMP_PAUSE_RESOURCE 1
+#endif
+
+enum class Runtime { OMP, TBB };
+
+std::string runtime_name(Runtime runtime) {
+  return runtime == Runtime::OMP ? "omp" : "tbb";
+}
+
+// Regions timed in the configuration reached, after the first one
+constexpr int64_t _STEADY_REGIONS = 16;
+
+void runtime_region(Runtime runtime, int64_t num_thread) {
+  if (runtime == Runtime::OMP) {
+    omp_parallel_empty(num_thread);
+  } else {
+    tbb_parallel_for(num_thread);
+  }
+}
+
+double region_ns(Runtime runtime, int64_t num_thread) {
+  auto start = std::chrono::steady_clock::now();
+  runtime_region(runtime, num_thread);
+  std::chrono::duration<double, std::nano> elapsed =
+      std::chrono::steady_clock::now() - start;
+  return elapsed.count();
+}
+
+double steady_region_ns(Runtime runtime, int64_t num_thread) {
+  std::vector<double> samples;
+  for (int64_t i = 0; i < _STEADY_REGIONS; i++) {
+    samples.push_back(region_ns(runtime, num_thread));
+  }
+  return percentile(samples, 0.5);
+}
+
+void configure_runtime(Runtime runtime, int64_t num_thread,
+                       std::unique_ptr<tbb::task_scheduler_init> &init) {
+  if (runtime == Runtime::OMP) {
+    omp_set_num_threads(num_thread);
+  } else {
+    init.reset();
+    init.reset(new tbb::task_scheduler_init(num_thread));
+  }
+}
+
+void report_first_region(benchmark::State &state, int64_t from_thread,
+                         int64_t num_thread, std::vector<double> &first,
+                         std::vector<double> &steady) {
+  state.counters["num_thread"] = num_thread;
+  state.counters["from_thread"] = from_thread;
+  state.counters["omp_wait_policy"] = omp_wait_policy();
+  state.counters["kmp_blocktime"] = kmp_blocktime();
+  state.counters["first_ns"] = percentile(first, 0.5);
+  state.counters["max_first_ns"] =
+      *std::max_element(first.begin(), first.end());
+  state.counters["steady_ns"] = percentile(steady, 0.5);
+  state.counters["overhead_ns"] =
+      state.counters["first_ns"] - state.counters["steady_ns"];
+}
+
+static void BM_RUNTIME_STARTUP(benchmark::State &state, int64_t num_thread,
+                               Runtime runtime) {
+#ifndef HAS_OMP_PAUSE_RESOURCE
+  if (runtime == Runtime::OMP) {
+    state.SkipWithError("OpenMP can't be shut down before 5.0");
+    return;
+  }
+#endif
+  std::vector<double> first;
+  std::vector<double> steady;
+  for (auto _ : state) {
+    std::unique_ptr<tbb::task_scheduler_init> init;
+    auto start = std::chrono::steady_clock::now();
+    configure_runtime(runtime, num_thread, init);
+    runtime_region(runtime, num_thread);
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+    state.SetIterationTime(elapsed.count());
+    first.push_back(elapsed.count() * 1e9);
+    steady.push_back(steady_region_ns(runtime, num_thread));
+    // Shut the runtime down again. TBB workers leave asynchronously, give
+    // them a moment.
+    if (runtime == Runtime::OMP) {
+#ifdef HAS_OMP_PAUSE_RESOURCE
+      omp_pause_resource_all(omp_pause_hard);
+#endif
+    } else {
+      init.reset();
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+  }
+  report_first_region(state, 0, num_thread, first, steady);
+}
+
+static void BM_RUNTIME_SWITCH(benchmark::State &state, int64_t from_thread,
+                              int64_t num_thread, Runtime runtime) {
+  std::unique_ptr<tbb::task_scheduler_init> init;
+  std::vector<double> first;
+  std::vector<double> steady;
+  for (auto _ : state) {
+    configure_runtime(runtime, from_thread, init);
+    steady_region_ns(runtime, from_thread);
+    auto start = std::chrono::steady_clock::now();
+    configure_runtime(runtime, num_thread, init);
+    runtime_region(runtime, num_thread);
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+    state.SetIterationTime(elapsed.count());
+    first.push_back(elapsed.count() * 1e9);
+    steady.push_back(steady_region_ns(runtime, num_thread));
+  }
+  report_first_region(state, from_thread, num_thread, first, steady);
+}
+
+int main(int argc, char **argv) {
+  std::map<std::string, region_fn> regions = {
+      {"omp_parallel_empty", &omp_parallel_empty},
+      {"omp_parallel_for", &omp_parallel_for},
+      {"omp_parallel_reduce", &omp_parallel_reduce},
+      {"tbb_parallel_for", &tbb_parallel_for},
+      {"tbb_parallel_reduce", &tbb_parallel_reduce},
+      {"std_thread_spawn_join", &std_thread_spawn_join}};
+
+  int64_t max_nt = std::max<int64_t>(std::thread::hardware_concurrency(), 2);
+  std::vector<int64_t> num_threads;
+  for (int64_t nt = 1; nt < max_nt; nt *= 2) {
+    num_threads.push_back(nt);
+  }
+  num_threads.push_back(max_nt);
+
+  // The pools outlive the benchmarks. Spin count 0 sleeps right away, like
+  // OMP_WAIT_POLICY=passive.
+  std::vector<int64_t> spin_counts = {0, 1 << 10, ws::_DEFAULT_SPIN_COUNT};
+  std::vector<std::unique_ptr<ws::WorkStealingPool>> pools;
+
+  for (int64_t nt : num_threads) {
+    for (auto &kv : regions) {
+      benchmark::RegisterBenchmark(kv.first.c_str(), &BM_FORK_JOIN, nt, -1,
+                                   kv.second)
+          ->UseManualTime()
+          ->Iterations(10000);
+    }
+    for (int64_t spin_count : spin_counts) {
+      pools.emplace_back(new ws::WorkStealingPool(nt, spin_count));
+      benchmark::RegisterBenchmark("ws_parallel_for", &BM_FORK_JOIN, nt,
+                                   spin_count, ws_parallel_for(*pools.back()))
+          ->UseManualTime()
+          ->Iterations(10000);
+    }
+  }
+
+  for (Runtime runtime : {Runtime::OMP, Runtime::TBB}) {
+    std::string startup = "runtime_startup_" + runtime_name(runtime);
+    std::string change = "runtime_switch_" + runtime_name(runtime);
+    for (int64_t nt : num_threads) {
+      benchmark::RegisterBenchmark(startup.c_str(), &BM_RUNTIME_STARTUP, nt,
+                                   runtime)
+          ->UseManualTime()
+          ->Iterations(100);
+      for (int64_t from : num_threads) {
+        if (from != nt) {
+          benchmark::RegisterBenchmark(change.c_str(), &BM_RUNTIME_SWITCH,
+                                       from, nt, runtime)
+              ->UseManualTime()
+              ->Iterations(100);
+        }
+      }
+    }
+  }
+
+  benchmark::Initialize(&argc, argv);
+  benchmark::RunSpecifiedBenchmarks();
+}
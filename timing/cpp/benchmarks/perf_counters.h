@@ -0,0 +1,356 @@
+#pragma once
+
+// Hardware counters around the timed region, through perf_event_open. Every
+// counted thread gets one group
+//
+//   cycles, instructions, L1D read misses, LLC read misses, dTLB read misses,
+//   branch misses
+//
+// so that the ratios between them come from the same time slices even when the
+// kernel multiplexes. The values are scaled by time enabled over time running.
+// DRAM reads come from the uncore_imc PMUs where the kernel exposes them,
+// which needs perf_event_paranoid <= 0 or CAP_PERFMON; the per thread counters
+// only count user space and work up to perf_event_paranoid 2.
+//
+// THREAD counts the calling thread. PROCESS counts every thread alive when the
+// counters are created, so the worker pools have to be up by then, see
+// warm_up_runtimes in avx_sum.cpp. Threads started later are not counted.
+//
+// Counting is toggled with prctl(PR_TASK_PERF_EVENTS_ENABLE), which flips all
+// events the calling thread opened in one syscall. resume() and pause()
+// therefore have to be called from the thread that created the counters.
+//
+// Counters that can't be opened, e.g. in a VM without a virtual PMU, are
+// reported as -1 like any other n/a counter.
+
+#include <benchmark/benchmark.h>
+#include <dirent.h>
+#include <linux/perf_event.h>
+#include <sys/prctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+enum class PerfScope { THREAD = 0, PROCESS };
+
+enum PerfEvent {
+  PERF_CYCLES = 0,
+  PERF_INSTRUCTIONS,
+  PERF_L1D_MISSES,
+  PERF_LLC_MISSES,
+  PERF_DTLB_MISSES,
+  PERF_BRANCH_MISSES,
+  PERF_DRAM_READS,
+  _NUM_PERF_EVENTS
+};
+
+// Every uncore_imc CAS read moves one 64 byte line
+constexpr double _DRAM_READ_BYTES = 64;
+
+inline uint64_t perf_cache_config(uint64_t cache, uint64_t op,
+                                  uint64_t result) {
+  return cache | (op << 8) | (result << 16);
+}
+
+inline int perf_event_open(perf_event_attr *attr, pid_t pid, int cpu,
+                           int group_fd, unsigned long flags) {
+  return syscall(__NR_perf_event_open, attr, pid, cpu, group_fd, flags);
+}
+
+inline std::vector<pid_t> process_threads() {
+  std::vector<pid_t> tids;
+  DIR *dir = opendir("/proc/self/task");
+  if (dir == NULL) {
+    return tids;
+  }
+  while (dirent *entry = readdir(dir)) {
+    if (entry->d_name[0] != '.') {
+      tids.push_back(std::atoi(entry->d_name));
+    }
+  }
+  closedir(dir);
+  return tids;
+}
+
+// "event=0x04,umask=0x03" as found in the sysfs events directory. The IMC
+// PMUs put event in config:0-7 and umask in config:8-15.
+inline uint64_t parse_uncore_config(const std::string &s) {
+  uint64_t config = 0;
+  size_t begin = 0;
+  while (begin < s.size()) {
+    size_t end = s.find(',', begin);
+    end = end == std::string::npos ? s.size() : end;
+    std::string term = s.substr(begin, end - begin);
+    size_t eq = term.find('=');
+    if (eq != std::string::npos) {
+      uint64_t value = std::strtoull(term.c_str() + eq + 1, NULL, 0);
+      if (term.compare(0, eq, "event") == 0) {
+        config |= value & 0xff;
+      } else if (term.compare(0, eq, "umask") == 0) {
+        config |= (value & 0xff) << 8;
+      }
+    }
+    begin = end + 1;
+  }
+  return config;
+}
+
+// "0,28" or "0-1,28" as found in a PMU's cpumask, one CPU per socket for the
+// uncore PMUs
+inline std::vector<int> parse_cpu_list(const std::string &s) {
+  std::vector<int> cpus;
+  size_t begin = 0;
+  while (begin < s.size()) {
+    size_t end = s.find(',', begin);
+    end = end == std::string::npos ? s.size() : end;
+    std::string range = s.substr(begin, end - begin);
+    size_t dash = range.find('-');
+    int first = std::atoi(range.c_str());
+    int last = dash == std::string::npos ? first
+                                         : std::atoi(range.c_str() + dash + 1);
+    for (int cpu = first; cpu <= last && !range.empty(); cpu++) {
+      cpus.push_back(cpu);
+    }
+    begin = end + 1;
+  }
+  return cpus;
+}
+
+class PerfCounters {
+  struct Group {
+    std::vector<int> fds;
+    std::vector<PerfEvent> events;
+  };
+
+  std::vector<Group> groups_;
+  std::vector<int> uncore_fds_;
+  int64_t calls_ = 0;
+
+  static perf_event_attr make_attr(uint32_t type, uint64_t config) {
+    perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED |
+                       PERF_FORMAT_TOTAL_TIME_RUNNING;
+    return attr;
+  }
+
+  void open_group(pid_t tid) {
+    struct {
+      PerfEvent event;
+      uint32_t type;
+      uint64_t config;
+    } specs[] = {
+        {PERF_CYCLES, PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+        {PERF_INSTRUCTIONS, PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+        {PERF_L1D_MISSES, PERF_TYPE_HW_CACHE,
+         perf_cache_config(PERF_COUNT_HW_CACHE_L1D, PERF_COUNT_HW_CACHE_OP_READ,
+                           PERF_COUNT_HW_CACHE_RESULT_MISS)},
+        {PERF_LLC_MISSES, PERF_TYPE_HW_CACHE,
+         perf_cache_config(PERF_COUNT_HW_CACHE_LL, PERF_COUNT_HW_CACHE_OP_READ,
+                           PERF_COUNT_HW_CACHE_RESULT_MISS)},
+        {PERF_DTLB_MISSES, PERF_TYPE_HW_CACHE,
+         perf_cache_config(PERF_COUNT_HW_CACHE_DTLB,
+                           PERF_COUNT_HW_CACHE_OP_READ,
+                           PERF_COUNT_HW_CACHE_RESULT_MISS)},
+        {PERF_BRANCH_MISSES, PERF_TYPE_HARDWARE,
+         PERF_COUNT_HW_BRANCH_MISSES},
+    };
+    Group group;
+    for (auto &spec : specs) {
+      perf_event_attr attr = make_attr(spec.type, spec.config);
+      int leader = group.fds.empty() ? -1 : group.fds[0];
+      int fd = perf_event_open(&attr, tid, -1, leader, 0);
+      if (fd < 0) {
+        // Without the cycles leader there is no group
+        if (group.fds.empty()) {
+          return;
+        }
+        continue;
+      }
+      group.fds.push_back(fd);
+      group.events.push_back(spec.event);
+    }
+    groups_.push_back(group);
+  }
+
+  void open_uncore() {
+    DIR *dir = opendir("/sys/bus/event_source/devices");
+    if (dir == NULL) {
+      return;
+    }
+    while (dirent *entry = readdir(dir)) {
+      std::string name(entry->d_name);
+      if (name.compare(0, 11, "uncore_imc_") != 0) {
+        continue;
+      }
+      std::string path = "/sys/bus/event_source/devices/" + name;
+      uint32_t type = 0;
+      std::string event;
+      std::string cpumask;
+      std::ifstream(path + "/type") >> type;
+      std::ifstream(path + "/events/cas_count_read") >> event;
+      std::ifstream(path + "/cpumask") >> cpumask;
+      if (type == 0 || event.empty()) {
+        continue;
+      }
+      perf_event_attr attr = make_attr(type, parse_uncore_config(event));
+      attr.exclude_kernel = 0;
+      attr.exclude_hv = 0;
+      attr.read_format =
+          PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+      // Every socket has its own IMCs under the same PMU name, counted
+      // through the CPU the cpumask lists for it
+      for (int cpu : parse_cpu_list(cpumask)) {
+        int fd = perf_event_open(&attr, -1, cpu, -1, 0);
+        if (fd >= 0) {
+          uncore_fds_.push_back(fd);
+        }
+      }
+    }
+    closedir(dir);
+  }
+
+  // -1 when the counter never got on the PMU, e.g. because the NMI watchdog
+  // holds a general purpose counter or the group doesn't fit
+  static double scaled(uint64_t value, uint64_t enabled, uint64_t running) {
+    return running > 0 ? (double)value * enabled / running : -1;
+  }
+
+public:
+  explicit PerfCounters(PerfScope scope) {
+    if (scope == PerfScope::THREAD) {
+      open_group(0);
+    } else {
+      for (pid_t tid : process_threads()) {
+        open_group(tid);
+      }
+    }
+    open_uncore();
+  }
+
+  PerfCounters(const PerfCounters &) = delete;
+  PerfCounters &operator=(const PerfCounters &) = delete;
+
+  ~PerfCounters() {
+    for (auto &group : groups_) {
+      for (int fd : group.fds) {
+        close(fd);
+      }
+    }
+    for (int fd : uncore_fds_) {
+      close(fd);
+    }
+  }
+
+  bool available() const { return !groups_.empty(); }
+
+  void resume() {
+    if (available() || !uncore_fds_.empty()) {
+      prctl(PR_TASK_PERF_EVENTS_ENABLE);
+    }
+  }
+
+  void pause() {
+    if (available() || !uncore_fds_.empty()) {
+      prctl(PR_TASK_PERF_EVENTS_DISABLE);
+    }
+  }
+
+  // Calls made while counting, for the per element counters
+  void count_calls(int64_t calls) { calls_ += calls; }
+
+  // Totals over all counted threads, -1 for events no thread could count
+  std::vector<double> read() const {
+    std::vector<double> totals(_NUM_PERF_EVENTS, -1);
+    for (auto &group : groups_) {
+      std::vector<uint64_t> buffer(3 + group.fds.size());
+      ssize_t bytes = ::read(group.fds[0], buffer.data(),
+                             buffer.size() * sizeof(uint64_t));
+      if (bytes < (ssize_t)(3 * sizeof(uint64_t))) {
+        continue;
+      }
+      for (size_t i = 0; i < group.events.size() && i < buffer[0]; i++) {
+        double value = scaled(buffer[3 + i], buffer[1], buffer[2]);
+        double &total = totals[group.events[i]];
+        if (value >= 0) {
+          total = std::max(total, 0.0) + value;
+        }
+      }
+    }
+    for (int fd : uncore_fds_) {
+      uint64_t buffer[3];
+      if (::read(fd, buffer, sizeof(buffer)) != sizeof(buffer)) {
+        continue;
+      }
+      double value = scaled(buffer[0], buffer[1], buffer[2]);
+      double &total = totals[PERF_DRAM_READS];
+      if (value >= 0) {
+        total = std::max(total, 0.0) + value;
+      }
+    }
+    return totals;
+  }
+
+  // Publishes the ratios as user counters. elements and bytes are what one
+  // call processes and moves, bytes 0 if a call doesn't touch memory.
+  void report(benchmark::State &state, int64_t elements, int64_t bytes) const {
+    std::vector<double> totals = read();
+    double cycles = totals[PERF_CYCLES];
+    double instructions = totals[PERF_INSTRUCTIONS];
+    double total_elements = (double)elements * calls_;
+    double total_bytes = (double)bytes * calls_;
+    auto per_element = [&](double value) {
+      return value >= 0 && total_elements > 0 ? value / total_elements : -1;
+    };
+    state.counters["ipc"] =
+        cycles > 0 && instructions >= 0 ? instructions / cycles : -1;
+    state.counters["bytes_per_cycle"] =
+        cycles > 0 && total_bytes > 0 ? total_bytes / cycles : -1;
+    state.counters["cycles_per_elem"] = per_element(cycles);
+    state.counters["l1d_miss_per_elem"] = per_element(totals[PERF_L1D_MISSES]);
+    state.counters["llc_miss_per_elem"] = per_element(totals[PERF_LLC_MISSES]);
+    state.counters["dtlb_miss_per_elem"] =
+        per_element(totals[PERF_DTLB_MISSES]);
+    state.counters["branch_miss_per_elem"] =
+        per_element(totals[PERF_BRANCH_MISSES]);
+    double dram_reads = totals[PERF_DRAM_READS];
+    state.counters["dram_bytes_per_elem"] =
+        per_element(dram_reads >= 0 ? dram_reads * _DRAM_READ_BYTES : -1);
+  }
+};
+
+// Counts from construction to destruction, one call per benchmark iteration.
+// For the benchmarks that time the bare state loop.
+class ScopedPerfCounters {
+  PerfCounters perf_;
+  benchmark::State &state_;
+  int64_t elements_;
+  int64_t bytes_;
+
+public:
+  explicit ScopedPerfCounters(benchmark::State &state, int64_t elements = 1,
+                              int64_t bytes = 0,
+                              PerfScope scope = PerfScope::THREAD)
+      : perf_(scope), state_(state), elements_(elements), bytes_(bytes) {
+    perf_.resume();
+  }
+
+  ~ScopedPerfCounters() {
+    perf_.pause();
+    perf_.count_calls(state_.iterations());
+    perf_.report(state_, elements_, bytes_);
+  }
+};
@@ -0,0 +1,112 @@
+#include "dataset_cache.h"
+#include "roofline.h"
+#include <benchmark/benchmark.h>
+#include <numa.h>
+#include <omp.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Calibration suite behind roofline.h. Every iteration times one pass.
+//
+//  stream_*     STREAM copy, scale, add and triad per thread count, with the
+//               threads and their first touched pages on one NUMA node, or
+//               unbound for node -1. gb_per_s is the best pass, as STREAM
+//               reports it.
+//  peak_fma     FMA throughput per thread count
+//  intensity_N  N FMAs per loaded float over a STREAM sized buffer, 2N flops
+//               per 4 bytes. Low N sits on the bandwidth ceiling, high N on
+//               the compute ceiling, pct_roofline says how close each gets.
+
+static void BM_STREAM(benchmark::State &state, StreamKernel kernel,
+                      int64_t num_thread, int node) {
+  StreamArrays arrays(stream_size(), num_thread, node);
+  double best = std::numeric_limits<double>::infinity();
+  for (auto _ : state) {
+    double seconds = run_stream(kernel, arrays, num_thread, node);
+    state.SetIterationTime(seconds);
+    best = std::min(best, seconds);
+  }
+  int64_t bytes = stream_bytes(kernel) * arrays.size;
+  state.SetBytesProcessed(state.iterations() * bytes);
+  state.counters["num_thread"] = num_thread;
+  state.counters["node"] = node;
+  state.counters["size"] = arrays.size;
+  state.counters["gb_per_s"] = bytes / best * 1e-9;
+}
+
+static void BM_PEAK_FMA(benchmark::State &state, int64_t num_thread) {
+  double best = std::numeric_limits<double>::infinity();
+  for (auto _ : state) {
+    double seconds = run_fma_chains(num_thread, _FMA_STEPS);
+    state.SetIterationTime(seconds);
+    best = std::min(best, seconds);
+  }
+  state.counters["num_thread"] = num_thread;
+  state.counters["avx512"] = has_avx512();
+  state.counters["gflop_per_s"] =
+      fma_chains_flops(_FMA_STEPS) * num_thread / best * 1e-9;
+}
+
+static void BM_INTENSITY(benchmark::State &state, int64_t fmas,
+                         int64_t num_thread) {
+  int64_t size = stream_size();
+  std::shared_ptr<const float> data = dataset<float>({size}, Fill::UNIFORM);
+  double best = std::numeric_limits<double>::infinity();
+  for (auto _ : state) {
+    double seconds = run_intensity(data.get(), size, fmas, num_thread);
+    state.SetIterationTime(seconds);
+    best = std::min(best, seconds);
+  }
+  state.counters["num_thread"] = num_thread;
+  state.counters["fmas"] = fmas;
+  state.counters["size"] = size;
+  state.counters["flops_per_byte"] = 2.0 * fmas / sizeof(float);
+  report_roofline(state, best * 1e9, 2.0 * fmas * size, size * sizeof(float),
+                  num_thread);
+}
+
+int main(int argc, char **argv) {
+  int64_t max_nt = std::max<int64_t>(std::thread::hardware_concurrency(), 2);
+  std::vector<int64_t> num_threads;
+  for (int64_t nt = 1; nt < max_nt; nt *= 2) {
+    num_threads.push_back(nt);
+  }
+  num_threads.push_back(max_nt);
+
+  std::vector<int> nodes = {-1};
+  if (numa_available() >= 0) {
+    for (int node = 0; node <= numa_max_node(); node++) {
+      nodes.push_back(node);
+    }
+  }
+
+  for (int64_t nt : num_threads) {
+    for (int node : nodes) {
+      for (StreamKernel kernel : {StreamKernel::COPY, StreamKernel::SCALE,
+                                  StreamKernel::ADD, StreamKernel::TRIAD}) {
+        std::string name = "stream_" + stream_kernel_name(kernel);
+        benchmark::RegisterBenchmark(name.c_str(), &BM_STREAM, kernel, nt,
+                                     node)
+            ->UseManualTime()
+            ->Iterations(10);
+      }
+    }
+    benchmark::RegisterBenchmark("peak_fma", &BM_PEAK_FMA, nt)
+        ->UseManualTime()
+        ->Iterations(10);
+    for (int64_t fmas = 1; fmas <= 64; fmas *= 2) {
+      std::string name = "intensity_" + std::to_string(fmas);
+      benchmark::RegisterBenchmark(name.c_str(), &BM_INTENSITY, fmas, nt)
+          ->UseManualTime()
+          ->Iterations(10);
+    }
+  }
+
+  benchmark::Initialize(&argc, argv);
+  benchmark::RunSpecifiedBenchmarks();
+}
@@ -0,0 +1,445 @@
+#pragma once
+
+// Roofline of the machine, measured instead of taken from a spec sheet, so
+// that the benchmarks can say how much headroom a kernel has left. Per thread
+// count
+//
+//  bandwidth  best of the STREAM copy, scale, add and triad kernels over
+//             arrays of 4x the LLC, first touched by the threads using them
+//  compute    independent FMA chains in registers, AVX-512 where the CPU has
+//             it and AVX2 otherwise, like the dispatched sum kernels
+//
+// A kernel doing I flops per byte can reach at most min(compute, I *
+// bandwidth). report_roofline puts the achieved GB/s and GFLOP/s of a call
+// next to both ceilings and that bound. The bandwidth ceiling is DRAM, inputs
+// that stay in cache can go past 100%. Sums and reductions count one flop per
+// element, integer dtypes included.
+//
+// Calibrating takes about a second per thread count and happens once per
+// process. The benchmark executables hand the thread counts they register to
+// register_rooflines, which has them calibrated together on the first report.
+// Other counts are calibrated the first time they are reported. The roofline
+// executable runs the same kernels as benchmarks per thread count and NUMA
+// node, plus the intensity kernel whose FMAs per loaded float walk from one
+// ceiling to the other.
+
+#include "buffer_allocator.h"
+#include "cache_state.h"
+
+#include <benchmark/benchmark.h>
+#include <numa.h>
+#include <omp.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <type_traits>
+
+#include "immintrin.h"
+
+enum class StreamKernel { COPY = 0, SCALE, ADD, TRIAD };
+
+constexpr float _STREAM_SCALAR = 3;
+constexpr int _FMA_CHAINS = 10;
+constexpr int64_t _FMA_STEPS = 1 << 24;
+// Timed passes per kernel, the best one counts. One more warms up.
+constexpr int _CALIBRATION_PASSES = 5;
+
+inline std::string stream_kernel_name(StreamKernel kernel) {
+  switch (kernel) {
+  case StreamKernel::SCALE:
+    return "scale";
+  case StreamKernel::ADD:
+    return "add";
+  case StreamKernel::TRIAD:
+    return "triad";
+  default:
+    return "copy";
+  }
+}
+
+// Bytes per element, reads plus writes without the write allocate like STREAM
+inline int64_t stream_bytes(StreamKernel kernel) {
+  bool three = kernel == StreamKernel::ADD || kernel == StreamKernel::TRIAD;
+  return (three ? 3 : 2) * sizeof(float);
+}
+
+// Elements per STREAM array, 4x the LLC so the caches don't help. Capped at
+// a 16th of the physical memory, the dataset cache may hold half of it while
+// the benchmarks calibrate.
+inline int64_t stream_size() {
+  size_t bytes = std::max<size_t>(4 * llc_bytes(), 64 << 20);
+  size_t memory = (size_t)sysconf(_SC_PHYS_PAGES) * sysconf(_SC_PAGESIZE);
+  return std::min(bytes, memory / 16) / sizeof(float);
+}
+
+// Binds the calling thread to the CPUs of node, nothing for node -1
+inline void bind_to_node(int node) {
+  if (node >= 0 && numa_available() >= 0) {
+    numa_run_on_node(node);
+  }
+}
+
+// Undoes bind_to_node
+inline void unbind_from_node(int node) {
+  if (node >= 0 && numa_available() >= 0) {
+    numa_run_on_node(-1);
+  }
+}
+
+// a, b and c of STREAM. The threads of every pass first touch their part
+// here with the same static schedule, so the pages end up on their node.
+struct StreamArrays {
+  int64_t size;
+  float *a;
+  float *b;
+  float *c;
+
+  StreamArrays(int64_t size, int64_t num_thread, int node) : size(size) {
+    ScopedNumaPolicy scoped_policy(NumaPolicy::FIRST_TOUCH);
+    a = (float *)alloc_buffer(size * sizeof(float));
+    b = (float *)alloc_buffer(size * sizeof(float));
+    c = (float *)alloc_buffer(size * sizeof(float));
+#pragma omp parallel num_threads(num_thread)
+    {
+      bind_to_node(node);
+#pragma omp for schedule(static)
+      for (int64_t i = 0; i < size; i++) {
+        a[i] = 1;
+        b[i] = 2;
+        c[i] = 0;
+      }
+      unbind_from_node(node);
+    }
+  }
+
+  StreamArrays(const StreamArrays &) = delete;
+  StreamArrays &operator=(const StreamArrays &) = delete;
+
+  ~StreamArrays() {
+    free_buffer(a);
+    free_buffer(b);
+    free_buffer(c);
+  }
+};
+
+// One pass of kernel on num_thread threads bound to node, -1 for any node.
+// Returns the seconds from the first thread starting to the last finishing.
+inline double run_stream(StreamKernel kernel, StreamArrays &arrays,
+                         int64_t num_thread, int node) {
+  using clock = std::chrono::steady_clock;
+  int64_t size = arrays.size;
+  float *a = arrays.a;
+  float *b = arrays.b;
+  float *c = arrays.c;
+  float s = _STREAM_SCALAR;
+  clock::time_point start;
+  double seconds = 0;
+#pragma omp parallel num_threads(num_thread)
+  {
+    bind_to_node(node);
+#pragma omp barrier
+#pragma omp single
+    start = clock::now();
+    switch (kernel) {
+    case StreamKernel::COPY:
+#pragma omp for schedule(static)
+      for (int64_t i = 0; i < size; i++) {
+        c[i] = a[i];
+      }
+      break;
+    case StreamKernel::SCALE:
+#pragma omp for schedule(static)
+      for (int64_t i = 0; i < size; i++) {
+        b[i] = s * c[i];
+      }
+      break;
+    case StreamKernel::ADD:
+#pragma omp for schedule(static)
+      for (int64_t i = 0; i < size; i++) {
+        c[i] = a[i] + b[i];
+      }
+      break;
+    case StreamKernel::TRIAD:
+#pragma omp for schedule(static)
+      for (int64_t i = 0; i < size; i++) {
+        a[i] = b[i] + s * c[i];
+      }
+      break;
+    }
+#pragma omp single
+    {
+      std::chrono::duration<double> elapsed = clock::now() - start;
+      seconds = elapsed.count();
+    }
+    unbind_from_node(node);
+  }
+  return seconds;
+}
+
+inline bool has_avx512() { return __builtin_cpu_supports("avx512f"); }
+
+// _FMA_CHAINS independent chains hide the FMA latency on two FMA ports.
+// acc * m + c converges, so the values stay normal.
+__attribute__((target("avx2,fma"))) inline float
+fma_chains_avx2(int64_t steps) {
+  __m256 acc[_FMA_CHAINS];
+  for (int j = 0; j < _FMA_CHAINS; j++) {
+    acc[j] = _mm256_set1_ps((float)j);
+  }
+  __m256 m = _mm256_set1_ps(0.999999f);
+  __m256 c = _mm256_set1_ps(1e-6f);
+  for (int64_t step = 0; step < steps; step++) {
+    for (int j = 0; j < _FMA_CHAINS; j++) {
+      acc[j] = _mm256_fmadd_ps(acc[j], m, c);
+    }
+  }
+  for (int j = 1; j < _FMA_CHAINS; j++) {
+    acc[0] = _mm256_add_ps(acc[0], acc[j]);
+  }
+  float out[8];
+  _mm256_storeu_ps(out, acc[0]);
+  float sum = 0;
+  for (int i = 0; i < 8; i++) {
+    sum += out[i];
+  }
+  return sum;
+}
+
+__attribute__((target("avx512f"))) inline float
+fma_chains_avx512(int64_t steps) {
+  __m512 acc[_FMA_CHAINS];
+  for (int j = 0; j < _FMA_CHAINS; j++) {
+    acc[j] = _mm512_set1_ps((float)j);
+  }
+  __m512 m = _mm512_set1_ps(0.999999f);
+  __m512 c = _mm512_set1_ps(1e-6f);
+  for (int64_t step = 0; step < steps; step++) {
+    for (int j = 0; j < _FMA_CHAINS; j++) {
+      acc[j] = _mm512_fmadd_ps(acc[j], m, c);
+    }
+  }
+  for (int j = 1; j < _FMA_CHAINS; j++) {
+    acc[0] = _mm512_add_ps(acc[0], acc[j]);
+  }
+  return _mm512_reduce_add_ps(acc[0]);
+}
+
+// Flops of one thread running steps steps of fma_chains
+inline double fma_chains_flops(int64_t steps) {
+  return 2.0 * _FMA_CHAINS * (has_avx512() ? 16 : 8) * steps;
+}
+
+// Seconds for num_thread threads to run steps steps of fma_chains each
+inline double run_fma_chains(int64_t num_thread, int64_t steps) {
+  using clock = std::chrono::steady_clock;
+  bool avx512 = has_avx512();
+  float sink = 0;
+  clock::time_point start = clock::now();
+#pragma omp parallel num_threads(num_thread) reduction(+ : sink)
+  sink += avx512 ? fma_chains_avx512(steps) : fma_chains_avx2(steps);
+  std::chrono::duration<double> elapsed = clock::now() - start;
+  benchmark::DoNotOptimize(sink);
+  return elapsed.count();
+}
+
+// fmas FMAs per loaded float, fmas >= 1. fmas - 1 of them update the loaded
+// vector in place and the last one folds it into its accumulator, so a call
+// does 2 * fmas flops per 4 bytes. AVX2 only, on AVX-512 machines high fmas
+// levels off at half the compute ceiling.
+__attribute__((target("avx2,fma"))) inline float
+intensity_avx2(const float *data, int64_t size, int64_t fmas) {
+  constexpr int CHAINS = 8;
+  __m256 acc[CHAINS];
+  for (int j = 0; j < CHAINS; j++) {
+    acc[j] = _mm256_setzero_ps();
+  }
+  __m256 m = _mm256_set1_ps(0.999999f);
+  __m256 c = _mm256_set1_ps(1e-6f);
+  int64_t i = 0;
+  for (; i + CHAINS * 8 <= size; i += CHAINS * 8) {
+    __m256 v[CHAINS];
+    for (int j = 0; j < CHAINS; j++) {
+      v[j] = _mm256_loadu_ps(data + i + j * 8);
+    }
+    for (int64_t k = 1; k < fmas; k++) {
+      for (int j = 0; j < CHAINS; j++) {
+        v[j] = _mm256_fmadd_ps(v[j], m, c);
+      }
+    }
+    for (int j = 0; j < CHAINS; j++) {
+      acc[j] = _mm256_fmadd_ps(v[j], m, acc[j]);
+    }
+  }
+  for (int j = 1; j < CHAINS; j++) {
+    acc[0] = _mm256_add_ps(acc[0], acc[j]);
+  }
+  float out[8];
+  _mm256_storeu_ps(out, acc[0]);
+  float sum = 0;
+  for (int j = 0; j < 8; j++) {
+    sum += out[j];
+  }
+  for (; i < size; i++) {
+    sum += data[i];
+  }
+  return sum;
+}
+
+// Seconds for num_thread threads to run the intensity kernel over data, each
+// on its static share
+inline double run_intensity(const float *data, int64_t size, int64_t fmas,
+                            int64_t num_thread) {
+  using clock = std::chrono::steady_clock;
+  float sink = 0;
+  clock::time_point start = clock::now();
+#pragma omp parallel num_threads(num_thread) reduction(+ : sink)
+  {
+    int64_t chunk = (size + num_thread - 1) / num_thread;
+    int64_t begin = std::min(omp_get_thread_num() * chunk, size);
+    int64_t end = std::min(begin + chunk, size);
+    sink += intensity_avx2(data + begin, end - begin, fmas);
+  }
+  std::chrono::duration<double> elapsed = clock::now() - start;
+  benchmark::DoNotOptimize(sink);
+  return elapsed.count();
+}
+
+struct Roofline {
+  double gb_per_s;
+  double gflop_per_s;
+};
+
+inline Roofline measure_roofline(int64_t num_thread) {
+  Roofline roofline = {0, 0};
+  {
+    StreamArrays arrays(stream_size(), num_thread, -1);
+    for (StreamKernel kernel : {StreamKernel::COPY, StreamKernel::SCALE,
+                                StreamKernel::ADD, StreamKernel::TRIAD}) {
+      double best = std::numeric_limits<double>::infinity();
+      for (int pass = 0; pass <= _CALIBRATION_PASSES; pass++) {
+        double seconds = run_stream(kernel, arrays, num_thread, -1);
+        best = pass > 0 ? std::min(best, seconds) : best;
+      }
+      roofline.gb_per_s = std::max(
+          roofline.gb_per_s, stream_bytes(kernel) * arrays.size / best * 1e-9);
+    }
+  }
+  double best = std::numeric_limits<double>::infinity();
+  for (int pass = 0; pass <= _CALIBRATION_PASSES; pass++) {
+    double seconds = run_fma_chains(num_thread, _FMA_STEPS);
+    best = pass > 0 ? std::min(best, seconds) : best;
+  }
+  roofline.gflop_per_s =
+      fma_chains_flops(_FMA_STEPS) * num_thread / best * 1e-9;
+  return roofline;
+}
+
+inline std::set<int64_t> &registered_rooflines() {
+  static std::set<int64_t> thread_counts;
+  return thread_counts;
+}
+
+// Thread counts to calibrate together on the first report, so that only the
+// first benchmark of a sweep waits for calibration and a run without any
+// benchmark, e.g. --benchmark_list_tests or a filter matching nothing, doesn't
+// calibrate at all. Call before the benchmarks run.
+inline void register_rooflines(const std::set<int64_t> &thread_counts) {
+  registered_rooflines().insert(thread_counts.begin(), thread_counts.end());
+}
+
+// measure_roofline, once per thread count and process. The first call also
+// calibrates the registered thread counts.
+inline Roofline measured_roofline(int64_t num_thread) {
+  static std::map<int64_t, Roofline> rooflines;
+  static std::mutex mutex;
+  num_thread = std::max<int64_t>(num_thread, 1);
+  std::lock_guard<std::mutex> lock(mutex);
+  std::set<int64_t> thread_counts = {num_thread};
+  if (rooflines.empty()) {
+    thread_counts.insert(registered_rooflines().begin(),
+                         registered_rooflines().end());
+  }
+  for (int64_t count : thread_counts) {
+    if (rooflines.count(count)) {
+      continue;
+    }
+    Roofline peak = measure_roofline(count);
+    rooflines.emplace(count, peak);
+    std::cerr << "Roofline of " << count << " threads: " << peak.gb_per_s
+              << " GB/s, " << peak.gflop_per_s << " GFLOP/s" << std::endl;
+  }
+  return rooflines.at(num_thread);
+}
+
+// Publishes what a call of call_ns nanoseconds that moves bytes and does flops
+// achieves, against the roofline of num_thread threads. pct_roofline is
+// against the lower of the two ceilings at the call's flops per byte.
+inline void report_roofline(benchmark::State &state, double call_ns,
+                            double flops, double bytes, int64_t num_thread) {
+  Roofline peak = measured_roofline(num_thread);
+  // Bytes and flops per nanosecond are GB/s and GFLOP/s
+  double gb_per_s = call_ns > 0 ? bytes / call_ns : -1;
+  double gflop_per_s = call_ns > 0 ? flops / call_ns : -1;
+  double bound = peak.gflop_per_s;
+  if (bytes > 0) {
+    bound = std::min(bound, flops / bytes * peak.gb_per_s);
+  }
+  state.counters["gb_per_s"] = gb_per_s;
+  state.counters["gflop_per_s"] = gflop_per_s;
+  state.counters["pct_peak_bw"] =
+      gb_per_s >= 0 ? 100 * gb_per_s / peak.gb_per_s : -1;
+  state.counters["pct_peak_flops"] =
+      gflop_per_s >= 0 ? 100 * gflop_per_s / peak.gflop_per_s : -1;
+  state.counters["pct_roofline"] =
+      gflop_per_s >= 0 && bound > 0 ? 100 * gflop_per_s / bound : -1;
+}
+
+// What one call of a kernel does, elements visited, flops and bytes read and
+// written, for report_roofline and PerfCounters::report
+struct CallWork {
+  int64_t elements;
+  double flops;
+  double bytes;
+
+  CallWork(int64_t elements, double flops, double bytes)
+      : elements(elements), flops(flops), bytes(bytes) {}
+};
+
+// The timed part of a benchmark iteration, entered with the timer paused
+// after the setup and leaving it running. Runs call iter times through
+// run_calls over the data_bytes at data and publishes iter, num_thread (-1 for
+// one core), cache_state, call_ns, the roofline and the hardware counters.
+// after runs untimed once the calls are done.
+template <typename F, typename A>
+void time_and_report(benchmark::State &state, int64_t iter, const void *data,
+                     size_t data_bytes, CallWork work, int64_t num_thread,
+                     PerfCounters &perf, F call, A after) {
+  state.counters["iter"] = iter;
+  state.counters["num_thread"] = num_thread;
+  state.ResumeTiming();
+  double call_ns = run_calls(state, iter, data, data_bytes, perf, call);
+  state.PauseTiming();
+  state.counters["cache_state"] = (int)current_cache_state();
+  state.counters["call_ns"] = call_ns;
+  report_roofline(state, call_ns, work.flops, work.bytes, num_thread);
+  after();
+  // From the totals so far, the last iteration's report stands
+  perf.report(state, work.elements, (int64_t)work.bytes);
+  state.ResumeTiming();
+}
+
+template <typename F>
+void time_and_report(benchmark::State &state, int64_t iter, const void *data,
+                     size_t data_bytes, CallWork work, int64_t num_thread,
+                     PerfCounters &perf, F call) {
+  time_and_report(state, iter, data, data_bytes, work, num_thread, perf, call,
+                  [] {});
+}
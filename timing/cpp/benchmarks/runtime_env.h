@@ -0,0 +1,58 @@
+#pragma once
+
+// Runtime settings and process state reported as counters by the benchmarks
+// that compare parallel runtimes. OMP_WAIT_POLICY and KMP_BLOCKTIME are only
+// read when the OpenMP runtime starts, so they are swept across processes and
+// merely echoed here.
+
+#include <time.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+
+// 1 for active, 0 for passive, -1 if unset
+inline int64_t omp_wait_policy() {
+  const char *policy = std::getenv("OMP_WAIT_POLICY");
+  if (policy == NULL) {
+    return -1;
+  }
+  std::string s(policy);
+  std::transform(s.begin(), s.end(), s.begin(), ::tolower);
+  return s == "active" ? 1 : 0;
+}
+
+// In milliseconds, -1 if unset and -2 for infinite
+inline int64_t kmp_blocktime() {
+  const char *blocktime = std::getenv("KMP_BLOCKTIME");
+  if (blocktime == NULL) {
+    return -1;
+  }
+  std::string s(blocktime);
+  if (s == "infinite") {
+    return -2;
+  }
+  return std::atol(blocktime);
+}
+
+// Threads alive in this process, worker pools of every runtime included. -1 if
+// /proc is not available.
+inline int64_t live_threads() {
+  std::ifstream status("/proc/self/status");
+  std::string line;
+  while (std::getline(status, line)) {
+    if (line.compare(0, 8, "Threads:") == 0) {
+      return std::atol(line.c_str() + 8);
+    }
+  }
+  return -1;
+}
+
+// CPU time of all threads of the process, so spinning workers count as well
+inline double process_cpu_seconds() {
+  timespec ts;
+  clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
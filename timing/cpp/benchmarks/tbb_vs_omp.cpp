@@ -1,13 +1,25 @@
+#include "perf_counters.h"
+#include "runtime_env.h"
 #include "tbb/blocked_range.h"
 #include "tbb/parallel_reduce.h"
+#include "work_stealing_pool.h"
 #include <benchmark/benchmark.h>
 #include <omp.h>
+#include <chrono>
 #include <cstdlib>
 #include <ctime>
 #include <functional>
 #include <iostream>
 #include <numeric>
 #include <random>
+#include <thread>
+
+// OpenMP and TBB alone, back to back, and nested in either direction. libtorch
+// mixes both runtimes in one process, so both worker pools can be alive and
+// spinning at once. Besides the wall time every benchmark reports the CPU time
+// of the whole process, which includes workers that spin while the other
+// runtime works, and the number of live threads. OMP_WAIT_POLICY and
+// KMP_BLOCKTIME are swept by run_tbb_vs_omp.py, see runtime_env.h.
 
 float do_something(float r) {
     benchmark::DoNotOptimize(r = r * 2);
@@ -24,7 +36,74 @@ float get_random_value() {
 
 #define SETTING ->RangeMultiplier(2)->Ranges({{8, 8 << 20}, {64, 128}});
 
+float omp_reduce(int64_t begin, int64_t end) {
+  float sum = 0;
+#pragma omp parallel for reduction(+ : sum)
+  for (int64_t i = begin; i < end; i++) {
+    sum += i * sum;
+  }
+  return sum;
+}
+
+float tbb_reduce(int64_t begin, int64_t end) {
+  return tbb::parallel_reduce(
+      tbb::blocked_range<int64_t>(begin, end), 0.f,
+      [](const tbb::blocked_range<int64_t> &r, float value) {
+        for (int64_t i = r.begin(); i < r.end(); i++) {
+          value += i * value;
+        }
+        return value;
+      },
+      std::plus<float>());
+}
+
+// Chunks of the outer region of the nested benchmarks, at least two so that
+// the nesting happens on a single core machine as well
+int64_t outer_chunks() {
+  return std::max<int64_t>(std::thread::hardware_concurrency(), 2);
+}
+
+// Wall and process CPU time of the timed loops, reported per iteration, and
+// the hardware counters of every thread alive when the benchmark starts. The
+// worker pools only exist from the first region on, so the first run of the
+// first benchmark misses them.
+struct RuntimeUsage {
+  double wall = 0;
+  double cpu = 0;
+  std::chrono::steady_clock::time_point wall_start;
+  double cpu_start = 0;
+  PerfCounters perf{PerfScope::PROCESS};
+
+  void start() {
+    wall_start = std::chrono::steady_clock::now();
+    cpu_start = process_cpu_seconds();
+    perf.resume();
+  }
+
+  void stop() {
+    perf.pause();
+    cpu += process_cpu_seconds() - cpu_start;
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - wall_start;
+    wall += elapsed.count();
+  }
+
+  void report(benchmark::State &state) {
+    state.counters["wall_ns"] = wall * 1e9 / state.iterations();
+    state.counters["process_cpu_ns"] = cpu * 1e9 / state.iterations();
+    state.counters["cpu_per_wall"] = wall > 0 ? cpu / wall : 0;
+    state.counters["live_threads"] = live_threads();
+    state.counters["omp_wait_policy"] = omp_wait_policy();
+    state.counters["kmp_blocktime"] = kmp_blocktime();
+    // One call is one step of range(0) elements, none of them in memory
+    perf.count_calls(state.iterations() * state.range(1));
+    perf.report(state, state.range(0), 0);
+  }
+};
+
+// Alternating OMP and TBB regions
 static void BM_TBB_OMP(benchmark::State &state) {
+  RuntimeUsage usage;
   for (auto _ : state) {
     state.PauseTiming();
     state.counters["size"] = state.range(0);
@@ -32,27 +111,82 @@ static void BM_TBB_OMP(benchmark::State &state) {
     int64_t steps = state.range(0);
     float sum = get_random_value();
     state.ResumeTiming();
+    usage.start();
     for (int64_t step = 0; step < state.range(1); step++) {
-#pragma omp parallel reduction(+ : sum)
-      for (int64_t i = 0; i < steps; i++) {
-        sum += i * sum;
-      }
+      sum += omp_reduce(0, steps);
       sum = do_something(sum);
+      sum += tbb_reduce(0, steps);
+      sum = do_something(sum);
+    }
+    usage.stop();
+  }
+  usage.report(state);
+}
+
+// Every TBB task runs an OMP region over its chunk. Each TBB thread is the
+// master of its own OMP team, so the process can hold up to
+// TBB threads * OMP threads workers.
+static void BM_OMP_IN_TBB(benchmark::State &state) {
+  RuntimeUsage usage;
+  for (auto _ : state) {
+    state.PauseTiming();
+    state.counters["size"] = state.range(0);
+    state.counters["iter"] = state.range(1);
+    int64_t steps = state.range(0);
+    int64_t chunks = outer_chunks();
+    int64_t chunk_size = (steps + chunks - 1) / chunks;
+    float sum = get_random_value();
+    state.ResumeTiming();
+    usage.start();
+    for (int64_t step = 0; step < state.range(1); step++) {
       sum += tbb::parallel_reduce(
-          tbb::blocked_range<int64_t>(0, steps), 0.f,
-          [](const tbb::blocked_range<int64_t> &r, float value) {
-            for (int64_t i = r.begin(); i < r.end(); i++) {
-              value += i * value;
+          tbb::blocked_range<int64_t>(0, chunks, 1), 0.f,
+          [=](const tbb::blocked_range<int64_t> &r, float value) {
+            for (int64_t c = r.begin(); c < r.end(); c++) {
+              value += omp_reduce(c * chunk_size,
+                                  std::min(steps, (c + 1) * chunk_size));
             }
             return value;
           },
-          std::plus<float>());
+          std::plus<float>(), tbb::simple_partitioner());
       sum = do_something(sum);
     }
+    usage.stop();
   }
+  usage.report(state);
+}
+
+// Every OMP thread runs a TBB region over its chunk and joins the TBB worker
+// pool from outside of it
+static void BM_TBB_IN_OMP(benchmark::State &state) {
+  RuntimeUsage usage;
+  for (auto _ : state) {
+    state.PauseTiming();
+    state.counters["size"] = state.range(0);
+    state.counters["iter"] = state.range(1);
+    int64_t steps = state.range(0);
+    int64_t chunks = outer_chunks();
+    int64_t chunk_size = (steps + chunks - 1) / chunks;
+    float sum = get_random_value();
+    state.ResumeTiming();
+    usage.start();
+    for (int64_t step = 0; step < state.range(1); step++) {
+      float value = 0;
+#pragma omp parallel for reduction(+ : value) schedule(static, 1)
+      for (int64_t c = 0; c < chunks; c++) {
+        value +=
+            tbb_reduce(c * chunk_size, std::min(steps, (c + 1) * chunk_size));
+      }
+      sum += value;
+      sum = do_something(sum);
+    }
+    usage.stop();
+  }
+  usage.report(state);
 }
 
 static void BM_TBB(benchmark::State &state) {
+  RuntimeUsage usage;
   for (auto _ : state) {
     state.PauseTiming();
     state.counters["size"] = state.range(0);
@@ -60,22 +194,47 @@ static void BM_TBB(benchmark::State &state) {
     int64_t steps = state.range(0);
     float sum = get_random_value();
     state.ResumeTiming();
+    usage.start();
     for (int64_t step = 0; step < state.range(1); step++) {
-      sum += tbb::parallel_reduce(
-          tbb::blocked_range<int64_t>(0, steps), 0.f,
-          [](const tbb::blocked_range<int64_t> &r, float value) {
-            for (int64_t i = r.begin(); i < r.end(); i++) {
-              value += i * value;
-            }
-            return value;
-          },
-          std::plus<float>());
+      sum += tbb_reduce(0, steps);
       sum = do_something(sum);
     }
+    usage.stop();
   }
+  usage.report(state);
+}
+
+static void BM_WS(benchmark::State &state) {
+  ws::WorkStealingPool &pool = ws::pool(std::thread::hardware_concurrency());
+  RuntimeUsage usage;
+  for (auto _ : state) {
+    state.PauseTiming();
+    state.counters["size"] = state.range(0);
+    state.counters["iter"] = state.range(1);
+    int64_t steps = state.range(0);
+    float sum = get_random_value();
+    state.ResumeTiming();
+    usage.start();
+    for (int64_t step = 0; step < state.range(1); step++) {
+      // One chunk per thread, like TBB's default auto_partitioner start
+      int64_t grain = std::max<int64_t>(steps / pool.num_threads(), 1);
+      sum += ws::parallel_reduce(pool, 0, steps, grain, 0.f,
+                                 [](int64_t b, int64_t e, float value) {
+                                   for (int64_t i = b; i < e; i++) {
+                                     value += i * value;
+                                   }
+                                   return value;
+                                 },
+                                 std::plus<float>());
+      sum = do_something(sum);
+    }
+    usage.stop();
+  }
+  usage.report(state);
 }
 
 static void BM_OMP(benchmark::State &state) {
+  RuntimeUsage usage;
   for (auto _ : state) {
     state.PauseTiming();
     state.counters["size"] = state.range(0);
@@ -83,17 +242,20 @@ static void BM_OMP(benchmark::State &state) {
     int64_t steps = state.range(0);
     float sum = get_random_value();
     state.ResumeTiming();
+    usage.start();
     for (int64_t step = 0; step < state.range(1); step++) {
-#pragma omp parallel reduction(+ : sum)
-      for (int64_t i = 0; i < steps; i++) {
-        sum += i * sum;
-      }
+      sum += omp_reduce(0, steps);
       sum = do_something(sum);
     }
+    usage.stop();
   }
+  usage.report(state);
 }
 
 BENCHMARK(BM_TBB_OMP) SETTING;
+BENCHMARK(BM_OMP_IN_TBB) SETTING;
+BENCHMARK(BM_TBB_IN_OMP) SETTING;
 BENCHMARK(BM_OMP) SETTING;
 BENCHMARK(BM_TBB) SETTING;
+BENCHMARK(BM_WS) SETTING;
 BENCHMARK_MAIN();
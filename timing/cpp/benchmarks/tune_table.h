@@ -0,0 +1,155 @@
+#pragma once
+
+// Tuned threshold and thread count per parallel kernel, dtype and input size,
+// written by AVX_SUM_AUTOTUNE=1 and loaded at startup, see AUTOTUNING in
+// avx_sum.cpp. Sizes are bucketed by log2, a lookup falls back to the nearest
+// tuned bucket of the same kernel and dtype.
+
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <limits>
+#include <map>
+#include <set>
+#include <sstream>
+#include <string>
+#include <tuple>
+#include <utility>
+
+struct TuneKey {
+  std::string kernel;
+  std::string dtype;
+  int64_t outer_bucket;
+  int64_t inner_bucket;
+  bool operator<(const TuneKey &other) const {
+    return std::tie(kernel, dtype, outer_bucket, inner_bucket) <
+           std::tie(other.kernel, other.dtype, other.outer_bucket,
+                    other.inner_bucket);
+  }
+};
+
+struct ParallelConfig {
+  int64_t threshold;
+  int64_t num_thread;
+  double ns;
+};
+
+inline int64_t size_bucket(int64_t size) {
+  int64_t bucket = 0;
+  while (size > 1) {
+    size >>= 1;
+    bucket++;
+  }
+  return bucket;
+}
+
+// The entries of one kernel and dtype by (outer_bucket, inner_bucket)
+using TuneEntries = std::map<std::pair<int64_t, int64_t>, ParallelConfig>;
+
+// Configuration of the entry nearest to the buckets, config is left alone if
+// there are no entries
+inline bool nearest_config(const TuneEntries &entries, int64_t outer_bucket,
+                           int64_t inner_bucket, ParallelConfig &config) {
+  int64_t best_distance = std::numeric_limits<int64_t>::max();
+  for (auto &kv : entries) {
+    int64_t distance = std::abs(kv.first.first - outer_bucket) +
+                       std::abs(kv.first.second - inner_bucket);
+    if (distance < best_distance) {
+      best_distance = distance;
+      config = kv.second;
+    }
+  }
+  return best_distance != std::numeric_limits<int64_t>::max();
+}
+
+class TuneTable {
+  std::map<TuneKey, ParallelConfig> entries_;
+
+public:
+  // One line per entry, kernel dtype outer_bucket inner_bucket threshold
+  // num_thread ns_per_call. Lines starting with # are comments.
+  bool load(const std::string &path) {
+    std::ifstream in(path);
+    std::string line;
+    while (std::getline(in, line)) {
+      if (line.empty() || line[0] == '#') {
+        continue;
+      }
+      std::istringstream fields(line);
+      TuneKey key;
+      ParallelConfig config;
+      if (fields >> key.kernel >> key.dtype >> key.outer_bucket >>
+          key.inner_bucket >> config.threshold >> config.num_thread >>
+          config.ns) {
+        entries_[key] = config;
+      }
+    }
+    return !entries_.empty();
+  }
+
+  void save(const std::string &path) const {
+    std::ofstream out(path);
+    out << "# kernel dtype outer_bucket inner_bucket threshold num_thread "
+           "ns_per_call"
+        << std::endl;
+    for (auto &kv : entries_) {
+      out << kv.first.kernel << " " << kv.first.dtype << " "
+          << kv.first.outer_bucket << " " << kv.first.inner_bucket << " "
+          << kv.second.threshold << " " << kv.second.num_thread << " "
+          << kv.second.ns << std::endl;
+    }
+  }
+
+  void insert(const TuneKey &key, const ParallelConfig &config) {
+    entries_[key] = config;
+  }
+
+  // Thread counts of all entries
+  std::set<int64_t> num_threads() const {
+    std::set<int64_t> counts;
+    for (auto &kv : entries_) {
+      counts.insert(kv.second.num_thread);
+    }
+    return counts;
+  }
+
+  bool has_kernel(const std::string &kernel, const std::string &dtype) const {
+    return !kernel_entries(kernel, dtype).empty();
+  }
+
+  TuneEntries kernel_entries(const std::string &kernel,
+                             const std::string &dtype) const {
+    TuneEntries entries;
+    for (auto &kv : entries_) {
+      if (kv.first.kernel == kernel && kv.first.dtype == dtype) {
+        entries[{kv.first.outer_bucket, kv.first.inner_bucket}] = kv.second;
+      }
+    }
+    return entries;
+  }
+
+  bool lookup(const TuneKey &key, ParallelConfig &config) const {
+    return nearest_config(kernel_entries(key.kernel, key.dtype),
+                          key.outer_bucket, key.inner_bucket, config);
+  }
+};
+
+inline std::string tune_table_path() {
+  const char *envar = std::getenv("AVX_SUM_TUNE_TABLE");
+  return envar ? envar : "avx_sum_tune.txt";
+}
+
+inline TuneTable &tune_table() {
+  static TuneTable table;
+  return table;
+}
+
+// Configuration for a kernel on a size_outer x size_inner input (1 x size for
+// a vector), false if the kernel was never tuned
+inline bool tuned_parallel_config(const std::string &kernel,
+                                  const std::string &dtype, int64_t size_outer,
+                                  int64_t size_inner, ParallelConfig &config) {
+  return tune_table().lookup(
+      {kernel, dtype, size_bucket(size_outer), size_bucket(size_inner)},
+      config);
+}
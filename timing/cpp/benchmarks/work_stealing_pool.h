@@ -0,0 +1,318 @@
+#pragma once
+
+// Minimal work-stealing thread pool, a third backend next to OpenMP and TBB
+// to tell the inherent cost of a parallel region from runtime overhead.
+//
+// Every thread owns a Chase-Lev deque of chunk ranges. The owner pushes and
+// pops at the bottom, idle threads steal from the top of a random victim. A
+// range is split in halves until a single chunk of grain elements is left,
+// pushing the right halves, like TBB's simple_partitioner. Idle workers spin
+// for a while before they sleep on a futex, so back to back regions don't pay
+// for a wake up.
+//
+// The calling thread takes part as worker 0. Regions run one at a time, a
+// region started from inside a region runs serially on the calling thread.
+
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "immintrin.h"
+
+namespace ws {
+
+constexpr int64_t _DEQUE_CAPACITY = 256;
+constexpr int64_t _DEFAULT_SPIN_COUNT = 1 << 14;
+constexpr int _MAX_CACHED_POOLS = 256;
+
+// Bodies get the worker id so that reductions can keep per-thread partials
+using range_fn = std::function<void(int64_t, int64_t, int)>;
+
+// Chunk ranges [first, last) are packed into one word, so that the deque can
+// hold plain atomics
+inline int64_t pack_range(int64_t first, int64_t last) {
+  return (first << 32) | last;
+}
+inline int64_t range_first(int64_t range) { return range >> 32; }
+inline int64_t range_last(int64_t range) { return range & 0xffffffff; }
+
+// Chase-Lev deque with the memory orderings of Le et al., "Correct and
+// Efficient Work-Stealing for Weak Memory Models". Splitting halves a range,
+// so at most about 2 * log2(chunks) entries are live and the buffer doesn't
+// have to grow. top_ and bottom_ are padded apart, thieves only write top_.
+// Explicit padding instead of alignas, C++11 new ignores extended alignment.
+class ChaseLevDeque {
+  std::atomic<int64_t> top_{0};
+  char pad_[64 - sizeof(std::atomic<int64_t>)];
+  std::atomic<int64_t> bottom_{0};
+  std::atomic<int64_t> buffer_[_DEQUE_CAPACITY];
+
+public:
+  void push(int64_t x) {
+    int64_t b = bottom_.load(std::memory_order_relaxed);
+    assert(b - top_.load(std::memory_order_acquire) < _DEQUE_CAPACITY);
+    buffer_[b % _DEQUE_CAPACITY].store(x, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    bottom_.store(b + 1, std::memory_order_relaxed);
+  }
+
+  bool pop(int64_t &x) {
+    int64_t b = bottom_.load(std::memory_order_relaxed) - 1;
+    bottom_.store(b, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t t = top_.load(std::memory_order_relaxed);
+    if (t > b) {
+      bottom_.store(b + 1, std::memory_order_relaxed);
+      return false;
+    }
+    x = buffer_[b % _DEQUE_CAPACITY].load(std::memory_order_relaxed);
+    if (t == b) {
+      // Last entry, race the thieves for it
+      bool won = top_.compare_exchange_strong(
+          t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+      bottom_.store(b + 1, std::memory_order_relaxed);
+      return won;
+    }
+    return true;
+  }
+
+  bool steal(int64_t &x) {
+    int64_t t = top_.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t b = bottom_.load(std::memory_order_acquire);
+    if (t >= b) {
+      return false;
+    }
+    x = buffer_[t % _DEQUE_CAPACITY].load(std::memory_order_relaxed);
+    return top_.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                                        std::memory_order_relaxed);
+  }
+};
+
+inline void futex_wait(std::atomic<uint32_t> *addr, uint32_t expected) {
+  syscall(SYS_futex, (uint32_t *)addr, FUTEX_WAIT_PRIVATE, expected, NULL,
+          NULL, 0);
+}
+
+inline void futex_wake_all(std::atomic<uint32_t> *addr) {
+  syscall(SYS_futex, (uint32_t *)addr, FUTEX_WAKE_PRIVATE, INT32_MAX, NULL,
+          NULL, 0);
+}
+
+// Set on pool threads and on a caller while its region runs
+inline bool &in_region() {
+  static thread_local bool in = false;
+  return in;
+}
+
+class WorkStealingPool {
+  struct Job {
+    int64_t begin;
+    int64_t end;
+    int64_t grain;
+    const range_fn *body;
+    std::atomic<int64_t> remaining;
+  };
+
+  int num_threads_;
+  int64_t spin_count_;
+  std::unique_ptr<ChaseLevDeque[]> deques_;
+  std::vector<std::thread> threads_;
+  std::mutex run_mutex_;
+  // Bumped for every region, the futex word idle workers sleep on
+  std::atomic<uint32_t> epoch_{0};
+  std::atomic<int> sleepers_{0};
+  std::atomic<int> active_{0};
+  std::atomic<Job *> job_{nullptr};
+  std::atomic<bool> stop_{false};
+
+  void execute(Job &job, int id, int64_t range) {
+    int64_t first = range_first(range);
+    int64_t last = range_last(range);
+    while (last - first > 1) {
+      int64_t mid = first + (last - first) / 2;
+      deques_[id].push(pack_range(mid, last));
+      last = mid;
+    }
+    int64_t b = job.begin + first * job.grain;
+    (*job.body)(b, std::min(b + job.grain, job.end), id);
+    job.remaining.fetch_sub(1, std::memory_order_acq_rel);
+  }
+
+  void work(Job &job, int id) {
+    uint64_t seed = 0x9e3779b97f4a7c15ull * (id + 1);
+    while (job.remaining.load(std::memory_order_acquire) > 0) {
+      int64_t range;
+      if (deques_[id].pop(range)) {
+        execute(job, id, range);
+        continue;
+      }
+      // xorshift to pick a victim
+      seed ^= seed << 13;
+      seed ^= seed >> 7;
+      seed ^= seed << 17;
+      int victim = seed % num_threads_;
+      if (victim != id && deques_[victim].steal(range)) {
+        execute(job, id, range);
+      } else {
+        _mm_pause();
+      }
+    }
+  }
+
+  void worker_loop(int id) {
+    in_region() = true;
+    uint32_t seen = 0;
+    while (true) {
+      for (int64_t spin = 0; spin < spin_count_ &&
+                             epoch_.load(std::memory_order_acquire) == seen;
+           spin++) {
+        _mm_pause();
+      }
+      if (epoch_.load(std::memory_order_acquire) == seen) {
+        sleepers_.fetch_add(1);
+        futex_wait(&epoch_, seen);
+        sleepers_.fetch_sub(1);
+        continue;
+      }
+      seen = epoch_.load(std::memory_order_acquire);
+      if (stop_.load()) {
+        return;
+      }
+      // run waits for active_ to drop to zero after it cleared job_, so a job
+      // seen here is still alive
+      active_.fetch_add(1);
+      Job *job = job_.load();
+      if (job) {
+        work(*job, id);
+      }
+      active_.fetch_sub(1);
+    }
+  }
+
+public:
+  explicit WorkStealingPool(int num_threads,
+                            int64_t spin_count = _DEFAULT_SPIN_COUNT)
+      : num_threads_(std::max(num_threads, 1)), spin_count_(spin_count),
+        deques_(new ChaseLevDeque[std::max(num_threads, 1)]) {
+    for (int id = 1; id < num_threads_; id++) {
+      threads_.emplace_back(&WorkStealingPool::worker_loop, this, id);
+    }
+  }
+
+  ~WorkStealingPool() {
+    stop_.store(true);
+    epoch_.fetch_add(1);
+    futex_wake_all(&epoch_);
+    for (auto &thread : threads_) {
+      thread.join();
+    }
+  }
+
+  int num_threads() const { return num_threads_; }
+
+  // Calls body(b, e, id) on chunks of grain elements of [begin, end)
+  void run(int64_t begin, int64_t end, int64_t grain, const range_fn &body) {
+    grain = std::max<int64_t>(grain, 1);
+    int64_t chunks = (end - begin + grain - 1) / grain;
+    if (chunks <= 1 || num_threads_ == 1 || in_region()) {
+      if (end > begin) {
+        body(begin, end, 0);
+      }
+      return;
+    }
+    assert(chunks <= 0xffffffff);
+    std::lock_guard<std::mutex> lock(run_mutex_);
+    in_region() = true;
+    Job job;
+    job.begin = begin;
+    job.end = end;
+    job.grain = grain;
+    job.body = &body;
+    job.remaining.store(chunks);
+    deques_[0].push(pack_range(0, chunks));
+    job_.store(&job);
+    epoch_.fetch_add(1);
+    if (sleepers_.load() > 0) {
+      futex_wake_all(&epoch_);
+    }
+    work(job, 0);
+    job_.store(nullptr);
+    while (active_.load() > 0) {
+      _mm_pause();
+    }
+    in_region() = false;
+  }
+};
+
+// One pool per thread count, created on first use like the TBB arenas. Pools
+// live until exit, so the kernels calling this per invocation find pools of
+// fewer than _MAX_CACHED_POOLS threads in a lock-free table, only creating
+// one takes the lock.
+inline WorkStealingPool &pool(int num_threads) {
+  static std::atomic<WorkStealingPool *> cached[_MAX_CACHED_POOLS];
+  bool cacheable = num_threads >= 0 && num_threads < _MAX_CACHED_POOLS;
+  if (cacheable) {
+    WorkStealingPool *p = cached[num_threads].load(std::memory_order_acquire);
+    if (p) {
+      return *p;
+    }
+  }
+  static std::mutex mutex;
+  static std::map<int, std::unique_ptr<WorkStealingPool>> pools;
+  std::lock_guard<std::mutex> lock(mutex);
+  std::unique_ptr<WorkStealingPool> &p = pools[num_threads];
+  if (!p) {
+    p.reset(new WorkStealingPool(num_threads));
+  }
+  if (cacheable) {
+    cached[num_threads].store(p.get(), std::memory_order_release);
+  }
+  return *p;
+}
+
+template <typename F>
+void parallel_for(WorkStealingPool &pool, int64_t begin, int64_t end,
+                  int64_t grain, const F &f) {
+  pool.run(begin, end, grain,
+           [&f](int64_t b, int64_t e, int id) {
+             (void)id;
+             f(b, e);
+           });
+}
+
+// f(b, e, partial) returns the partial with [b, e) folded in
+template <typename T, typename F, typename C>
+T parallel_reduce(WorkStealingPool &pool, int64_t begin, int64_t end,
+                  int64_t grain, T identity, const F &f, const C &combine) {
+  // One cache line each, so that workers don't share lines
+  struct Partial {
+    T value;
+    char pad[64 - sizeof(T)];
+  };
+  std::vector<Partial> partials(pool.num_threads());
+  for (Partial &partial : partials) {
+    partial.value = identity;
+  }
+  pool.run(begin, end, grain, [&](int64_t b, int64_t e, int id) {
+    partials[id].value = f(b, e, partials[id].value);
+  });
+  T result = identity;
+  for (const Partial &partial : partials) {
+    result = combine(result, partial.value);
+  }
+  return result;
+}
+
+} // namespace ws
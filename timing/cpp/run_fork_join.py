@@ -0,0 +1,57 @@
+import itertools
+import json
+import os
+import subprocess
+
+# OMP_WAIT_POLICY and KMP_BLOCKTIME are read once at runtime startup, so every
+# combination needs its own process.
+# NB: assumes fork_join has already been built (see README.md)
+WAIT_POLICIES = ['active', 'passive']
+BLOCKTIMES = ['0', '1', '200', 'infinite']
+
+
+def run_benchmark(binary, wait_policy, blocktime, args=()):
+    env = dict(os.environ, OMP_WAIT_POLICY=wait_policy,
+               KMP_BLOCKTIME=blocktime)
+    bench = subprocess.check_output(
+        [binary, '--benchmark_format=json'] + list(args), env=env)
+    return json.loads(bench.decode('utf-8'))['benchmarks']
+
+
+def run_sweep(binary, args=()):
+    results = []
+    for wait_policy, blocktime in itertools.product(WAIT_POLICIES,
+                                                    BLOCKTIMES):
+        for result in run_benchmark(binary, wait_policy, blocktime, args):
+            result['wait_policy'] = wait_policy
+            result['blocktime'] = blocktime
+            results.append(result)
+    return results
+
+
+def main():
+    results = run_sweep('./build/bin/fork_join')
+    fork_join = [r for r in results if 'p50_ns' in r]
+    runtime = [r for r in results if 'first_ns' in r]
+    print('{:<24} {:>4} {:>8} {:>9} {:>6} {:>10} {:>10} {:>10}'.format(
+        'name', 'nt', 'policy', 'blocktime', 'spin', 'p50_ns', 'p99_ns',
+        'grain'))
+    for r in fork_join:
+        print('{:<24} {:>4.0f} {:>8} {:>9} {:>6.0f} {:>10.0f} {:>10.0f} '
+              '{:>10.0f}'.format(r['name'].split('/')[0], r['num_thread'],
+                                 r['wait_policy'], r['blocktime'],
+                                 r['spin_count'], r['p50_ns'], r['p99_ns'],
+                                 r['grain_elements']))
+    print()
+    print('{:<24} {:>4} {:>4} {:>8} {:>9} {:>10} {:>10} {:>11}'.format(
+        'name', 'from', 'nt', 'policy', 'blocktime', 'first_ns', 'steady_ns',
+        'overhead_ns'))
+    for r in runtime:
+        print('{:<24} {:>4.0f} {:>4.0f} {:>8} {:>9} {:>10.0f} {:>10.0f} '
+              '{:>11.0f}'.format(r['name'].split('/')[0], r['from_thread'],
+                                 r['num_thread'], r['wait_policy'],
+                                 r['blocktime'], r['first_ns'],
+                                 r['steady_ns'], r['overhead_ns']))
+
+if __name__ == '__main__':
+    main()
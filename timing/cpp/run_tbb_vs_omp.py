@@ -0,0 +1,24 @@
+import sys
+
+from run_fork_join import run_sweep
+
+# Same OMP_WAIT_POLICY x KMP_BLOCKTIME sweep as run_fork_join.py, over the
+# interop suite. Extra arguments go to the binary, e.g.
+# --benchmark_filter=BM_OMP_IN_TBB
+# NB: assumes tbb_vs_omp has already been built (see README.md)
+
+
+def main():
+    results = run_sweep('./build/bin/tbb_vs_omp', sys.argv[1:])
+    print('{:<24} {:>8} {:>9} {:>12} {:>14} {:>8} {:>8}'.format(
+        'name', 'policy', 'blocktime', 'wall_ns', 'process_cpu_ns',
+        'cpu/wall', 'threads'))
+    for r in results:
+        print('{:<24} {:>8} {:>9} {:>12.0f} {:>14.0f} {:>8.2f} '
+              '{:>8.0f}'.format(r['name'], r['wait_policy'], r['blocktime'],
+                                r['wall_ns'], r['process_cpu_ns'],
+                                r['cpu_per_wall'], r['live_threads']))
+
+
+if __name__ == '__main__':
+    main()
@@ -2,6 +2,7 @@
 #include <benchmark/benchmark.h>
 #include <torch/torch.h>
 #include <ATen/cuda/CUDAContext.h>
+#include "perf_counters.h"
 
 static void BM_TensorTypeId(benchmark::State& state) {
   auto options = at::TensorOptions(at::kCUDA);
@@ -10,6 +11,7 @@ static void BM_TensorTypeId(benchmark::State& state) {
   // initialize some cuda...
   auto tmp = at::empty({0}, options);
 
+  ScopedPerfCounters perf(state);
   for (auto _ : state) {
     tmp.unsafeGetTensorImpl()->type_id();
   }
@@ -23,6 +25,7 @@ static void BM_TensorType(benchmark::State& state) {
   // initialize some cuda...
   auto tmp = at::empty({0}, options);
 
+  ScopedPerfCounters perf(state);
   for (auto _ : state) {
     tmp.type();
   }
@@ -42,6 +45,7 @@ static void BM_THCCachingAllocatorAllocate(benchmark::State& state) {
     at::DataPtr data = impl->storage().allocator()->allocate(size * 4);
   }
 
+  ScopedPerfCounters perf(state);
   for (auto _ : state) {
     at::DataPtr data = impl->storage().allocator()->allocate(size * 4);
   }
@@ -54,6 +58,7 @@ static void BM_TensorIsCuda(benchmark::State& state) {
   // initialize some cuda...
   auto tmp = at::empty({0}, options);
 
+  ScopedPerfCounters perf(state);
   for (auto _ : state) {
     benchmark::DoNotOptimize(tmp.is_cuda());
   }
@@ -66,6 +71,7 @@ static void BM_TensorDim(benchmark::State& state) {
   // initialize some cuda...
   auto tmp = at::empty({0}, options);
 
+  ScopedPerfCounters perf(state);
   for (auto _ : state) {
     benchmark::DoNotOptimize(tmp.dim());
   }
@@ -78,6 +84,7 @@ static void BM_TensorIsSparse(benchmark::State& state) {
   // initialize some cuda...
   auto tmp = at::empty({0}, options);
 
+  ScopedPerfCounters perf(state);
   for (auto _ : state) {
     benchmark::DoNotOptimize(tmp.is_sparse());
   }
@@ -90,6 +97,7 @@ static void BM_TensorTypeIsCuda(benchmark::State& state) {
   // initialize some cuda...
   auto tmp = at::empty({0}, options);
 
+  ScopedPerfCounters perf(state);
   for (auto _ : state) {
     benchmark::DoNotOptimize(tmp.type().is_cuda());
   }
@@ -102,6 +110,7 @@ static void BM_TensorNumel(benchmark::State& state) {
   // initialize some cuda...
   auto tmp = at::empty({0}, options);
 
+  ScopedPerfCounters perf(state);
   for (auto _ : state) {
     benchmark::DoNotOptimize(tmp.numel());
   }
@@ -115,6 +124,7 @@ static void BM_CudaAPIGetDevice(benchmark::State& state) {
   auto tmp = at::empty({0}, options);
   int32_t device;
 
+  ScopedPerfCounters perf(state);
   for (auto _ : state) {
     benchmark::DoNotOptimize(cudaGetDevice(&device));
   }
@@ -129,6 +139,7 @@ static void BM_CudaAPISetDevice(benchmark::State& state) {
   int32_t device;
   cudaGetDevice(&device);
 
+  ScopedPerfCounters perf(state);
   for (auto _ : state) {
     benchmark::DoNotOptimize(cudaSetDevice(device));
   }
@@ -142,6 +153,7 @@ static void BM_DynamicCUDAInterfaceGetDevice(benchmark::State& state) {
   auto tmp = at::empty({0}, options);
   int32_t device;
 
+  ScopedPerfCounters perf(state);
   for (auto _ : state) {
     at::detail::DynamicCUDAInterface::get_device(&device);
   }
@@ -156,6 +168,7 @@ static void BM_DynamicCUDAInterfaceSetDevice(benchmark::State& state) {
   int32_t device;
   cudaGetDevice(&device);
 
+  ScopedPerfCounters perf(state);
   for (auto _ : state) {
     at::detail::DynamicCUDAInterface::set_device(device);
   }
@@ -169,6 +182,7 @@ static void BM_StorageImplGetDevice(benchmark::State& state) {
   auto tmp = at::empty({0}, options);
   auto* storage_impl = tmp.unsafeGetTensorImpl()->storage().unsafeGetStorageImpl();
 
+  ScopedPerfCounters perf(state);
   for (auto _ : state) {
     benchmark::DoNotOptimize(storage_impl->device().index());
   }
@@ -182,6 +196,7 @@ static void BM_TensorImplGetDevice(benchmark::State& state) {
   auto tmp = at::empty({0}, options);
   auto* tensor_impl = tmp.unsafeGetTensorImpl();
 
+  ScopedPerfCounters perf(state);
   for (auto _ : state) {
     benchmark::DoNotOptimize(
         tensor_impl->storage().unsafeGetStorageImpl()->device().index());
@@ -195,6 +210,7 @@ static void BM_TensorGetDeviceDirect(benchmark::State& state) {
   // initialize some cuda...
   auto tmp = at::empty({0}, options);
 
+  ScopedPerfCounters perf(state);
   for (auto _ : state) {
     benchmark::DoNotOptimize(
         tmp.unsafeGetTensorImpl()->storage().unsafeGetStorageImpl()->device().index());
@@ -222,6 +238,7 @@ static void BM_TensorGetDevice(benchmark::State& state) {
   // initialize some cuda...
   auto tmp = at::empty({0}, options);
 
+  ScopedPerfCounters perf(state);
   for (auto _ : state) {
     benchmark::DoNotOptimize(tmp.get_device());
   }
@@ -236,6 +253,7 @@ static void BM_DeviceGuardCtor(benchmark::State& state) {
   auto tmp = at::empty({0}, options);
   void* mem = malloc(sizeof(at::DeviceGuard));
 
+  ScopedPerfCounters perf(state);
   for (auto _ : state) {
     benchmark::DoNotOptimize(new (mem) at::DeviceGuard(tmp));
   }
@@ -250,6 +268,7 @@ static void BM_DeviceGuard(benchmark::State& state) {
   // initialize some cuda...
   auto tmp = at::empty({0}, options);
 
+  ScopedPerfCounters perf(state);
   for (auto _ : state) {
     {
       const at::DeviceGuard guard(tmp);
@@ -266,6 +285,7 @@ static void BM_EmptyTensorNoopResize(benchmark::State& state) {
   auto tmp = at::empty({0}, options);
   tmp.resize_(sizes);
 
+  ScopedPerfCounters perf(state);
   for (auto _ : state) {
     tmp.resize_(sizes);
   }
@@ -294,6 +314,7 @@ static void BM_TensorNoopResize(benchmark::State& state) {
   auto tmp = at::empty({0}, options);
   tmp.resize_(sizes);
 
+  ScopedPerfCounters perf(state);
   for (auto _ : state) {
     tmp.resize_(sizes);
   }
@@ -305,6 +326,7 @@ static void BM_TensorAsStrided(benchmark::State& state) {
   std::vector<long int> strides({1, 300});
   std::vector<long int> sizes({300, 8});
 
+  ScopedPerfCounters perf(state);
   for (auto _ : state)
     benchmark::DoNotOptimize(tensor.as_strided(strides, sizes));
 }
@@ -316,6 +338,7 @@ static void BM_AtenEmptyCuda(benchmark::State& state) {
   // initialize some cuda...
   auto tmp = at::empty({0}, options);
 
+  ScopedPerfCounters perf(state);
   for (auto _ : state) {
     auto tensor = at::native::empty_cuda({0}, options);
   }
@@ -328,6 +351,7 @@ static void BM_AtenEmpty(benchmark::State& state) {
   // initialize some cuda...
   auto tmp = at::empty({0}, options);
 
+  ScopedPerfCounters perf(state);
   for (auto _ : state) {
     auto tensor = at::empty({0}, options);
   }
@@ -340,6 +364,7 @@ static void BM_VariableEmpty(benchmark::State& state) {
   // initialize some cuda...
   auto tmp = torch::empty({0}, options);
 
+  ScopedPerfCounters perf(state);
   for (auto _ : state) {
     auto tensor = torch::empty({0}, options);
   }
@@ -354,6 +379,7 @@ static void BM_AtenEmptyResize(benchmark::State& state) {
   auto tmp = at::empty({0}, options);
   tmp.resize_(sizes);
 
+  ScopedPerfCounters perf(state);
   for (auto _ : state) {
     auto tensor = at::empty({0}, options);
     tensor.resize_(sizes);
@@ -369,6 +395,7 @@ static void BM_AtenEmptyNoResize(benchmark::State& state) {
   auto tmp = at::empty({0}, options);
   tmp.resize_(sizes);
 
+  ScopedPerfCounters perf(state);
   for (auto _ : state) {
     auto tensor = at::empty(sizes, options);
   }
@@ -385,6 +412,7 @@ static void BM_VariableEmptyResize(benchmark::State& state) {
   auto tmp = torch::empty(zero, options);
   tmp.resize_(sizes);
 
+  ScopedPerfCounters perf(state);
   for (auto _ : state) {
     auto tensor = torch::empty(zero, options);
     tensor.resize_(sizes);
@@ -401,6 +429,7 @@ static void BM_VariableEmptyNoResize(benchmark::State& state) {
   auto tmp = torch::empty(zero, options);
   tmp.resize_(sizes);
 
+  ScopedPerfCounters perf(state);
   for (auto _ : state) {
     benchmark::DoNotOptimize(torch::empty(sizes, options));
   }
@@ -414,6 +443,7 @@ static void BM_MakeStorage(benchmark::State& state) {
   // initialize some cuda...
   auto tmp = torch::empty({0}, options);
 
+  ScopedPerfCounters perf(state);
   for (auto _ : state) {
     benchmark::DoNotOptimize(
         c10::make_intrusive<at::StorageImpl>(
@@ -433,6 +463,7 @@ static void BM_StorageCtor(benchmark::State& state) {
 
   void* mem = malloc(sizeof(at::StorageImpl));
 
+  ScopedPerfCounters perf(state);
   for (auto _ : state) {
     benchmark::DoNotOptimize(
         new (mem) at::StorageImpl(
@@ -447,6 +478,7 @@ static void BM_StorageCtor(benchmark::State& state) {
 BENCHMARK(BM_StorageCtor);
 
 static void BM_MallocOverhead(benchmark::State& state) {
+  ScopedPerfCounters perf(state);
   for (auto _ : state) {
     benchmark::DoNotOptimize(malloc(1));
   }
@@ -454,6 +486,7 @@ static void BM_MallocOverhead(benchmark::State& state) {
 BENCHMARK(BM_MallocOverhead);
 
 static void BM_StorageMalloc(benchmark::State& state) {
+  ScopedPerfCounters perf(state);
   for (auto _ : state) {
     // NB: leaks memory
     benchmark::DoNotOptimize(malloc(sizeof(at::StorageImpl)));
@@ -467,6 +500,7 @@ static void BM_ScalarTypeToTypeMeta(benchmark::State& state) {
   // initialize some cuda...
   auto tmp = torch::empty({0}, options);
 
+  ScopedPerfCounters perf(state);
   for (auto _ : state) {
     benchmark::DoNotOptimize(
         at::scalarTypeToTypeMeta(options.dtype()));
@@ -486,6 +520,7 @@ static void BM_MakeTensorFromStorage(benchmark::State& state) {
             at::cuda::getCUDADeviceAllocator(),
             true);
 
+  ScopedPerfCounters perf(state);
   for (auto _ : state) {
     benchmark::DoNotOptimize(
         at::detail::make_tensor<at::TensorImpl>(storage, at::CUDATensorId(), false));
@@ -507,6 +542,7 @@ static void BM_MakeVariableFromTensor(benchmark::State& state) {
   auto tensor = at::detail::make_tensor<at::TensorImpl>(
       storage_impl, at::CUDATensorId(), false);
 
+  ScopedPerfCounters perf(state);
   for (auto _ : state) {
     benchmark::DoNotOptimize(
         torch::autograd::make_variable(tensor, false));
@@ -522,6 +558,7 @@ static void BM_CheckedTensorUnwrap(benchmark::State& state) {
   // initialize some cuda...
   auto tmp = at::empty({0}, options);
 
+  ScopedPerfCounters perf(state);
   for (auto _ : state) {
     benchmark::DoNotOptimize(
         at::checked_tensor_unwrap(tmp,"self",1, false, at::Backend::CUDA, at::ScalarType::Float));